@@ -54,6 +54,12 @@ namespace nymeaserver {
 
 QList<QWebSocket*> DebugServerHandler::s_websocketClients;
 QMutex DebugServerHandler::s_loggingMutex;
+DebugServerHandler *DebugServerHandler::s_logReceiver = nullptr;
+QStringList DebugServerHandler::s_pendingLogMessages;
+int DebugServerHandler::s_droppedLogMessages = 0;
+
+// Maximum number of log messages waiting to be sent to the websocket clients
+static const int maxPendingLogMessages = 10000;
 
 DebugServerHandler::DebugServerHandler(QObject *parent) :
     QObject(parent)
@@ -62,6 +68,15 @@ DebugServerHandler::DebugServerHandler(QObject *parent) :
     onDebugServerEnabledChanged(NymeaCore::instance()->configuration()->debugServerEnabled());
 }
 
+DebugServerHandler::~DebugServerHandler()
+{
+    QMutexLocker locker(&s_loggingMutex);
+    if (s_logReceiver == this) {
+        s_logReceiver = nullptr;
+        s_pendingLogMessages.clear();
+    }
+}
+
 HttpReply *DebugServerHandler::processDebugRequest(const QString &requestPath, const QUrlQuery &requestQuery)
 {
     qCDebug(dcDebugServer()) << "Debug request for" << requestPath;
@@ -573,9 +588,42 @@ void DebugServerHandler::logMessageHandler(QtMsgType type, const QMessageLogCont
         break;
     }
 
+    // Only queue the message here, it may be logged from any thread. The clients are served in batches from the event loop.
     QMutexLocker locker(&s_loggingMutex);
+    if (!s_logReceiver) {
+        return;
+    }
+    if (s_pendingLogMessages.count() >= maxPendingLogMessages) {
+        s_droppedLogMessages++;
+        return;
+    }
+    s_pendingLogMessages.append(finalMessage);
+    if (s_pendingLogMessages.count() == 1) {
+        QMetaObject::invokeMethod(s_logReceiver, "sendLogMessages", Qt::QueuedConnection);
+    }
+}
+
+void DebugServerHandler::sendLogMessages()
+{
+    QStringList messages;
+    int dropped = 0;
+    {
+        QMutexLocker locker(&s_loggingMutex);
+        messages.swap(s_pendingLogMessages);
+        dropped = s_droppedLogMessages;
+        s_droppedLogMessages = 0;
+    }
+
+    if (dropped > 0) {
+        messages.append(QString(" W | DebugServer: Dropped %1 log messages.\n").arg(dropped));
+    }
+    if (messages.isEmpty()) {
+        return;
+    }
+
+    QString batch = messages.join(QString());
     foreach (QWebSocket *client, s_websocketClients) {
-        client->sendTextMessage(finalMessage);
+        client->sendTextMessage(batch);
     }
 }
 
@@ -655,6 +703,9 @@ void DebugServerHandler::onWebsocketClientConnected()
     if (s_websocketClients.isEmpty()) {
         qCDebug(dcDebugServer()) << "Install debug message handler for live logs.";
         //QLoggingCategory::setFilterRules("*.debug=true");
+        QMutexLocker locker(&s_loggingMutex);
+        s_logReceiver = this;
+        locker.unlock();
         nymeaInstallMessageHandler(&logMessageHandler);
     }
 
@@ -675,6 +726,10 @@ void DebugServerHandler::onWebsocketClientDisconnected()
     if (s_websocketClients.isEmpty()) {
         qCDebug(dcDebugServer()) << "Uninstalling debug message handler for live logs.";
         nymeaUninstallMessageHandler(&logMessageHandler);
+        QMutexLocker locker(&s_loggingMutex);
+        s_logReceiver = nullptr;
+        s_pendingLogMessages.clear();
+        s_droppedLogMessages = 0;
     }
 }
 
@@ -48,6 +48,7 @@ class DebugServerHandler : public QObject
     Q_OBJECT
 public:
     explicit DebugServerHandler(QObject *parent = nullptr);
+    ~DebugServerHandler() override;
 
     HttpReply *processDebugRequest(const QString &requestPath, const QUrlQuery &requestQuery);
 
@@ -55,6 +56,10 @@ private:
     static QList<QWebSocket*> s_websocketClients;
     static void logMessageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message);
     static QMutex s_loggingMutex;
+    // Log messages waiting to be sent to the websocket clients, guarded by s_loggingMutex
+    static DebugServerHandler *s_logReceiver;
+    static QStringList s_pendingLogMessages;
+    static int s_droppedLogMessages;
 
     QWebSocketServer *m_websocketServer = nullptr;
 
@@ -81,6 +86,8 @@ private:
 private slots:
     void onDebugServerEnabledChanged(bool enabled);
 
+    void sendLogMessages();
+
     void onWebsocketClientConnected();
     void onWebsocketClientDisconnected();
     void onWebsocketClientError(QAbstractSocket::SocketError error);
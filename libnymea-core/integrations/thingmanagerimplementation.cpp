@@ -69,6 +69,9 @@
 #include <QStandardPaths>
 #include <QDir>
 #include <QJsonDocument>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrentRun>
 
 ThingManagerImplementation::ThingManagerImplementation(HardwareManager *hardwareManager, const QLocale &locale, QObject *parent) :
     ThingManager(parent),
@@ -92,6 +95,12 @@ ThingManagerImplementation::ThingManagerImplementation(HardwareManager *hardware
 
     m_apiKeysProvidersLoader = new ApiKeysProvidersLoader(this);
 
+    // Cached states are collected and written in batches to reduce disk writes
+    m_stateCacheFlushTimer = new QTimer(this);
+    m_stateCacheFlushTimer->setSingleShot(true);
+    m_stateCacheFlushTimer->setInterval(10000);
+    connect(m_stateCacheFlushTimer, &QTimer::timeout, this, &ThingManagerImplementation::flushThingStates);
+
     // Give hardware a chance to start up before loading plugins etc.
     QMetaObject::invokeMethod(this, "loadPlugins", Qt::QueuedConnection);
     QMetaObject::invokeMethod(this, "loadConfiguredThings", Qt::QueuedConnection);
@@ -112,8 +121,9 @@ ThingManagerImplementation::~ThingManagerImplementation()
 
     foreach (Thing *thing, m_configuredThings) {
         storeThingStates(thing);
-        delete thing;
     }
+    flushThingStates();
+    qDeleteAll(m_configuredThings);
 
     foreach (IntegrationPlugin *plugin, m_integrationPlugins) {
         if (plugin->parent() == this) {
@@ -129,6 +139,11 @@ ThingManagerImplementation::~ThingManagerImplementation()
 #endif
 }
 
+void ThingManagerImplementation::setStateCacheFlushInterval(int msecs)
+{
+    m_stateCacheFlushTimer->setInterval(qMax(0, msecs));
+}
+
 QStringList ThingManagerImplementation::pluginSearchDirs()
 {
     QStringList searchDirs;
@@ -822,10 +837,11 @@ Thing::ThingError ThingManagerImplementation::removeConfiguredThing(const ThingI
     // don't end up aborting an already finished setup instead of calling thingRemoved() on it.
     qApp->processEvents();
 
-    Thing *thing = m_configuredThings.take(thingId);
+    Thing *thing = m_configuredThings.value(thingId);
     if (!thing) {
         return Thing::ThingErrorThingNotFound;
     }
+    unregisterThing(thing);
     IntegrationPlugin *plugin = m_integrationPlugins.value(thing->pluginId());
     if (!plugin) {
         qCWarning(dcThingManager()).nospace() << "Plugin not loaded for thing " << thing->name() << ". Not calling thingRemoved on plugin.";
@@ -845,6 +861,7 @@ Thing::ThingError ThingManagerImplementation::removeConfiguredThing(const ThingI
     settings.remove("");
     settings.endGroup();
 
+    m_dirtyThingStates.remove(thingId);
     NymeaSettings stateCache(NymeaSettings::SettingsRoleThingStates);
     stateCache.remove(thingId.toString());
 
@@ -1212,12 +1229,7 @@ Vendor ThingManagerImplementation::translateVendor(const Vendor &vendor, const Q
 
 Thing *ThingManagerImplementation::findConfiguredThing(const ThingId &id) const
 {
-    foreach (Thing *thing, m_configuredThings) {
-        if (thing->id() == id) {
-            return thing;
-        }
-    }
-    return nullptr;
+    return m_configuredThings.value(id);
 }
 
 Things ThingManagerImplementation::configuredThings() const
@@ -1227,36 +1239,21 @@ Things ThingManagerImplementation::configuredThings() const
 
 Things ThingManagerImplementation::findConfiguredThings(const ThingClassId &thingClassId) const
 {
-    QList<Thing*> ret;
-    foreach (Thing *thing, m_configuredThings) {
-        if (thing->thingClassId() == thingClassId) {
-            ret << thing;
-        }
-    }
-    return ret;
+    return m_thingClassThings.value(thingClassId);
 }
 
 Things ThingManagerImplementation::findConfiguredThings(const QString &interface) const
 {
     QList<Thing*> ret;
-    foreach (Thing *thing, m_configuredThings) {
-        ThingClass thingClass = m_supportedThings.value(thing->thingClassId());
-        if (thingClass.interfaces().contains(interface)) {
-            ret.append(thing);
-        }
+    foreach (const ThingClassId &thingClassId, m_interfaceThingClasses.value(interface)) {
+        ret.append(m_thingClassThings.value(thingClassId));
     }
     return ret;
 }
 
 Things ThingManagerImplementation::findChilds(const ThingId &id) const
 {
-    QList<Thing *> ret;
-    foreach (Thing *d, m_configuredThings) {
-        if (d->parentId() == id) {
-            ret.append(d);
-        }
-    }
-    return ret;
+    return m_childThings.value(id);
 }
 
 ThingClass ThingManagerImplementation::findThingClass(const ThingClassId &thingClassId) const
@@ -1325,8 +1322,18 @@ ThingActionInfo *ThingManagerImplementation::executeAction(const Action &action)
     return info;
 }
 
+// Reads and parses the metadata of a C++ plugin without loading the library. Runs on the global thread pool.
+static PluginMetadata readCppPluginMetadata(const QString &absoluteFilePath)
+{
+    QPluginLoader loader(absoluteFilePath);
+    return PluginMetadata(loader.metaData().value("MetaData").toObject(), false, false);
+}
+
 void ThingManagerImplementation::loadPlugins()
-{    
+{
+    QElapsedTimer timer;
+    timer.start();
+
     QStringList searchDirs;
     // Add first level of subdirectories to the plugin search dirs so we can point to a collection of plugins
     foreach (const QString &path, pluginSearchDirs()) {
@@ -1337,59 +1344,88 @@ void ThingManagerImplementation::loadPlugins()
         }
     }
 
+    QStringList pluginFiles;
     foreach (const QString &path, searchDirs) {
         QDir dir(path);
         qCDebug(dcThingManager) << "Loading plugins from:" << dir.absolutePath();
         foreach (const QString &entry, dir.entryList({"*.so", "*.js", "*.py"}, QDir::Files)) {
+            pluginFiles.append(path + '/' + entry);
+        }
+    }
 
-            IntegrationPlugin *plugin = nullptr;
+    // Parsing the metadata is the expensive part of loading C++ plugins and doesn't require loading the library.
+    // Do that for all of them in parallel while the plugins are loaded and registered one by one in the order found.
+    QHash<QString, QFuture<PluginMetadata> > cppMetadata;
+    foreach (const QString &pluginFile, pluginFiles) {
+        QFileInfo fi(pluginFile);
+        if (fi.fileName().startsWith("libnymea_integrationplugin") && fi.fileName().endsWith(".so")) {
+            cppMetadata.insert(pluginFile, QtConcurrent::run(readCppPluginMetadata, fi.absoluteFilePath()));
+        }
+    }
 
-            QFileInfo fi(path + '/' + entry);
-            if (entry.startsWith("libnymea_integrationplugin") && entry.endsWith(".so")) {
-                plugin = createCppIntegrationPlugin(fi.absoluteFilePath());
+    QList<QPair<QString, qint64> > pluginTimes;
+    foreach (const QString &pluginFile, pluginFiles) {
+        QElapsedTimer pluginTimer;
+        pluginTimer.start();
 
-            } else if (entry.startsWith("integrationplugin") && entry.endsWith(".js")) {
+        IntegrationPlugin *plugin = nullptr;
+
+        QFileInfo fi(pluginFile);
+        QString entry = fi.fileName();
+        if (cppMetadata.contains(pluginFile)) {
+            plugin = createCppIntegrationPlugin(fi.absoluteFilePath(), cppMetadata.value(pluginFile).result());
+
+        } else if (entry.startsWith("integrationplugin") && entry.endsWith(".js")) {
 #if QT_VERSION >= QT_VERSION_CHECK(5,12,0)
-                ScriptIntegrationPlugin *p = new ScriptIntegrationPlugin(this);
-                bool ok = p->loadScript(fi.absoluteFilePath());
-                if (ok) {
-                    plugin = p;
-                } else {
-                    delete p;
-                }
+            ScriptIntegrationPlugin *p = new ScriptIntegrationPlugin(this);
+            bool ok = p->loadScript(fi.absoluteFilePath());
+            if (ok) {
+                plugin = p;
+            } else {
+                delete p;
+            }
 #else
-                qCWarning(dcThingManager()) << "Not loading JS plugin as JS plugin support is not included in this nymea instance.";
+            qCWarning(dcThingManager()) << "Not loading JS plugin as JS plugin support is not included in this nymea instance.";
 #endif
-            } else if (entry.startsWith("integrationplugin") && entry.endsWith(".py")) {
+        } else if (entry.startsWith("integrationplugin") && entry.endsWith(".py")) {
 #ifdef WITH_PYTHON
-                PythonIntegrationPlugin *p = new PythonIntegrationPlugin(this);
-                bool ok = p->loadScript(fi.absoluteFilePath());
-                if (ok) {
-                    plugin = p;
-                } else {
-                    delete p;
-                }
-#else
-                qCWarning(dcThingManager()) << "Not loading Python plugin as Python plugin support is not included in this nymea instance.";
-#endif
+            PythonIntegrationPlugin *p = new PythonIntegrationPlugin(this);
+            bool ok = p->loadScript(fi.absoluteFilePath());
+            if (ok) {
+                plugin = p;
             } else {
-                // Not a known plugin type
-                continue;
+                delete p;
             }
+#else
+            qCWarning(dcThingManager()) << "Not loading Python plugin as Python plugin support is not included in this nymea instance.";
+#endif
+        } else {
+            // Not a known plugin type
+            continue;
+        }
 
-            if (!plugin) {
-                qCWarning(dcThingManager()) << "Error loading plugin:" << fi.absoluteFilePath();
-                continue;
-            }
+        if (!plugin) {
+            qCWarning(dcThingManager()) << "Error loading plugin:" << fi.absoluteFilePath();
+            continue;
+        }
 
-            if (m_integrationPlugins.contains(plugin->pluginId())) {
-                qCWarning(dcThingManager()) << "A plugin with this ID is already loaded. Not loading" << entry << plugin->pluginId();
-                delete plugin;
-                continue;
-            }
-            loadPlugin(plugin);
-            PluginInfoCache::cachePluginInfo(plugin->metadata().jsonObject());
+        if (m_integrationPlugins.contains(plugin->pluginId())) {
+            qCWarning(dcThingManager()) << "A plugin with this ID is already loaded. Not loading" << entry << plugin->pluginId();
+            delete plugin;
+            continue;
         }
+        loadPlugin(plugin);
+        PluginInfoCache::cachePluginInfo(plugin->metadata().jsonObject());
+        pluginTimes.append(qMakePair(plugin->pluginName(), pluginTimer.elapsed()));
+    }
+
+    // Startup timing report
+    qCInfo(dcThingManager()) << "Loaded" << pluginTimes.count() << "plugins in" << timer.elapsed() << "ms using" << QThreadPool::globalInstance()->maxThreadCount() << "threads for parsing";
+    std::sort(pluginTimes.begin(), pluginTimes.end(), [](const QPair<QString, qint64> &a, const QPair<QString, qint64> &b){
+        return a.second > b.second;
+    });
+    for (int i = 0; i < qMin(5, pluginTimes.count()); i++) {
+        qCDebug(dcThingManager()).nospace() << "* " << pluginTimes.at(i).first << ": " << pluginTimes.at(i).second << " ms";
     }
 }
 
@@ -1433,7 +1469,7 @@ void ThingManagerImplementation::loadPlugin(IntegrationPlugin *pluginIface)
             continue;
         }
         m_vendorThingMap[thingClass.vendorId()].append(thingClass.id());
-        m_supportedThings.insert(thingClass.id(), thingClass);
+        registerThingClass(thingClass);
         qCDebug(dcThingManager) << "* Loaded thing class:" << thingClass.name();
     }
 
@@ -1512,7 +1548,7 @@ void ThingManagerImplementation::loadConfiguredThings()
                 PluginMetadata pluginMetadata(pluginInfo, false, false);
                 thingClass = pluginMetadata.thingClasses().findById(thingClassId);
                 if (thingClass.isValid()) {
-                    m_supportedThings.insert(thingClassId, thingClass);
+                    registerThingClass(thingClass);
                     if (!m_supportedVendors.contains(thingClass.vendorId())) {
                         Vendor vendor = pluginMetadata.vendors().findById(thingClass.vendorId());
                         m_supportedVendors.insert(vendor.id(), vendor);
@@ -1791,6 +1827,28 @@ void ThingManagerImplementation::cleanupThingStateCache()
     }
 }
 
+void ThingManagerImplementation::flushThingStates()
+{
+    m_stateCacheFlushTimer->stop();
+    if (m_dirtyThingStates.isEmpty()) {
+        return;
+    }
+
+    NymeaSettings settings(NymeaSettings::SettingsRoleThingStates);
+    foreach (const ThingId &thingId, m_dirtyThingStates.keys()) {
+        Thing *thing = m_configuredThings.value(thingId);
+        if (!thing) {
+            continue;
+        }
+        settings.beginGroup(thingId.toString());
+        foreach (const StateTypeId &stateTypeId, m_dirtyThingStates.value(thingId)) {
+            settings.setValue(stateTypeId.toString(), thing->stateValue(stateTypeId));
+        }
+        settings.endGroup();
+    }
+    m_dirtyThingStates.clear();
+}
+
 void ThingManagerImplementation::onEventTriggered(Event event)
 {
     // Doing some sanity checks here...
@@ -2206,13 +2264,44 @@ void ThingManagerImplementation::trySetupThing(Thing *thing)
 void ThingManagerImplementation::registerThing(Thing *thing)
 {
     m_configuredThings.insert(thing->id(), thing);
+    m_thingClassThings[thing->thingClassId()].append(thing);
+    if (!thing->parentId().isNull()) {
+        m_childThings[thing->parentId()].append(thing);
+    }
     connect(thing, &Thing::eventTriggered, this, &ThingManagerImplementation::onEventTriggered);
     connect(thing, &Thing::stateValueChanged, this, &ThingManagerImplementation::slotThingStateValueChanged);
     connect(thing, &Thing::settingChanged, this, &ThingManagerImplementation::slotThingSettingChanged);
     connect(thing, &Thing::nameChanged, this, &ThingManagerImplementation::slotThingNameChanged);
 }
 
-IntegrationPlugin *ThingManagerImplementation::createCppIntegrationPlugin(const QString &absoluteFilePath)
+void ThingManagerImplementation::unregisterThing(Thing *thing)
+{
+    m_configuredThings.remove(thing->id());
+
+    m_thingClassThings[thing->thingClassId()].removeAll(thing);
+    if (m_thingClassThings.value(thing->thingClassId()).isEmpty()) {
+        m_thingClassThings.remove(thing->thingClassId());
+    }
+
+    if (!thing->parentId().isNull()) {
+        m_childThings[thing->parentId()].removeAll(thing);
+        if (m_childThings.value(thing->parentId()).isEmpty()) {
+            m_childThings.remove(thing->parentId());
+        }
+    }
+}
+
+void ThingManagerImplementation::registerThingClass(const ThingClass &thingClass)
+{
+    m_supportedThings.insert(thingClass.id(), thingClass);
+    foreach (const QString &interface, thingClass.interfaces()) {
+        if (!m_interfaceThingClasses.value(interface).contains(thingClass.id())) {
+            m_interfaceThingClasses[interface].append(thingClass.id());
+        }
+    }
+}
+
+IntegrationPlugin *ThingManagerImplementation::createCppIntegrationPlugin(const QString &absoluteFilePath, const PluginMetadata &metaData)
 {
     // Check plugin API version compatibility
     QLibrary lib(absoluteFilePath);
@@ -2248,8 +2337,6 @@ IntegrationPlugin *ThingManagerImplementation::createCppIntegrationPlugin(const
         return nullptr;
     }
 
-    QJsonObject pluginInfo = loader.metaData().value("MetaData").toObject();
-    PluginMetadata metaData(pluginInfo, false, false);
     if (!metaData.isValid()) {
         foreach (const QString &error, metaData.validationErrors()) {
             qCWarning(dcThingManager()) << error;
@@ -2284,9 +2371,10 @@ void ThingManagerImplementation::storeThingStates(Thing *thing)
 
 void ThingManagerImplementation::storeThingState(Thing *thing, const StateTypeId &stateTypeId)
 {
-    NymeaSettings settings(NymeaSettings::SettingsRoleThingStates);
-    settings.beginGroup(thing->id().toString());
-    settings.setValue(stateTypeId.toString(), thing->stateValue(stateTypeId));
-    settings.endGroup();
+    // Only mark the state as dirty, the current value will be written on the next flush
+    m_dirtyThingStates[thing->id()].insert(stateTypeId);
+    if (!m_stateCacheFlushTimer->isActive()) {
+        m_stateCacheFlushTimer->start();
+    }
 }
 
@@ -46,6 +46,7 @@
 
 #include <QObject>
 #include <QTimer>
+#include <QSet>
 #include <QLocale>
 #include <QPluginLoader>
 #include <QTranslator>
@@ -71,6 +72,8 @@ public:
     explicit ThingManagerImplementation(HardwareManager *hardwareManager, const QLocale &locale, QObject *parent = nullptr);
     ~ThingManagerImplementation() override;
 
+    void setStateCacheFlushInterval(int msecs);
+
     static QStringList pluginSearchDirs();
     static QList<QJsonObject> pluginsMetadata();
     void registerStaticPlugin(IntegrationPlugin* plugin);
@@ -143,6 +146,7 @@ private slots:
     void onAutoThingDisappeared(const ThingId &thingId);
     void onLoaded();
     void cleanupThingStateCache();
+    void flushThingStates();
     void onEventTriggered(Event event);
 
     // Only connect this to Things. It will query the sender()
@@ -161,6 +165,8 @@ private:
     void initThing(Thing *thing);
     void trySetupThing(Thing *thing);
     void registerThing(Thing *thing);
+    void unregisterThing(Thing *thing);
+    void registerThingClass(const ThingClass &thingClass);
     void postSetupThing(Thing *thing);
     void storeThingStates(Thing *thing);
     void storeThingState(Thing *thing, const StateTypeId &stateTypeId);
@@ -170,7 +176,7 @@ private:
     void syncIOConnection(Thing *inputThing, const StateTypeId &stateTypeId);
     QVariant mapValue(const QVariant &value, const StateType &fromStateType, const StateType &toStateType, bool inverted) const;
 
-    IntegrationPlugin *createCppIntegrationPlugin(const QString &absoluteFilePath);
+    IntegrationPlugin *createCppIntegrationPlugin(const QString &absoluteFilePath, const PluginMetadata &metaData);
 
 private:
     HardwareManager *m_hardwareManager;
@@ -182,6 +188,11 @@ private:
     QHash<VendorId, QList<ThingClassId> > m_vendorThingMap;
     QHash<ThingClassId, ThingClass> m_supportedThings;
     QHash<ThingId, Thing*> m_configuredThings;
+    QHash<ThingId, QSet<StateTypeId> > m_dirtyThingStates;
+    QTimer *m_stateCacheFlushTimer = nullptr;
+    QHash<ThingClassId, QList<Thing*> > m_thingClassThings;
+    QHash<ThingId, QList<Thing*> > m_childThings;
+    QHash<QString, QList<ThingClassId> > m_interfaceThingClasses;
     QHash<ThingDescriptorId, ThingDescriptor> m_discoveredThings;
 
     QHash<PluginId, IntegrationPlugin*> m_integrationPlugins;
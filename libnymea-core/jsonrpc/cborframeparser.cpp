@@ -0,0 +1,198 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "cborframeparser.h"
+
+#include <limits>
+
+namespace nymeaserver {
+
+QList<QByteArray> CborFrameParser::append(const QByteArray &data)
+{
+    QList<QByteArray> frames;
+    m_buffer.append(data);
+
+    const uchar *buffer = reinterpret_cast<const uchar *>(m_buffer.constData());
+    const int size = m_buffer.size();
+    while (m_scanPosition < size) {
+        if (m_pendingItems.isEmpty()) {
+            // Start of a new top level item
+            m_pendingItems.append(1);
+        }
+
+        const uchar initialByte = buffer[m_scanPosition];
+        const int majorType = initialByte >> 5;
+        const int additionalInfo = initialByte & 0x1f;
+        bool itemFinished = false;
+        bool incomplete = false;
+        bool invalid = false;
+
+        if (initialByte == 0xff) {
+            // Break, ends a container or string of indefinite length
+            if (m_pendingItems.last() != -1) {
+                invalid = true;
+            } else {
+                m_pendingItems.removeLast();
+                m_scanPosition++;
+                itemFinished = true;
+            }
+        } else if (additionalInfo >= 28 && additionalInfo <= 30) {
+            invalid = true;
+        } else {
+            int argumentSize = 0;
+            if (additionalInfo >= 24 && additionalInfo <= 27) {
+                argumentSize = 1 << (additionalInfo - 24);
+            }
+            const int headerSize = 1 + argumentSize;
+            if (size - m_scanPosition < headerSize) {
+                // Wait for the rest of the header
+                break;
+            }
+
+            quint64 argument = static_cast<quint64>(additionalInfo);
+            if (argumentSize > 0) {
+                argument = 0;
+                for (int i = 1; i <= argumentSize; i++) {
+                    argument = (argument << 8) | buffer[m_scanPosition + i];
+                }
+            }
+            const bool indefinite = additionalInfo == 31;
+
+            switch (majorType) {
+            case 2:
+            case 3:
+                // Byte and text strings
+                if (indefinite) {
+                    m_pendingItems.append(-1);
+                    m_scanPosition += headerSize;
+                } else if (argument > static_cast<quint64>(size - m_scanPosition - headerSize)) {
+                    // Wait for the rest of the string
+                    incomplete = true;
+                } else {
+                    m_scanPosition += headerSize + static_cast<int>(argument);
+                    itemFinished = true;
+                }
+                break;
+            case 4:
+            case 5:
+                // Arrays and maps, a map holds a key and a value per entry
+                m_scanPosition += headerSize;
+                if (indefinite) {
+                    m_pendingItems.append(-1);
+                } else if (argument > static_cast<quint64>(std::numeric_limits<int>::max())) {
+                    invalid = true;
+                } else if (argument == 0) {
+                    itemFinished = true;
+                } else {
+                    m_pendingItems.append(majorType == 5 ? argument * 2 : argument);
+                }
+                break;
+            case 6:
+                // A tag applies to the item following it
+                m_scanPosition += headerSize;
+                break;
+            default:
+                // Integers, simple values and floats
+                m_scanPosition += headerSize;
+                itemFinished = true;
+                break;
+            }
+        }
+
+        if (incomplete) {
+            break;
+        }
+
+        if (invalid) {
+            // Hand everything over, the decoder reports the error
+            m_scanPosition = size;
+            m_pendingItems.clear();
+            itemFinished = true;
+        }
+
+        if (itemFinished && finishItem()) {
+            frames.append(m_buffer.mid(m_frameStart, m_scanPosition - m_frameStart));
+            m_frameStart = m_scanPosition;
+        }
+    }
+
+    compact();
+    return frames;
+}
+
+int CborFrameParser::pendingSize() const
+{
+    return m_buffer.size() - m_frameStart;
+}
+
+void CborFrameParser::clear()
+{
+    m_buffer.clear();
+    m_frameStart = 0;
+    m_scanPosition = 0;
+    m_pendingItems.clear();
+}
+
+// Counts a finished item in its container. Returns true if this completes the top level item.
+bool CborFrameParser::finishItem()
+{
+    while (!m_pendingItems.isEmpty()) {
+        if (m_pendingItems.last() == -1) {
+            // Containers of indefinite length end with a break
+            return false;
+        }
+        if (--m_pendingItems.last() > 0) {
+            return false;
+        }
+        // The container is complete, which finishes an item in its parent
+        m_pendingItems.removeLast();
+    }
+    return true;
+}
+
+void CborFrameParser::compact()
+{
+    if (m_frameStart == 0) {
+        return;
+    }
+
+    // Only move the remaining data once the consumed part dominates the buffer in order to keep appends amortized
+    if (m_frameStart == m_buffer.size()) {
+        m_buffer.clear();
+    } else if (m_frameStart >= m_buffer.size() / 2) {
+        m_buffer.remove(0, m_frameStart);
+    } else {
+        return;
+    }
+    m_scanPosition -= m_frameStart;
+    m_frameStart = 0;
+}
+
+}
@@ -0,0 +1,123 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "jsonframeparser.h"
+
+namespace nymeaserver {
+
+QList<QByteArray> JsonFrameParser::append(const QByteArray &data)
+{
+    QList<QByteArray> frames;
+    m_buffer.append(data);
+
+    const char *buffer = m_buffer.constData();
+    const int size = m_buffer.size();
+    for (int i = m_scanPosition; i < size; i++) {
+        const char c = buffer[i];
+        if (m_inString) {
+            if (m_escape) {
+                m_escape = false;
+            } else if (c == '\\') {
+                m_escape = true;
+            } else if (c == '"') {
+                m_inString = false;
+            }
+            continue;
+        }
+
+        switch (c) {
+        case '"':
+            m_inString = true;
+            break;
+        case '{':
+        case '[':
+            m_depth++;
+            break;
+        case '}':
+        case ']':
+            // Closing brackets outside of a frame are garbage and left for the JSON parser to complain about
+            if (m_depth > 0 && --m_depth == 0) {
+                frames.append(m_buffer.mid(m_frameStart, i - m_frameStart + 1));
+                m_frameStart = i + 1;
+            }
+            break;
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+            // Skip whitespace between frames
+            if (m_depth == 0 && m_frameStart == i) {
+                m_frameStart = i + 1;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    m_scanPosition = size;
+
+    compact();
+    return frames;
+}
+
+int JsonFrameParser::pendingSize() const
+{
+    return m_buffer.size() - m_frameStart;
+}
+
+void JsonFrameParser::clear()
+{
+    m_buffer.clear();
+    m_frameStart = 0;
+    m_scanPosition = 0;
+    m_depth = 0;
+    m_inString = false;
+    m_escape = false;
+}
+
+void JsonFrameParser::compact()
+{
+    if (m_frameStart == 0) {
+        return;
+    }
+
+    // Only move the remaining data once the consumed part dominates the buffer in order to keep appends amortized
+    if (m_frameStart == m_buffer.size()) {
+        m_buffer.clear();
+    } else if (m_frameStart >= m_buffer.size() / 2) {
+        m_buffer.remove(0, m_frameStart);
+    } else {
+        return;
+    }
+    m_scanPosition -= m_frameStart;
+    m_frameStart = 0;
+}
+
+}
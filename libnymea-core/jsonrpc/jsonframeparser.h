@@ -0,0 +1,69 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef JSONFRAMEPARSER_H
+#define JSONFRAMEPARSER_H
+
+#include <QByteArray>
+#include <QList>
+
+namespace nymeaserver {
+
+// Splits a stream of JSON data into top level objects (or arrays). The parser keeps its scan state
+// (nesting depth, string and escape state) between calls to append(), so every incoming byte is
+// inspected exactly once, regardless of how the stream is fragmented or whether the messages are
+// pretty printed. Consumed data is dropped lazily from the front of the buffer.
+class JsonFrameParser
+{
+public:
+    JsonFrameParser() {}
+
+    // Appends data to the buffer and returns all frames completed by it
+    QList<QByteArray> append(const QByteArray &data);
+
+    // Number of buffered bytes which do not belong to a complete frame yet
+    int pendingSize() const;
+
+    void clear();
+
+private:
+    void compact();
+
+    QByteArray m_buffer;
+    int m_frameStart = 0;
+    int m_scanPosition = 0;
+    int m_depth = 0;
+    bool m_inString = false;
+    bool m_escape = false;
+};
+
+}
+
+#endif // JSONFRAMEPARSER_H
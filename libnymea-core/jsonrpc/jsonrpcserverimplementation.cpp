@@ -79,6 +79,13 @@
 
 #include <QJsonDocument>
 #include <QStringList>
+#include <QMetaEnum>
+
+#include <limits>
+#if QT_VERSION >= QT_VERSION_CHECK(5,12,0)
+#include <QCborValue>
+#include <QCborStreamReader>
+#endif
 #include <QSslConfiguration>
 
 namespace nymeaserver {
@@ -95,6 +102,7 @@ JsonRPCServerImplementation::JsonRPCServerImplementation(const QSslConfiguration
     registerEnum<BasicType>();
     registerEnum<UserManager::UserError>();
     registerEnum<CloudManager::CloudConnectionState>();
+    registerEnum<Encoding>();
 
     // Objects
     registerObject<TokenInfo>();
@@ -122,8 +130,20 @@ JsonRPCServerImplementation::JsonRPCServerImplementation(const QSslConfiguration
                             "like initialSetupRequired might change if the setup has been performed in the meantime.\n "
                             "The field cacheHashes may contain a map of methods and MD5 hashes. As long as the hash for "
                             "a method does not change, a client may use a previously cached copy of the call instead of "
-                            "fetching the content again.";
+                            "fetching the content again.\n The optional parameter encodings lists the wire encodings "
+                            "supported by the client in order of preference. The server picks the first one it supports "
+                            "and returns it in encoding. The response to this call is still sent in the previous encoding, "
+                            "all following messages in both directions use the new one. With EncodingCbor, every message "
+                            "is a single CBOR item without any delimiter.\n If compression is set to true and the "
+                            "transport supports it, all data following the response to this call is compressed. On TCP "
+                            "connections, this is a zlib stream, flushed after each message. On WebSocket connections, "
+                            "each message is sent as a binary message, deflated as described for permessage-deflate in "
+                            "RFC 7692, with the compression context kept across messages. The returned compression "
+                            "value indicates whether compression is in use. Once enabled, compression cannot be "
+                            "disabled for the connection.";
     params.insert("o:locale", enumValueName(String));
+    params.insert("o:encodings", QVariantList() << enumRef<Encoding>());
+    params.insert("o:compression", enumValueName(Bool));
     returns.insert("server", enumValueName(String));
     returns.insert("name", enumValueName(String));
     returns.insert("version", enumValueName(String));
@@ -136,6 +156,8 @@ JsonRPCServerImplementation::JsonRPCServerImplementation(const QSslConfiguration
     returns.insert("pushButtonAuthAvailable", enumValueName(Bool));
     returns.insert("o:experiences", QVariantList() << objectRef("Experience"));
     returns.insert("o:cacheHashes", QVariantList() << objectRef("CacheHash"));
+    returns.insert("encoding", enumRef<Encoding>());
+    returns.insert("compression", enumValueName(Bool));
     registerMethod("Hello", description, params, returns);
 
     params.clear(); returns.clear();
@@ -161,9 +183,16 @@ JsonRPCServerImplementation::JsonRPCServerImplementation(const QSslConfiguration
                                             "will be enabled, the others will be disabled. The return value of \"success\" will "
                                             "indicate success of the operation. The \"enabled\" property in the return value is "
                                             "deprecated and used for legacy compatibilty only. It will be set to true if at least "
-                                            "one namespace has been enabled.";
+                                            "one namespace has been enabled.\n"
+                                            "Notifications carrying a thing or a state type can additionally be limited "
+                                            "to the given \"thingIds\" and \"stateTypeIds\". If a \"coalescingInterval\" "
+                                            "(in ms) is given, state changes are collected and only the latest value of each "
+                                            "state is sent once per interval. Calling this method again replaces all filters.";
     params.insert("o:namespaces", enumValueName(StringList));
     params.insert("d:o:enabled", enumValueName(Bool));
+    params.insert("o:thingIds", QVariantList() << enumValueName(Uuid));
+    params.insert("o:stateTypeIds", QVariantList() << enumValueName(Uuid));
+    params.insert("o:coalescingInterval", enumValueName(Uint));
     returns.insert("namespaces", enumValueName(StringList));
     returns.insert("d:enabled", enumValueName(Bool));
     registerMethod("SetNotificationStatus", description, params, returns);
@@ -283,6 +312,34 @@ JsonReply *JsonRPCServerImplementation::Hello(const QVariantMap &params, const J
         m_clientLocales.insert(clientId, QLocale(params.value("locale").toString()));
     }
 
+    if (params.contains("encodings")) {
+        // Pick the first encoding in the client's list of preference we support
+        Encoding encoding = EncodingJson;
+        QMetaEnum metaEnum = QMetaEnum::fromType<Encoding>();
+        foreach (const QVariant &requestedEncoding, params.value("encodings").toList()) {
+            int value = metaEnum.keyToValue(requestedEncoding.toByteArray());
+#if QT_VERSION >= QT_VERSION_CHECK(5,12,0)
+            if (value == EncodingCbor) {
+                encoding = EncodingCbor;
+                break;
+            }
+#endif
+            if (value == EncodingJson) {
+                break;
+            }
+        }
+        // The response to this call is still sent in the current encoding
+        if (encoding != m_clientEncodings.value(clientId)) {
+            m_pendingClientEncodings.insert(clientId, encoding);
+        } else {
+            m_pendingClientEncodings.remove(clientId);
+        }
+    }
+
+    if (params.value("compression").toBool() && !m_compressedClients.contains(clientId) && interface->compressionSupported()) {
+        m_pendingClientCompression.insert(clientId);
+    }
+
     qCDebug(dcJsonRpc()) << "Client" << clientId << "initiated handshake." << m_clientLocales.value(clientId);
 
     // If we waited for the handshake, here it is. Remove the timer...
@@ -331,6 +388,28 @@ JsonReply* JsonRPCServerImplementation::SetNotificationStatus(const QVariantMap
     qCDebug(dcJsonRpc()) << "Notification settings for client" << clientId << ":" << enabledNamespaces;
     m_clientNotifications[clientId] = enabledNamespaces;
 
+    removeNotificationFilter(clientId);
+    if (params.contains("thingIds") || params.contains("stateTypeIds") || params.value("coalescingInterval").toUInt() > 0) {
+        NotificationFilter filter;
+        foreach (const QVariant &thingId, params.value("thingIds").toList()) {
+            filter.thingIds.insert(thingId.toUuid());
+        }
+        foreach (const QVariant &stateTypeId, params.value("stateTypeIds").toList()) {
+            filter.stateTypeIds.insert(stateTypeId.toUuid());
+        }
+        filter.coalescingInterval = params.value("coalescingInterval").toInt();
+        if (filter.coalescingInterval > 0) {
+            filter.coalescingTimer = new QTimer(this);
+            filter.coalescingTimer->setSingleShot(true);
+            filter.coalescingTimer->setInterval(filter.coalescingInterval);
+            connect(filter.coalescingTimer, &QTimer::timeout, this, [this, clientId](){
+                flushCoalescedNotifications(clientId);
+            });
+        }
+        qCDebug(dcJsonRpc()) << "Notification filter for client" << clientId << "things:" << filter.thingIds << "state types:" << filter.stateTypeIds << "coalescing interval:" << filter.coalescingInterval;
+        m_clientNotificationFilters.insert(clientId, filter);
+    }
+
     QVariantMap returns;
     returns.insert("namespaces", m_clientNotifications[clientId]);
     // legacy, deprecated
@@ -500,7 +579,7 @@ bool JsonRPCServerImplementation::registerExperienceHandler(JsonHandler *handler
 /*! Send a JSON success response to the client with the given \a clientId,
  * \a commandId and \a params to the inerted \l{TransportInterface}.
  */
-void JsonRPCServerImplementation::sendResponse(TransportInterface *interface, const QUuid &clientId, int commandId, const QVariantMap &params, const QString &deprecationWarning)
+void JsonRPCServerImplementation::sendResponse(TransportInterface *interface, const QUuid &clientId, int commandId, const QVariantMap &params, const QString &deprecationWarning, int batchId, int batchIndex)
 {
     QVariantMap response;
     response.insert("id", commandId);
@@ -511,36 +590,176 @@ void JsonRPCServerImplementation::sendResponse(TransportInterface *interface, co
         response.insert("deprecationWarning", deprecationWarning);
     }
 
-    QByteArray data = QJsonDocument::fromVariant(response).toJson(QJsonDocument::Compact);
-    qCDebug(dcJsonRpcTraffic()) << "Sending data:" << data;
-    interface->sendData(clientId, data);
+    sendResponseData(interface, clientId, response, batchId, batchIndex);
 }
 
 /*! Send a JSON error response to the client with the given \a clientId,
  * \a commandId and \a error to the inerted \l{TransportInterface}.
  */
-void JsonRPCServerImplementation::sendErrorResponse(TransportInterface *interface, const QUuid &clientId, int commandId, const QString &error)
+void JsonRPCServerImplementation::sendErrorResponse(TransportInterface *interface, const QUuid &clientId, int commandId, const QString &error, int batchId, int batchIndex)
 {
     QVariantMap errorResponse;
     errorResponse.insert("id", commandId);
     errorResponse.insert("status", "error");
     errorResponse.insert("error", error);
 
-    QByteArray data = QJsonDocument::fromVariant(errorResponse).toJson(QJsonDocument::Compact);
-    qCDebug(dcJsonRpcTraffic()) << "Sending data:" << data;
-    interface->sendData(clientId, data);
+    sendResponseData(interface, clientId, errorResponse, batchId, batchIndex);
 }
 
-void JsonRPCServerImplementation::sendUnauthorizedResponse(TransportInterface *interface, const QUuid &clientId, int commandId, const QString &error)
+void JsonRPCServerImplementation::sendUnauthorizedResponse(TransportInterface *interface, const QUuid &clientId, int commandId, const QString &error, int batchId, int batchIndex)
 {
     QVariantMap errorResponse;
     errorResponse.insert("id", commandId);
     errorResponse.insert("status", "unauthorized");
     errorResponse.insert("error", error);
 
-    QByteArray data = QJsonDocument::fromVariant(errorResponse).toJson(QJsonDocument::Compact);
+    sendResponseData(interface, clientId, errorResponse, batchId, batchIndex);
+}
+
+void JsonRPCServerImplementation::sendResponseData(TransportInterface *interface, const QUuid &clientId, const QVariantMap &response, int batchId, int batchIndex)
+{
+    if (batchId >= 0) {
+        // Part of a batch request. Collect the response and send them all at once when the last call has finished.
+        if (!m_batches.contains(batchId)) {
+            qCDebug(dcJsonRpc()) << "Dropping response for batch" << batchId << "as the batch has been discarded.";
+            return;
+        }
+        Batch &batch = m_batches[batchId];
+        batch.responses[batchIndex] = response;
+        batch.pendingResponses--;
+        if (batch.pendingResponses == 0) {
+            flushBatch(interface, clientId, batchId);
+        }
+        return;
+    }
+
+    Encoding encoding = m_clientEncodings.value(clientId);
+    QByteArray data = encodeMessage(encoding, response);
+    qCDebug(dcJsonRpcTraffic()) << "Sending data:" << data;
+    sendEncodedData(interface, {clientId}, encoding, data);
+}
+
+void JsonRPCServerImplementation::flushBatch(TransportInterface *interface, const QUuid &clientId, int batchId)
+{
+    if (!m_batches.contains(batchId)) {
+        return;
+    }
+    Batch batch = m_batches.take(batchId);
+
+    // Calls which have not been answered yet are left out. This only happens if the batch is
+    // flushed early because the connection is about to be dropped.
+    QVariantList responses;
+    foreach (const QVariant &response, batch.responses) {
+        if (response.isValid()) {
+            responses.append(response);
+        }
+    }
+
+    Encoding encoding = m_clientEncodings.value(clientId);
+    QByteArray data = encodeMessage(encoding, responses);
     qCDebug(dcJsonRpcTraffic()) << "Sending data:" << data;
-    interface->sendData(clientId, data);
+    sendEncodedData(interface, {clientId}, encoding, data);
+
+    if (batch.encodingChanged) {
+        applyPendingEncoding(clientId);
+    }
+}
+
+void JsonRPCServerImplementation::applyPendingEncoding(const QUuid &clientId)
+{
+    if (m_pendingClientCompression.remove(clientId) && m_clientTransports.contains(clientId)) {
+        m_clientTransports.value(clientId)->enableCompression(clientId);
+        m_compressedClients.insert(clientId);
+    }
+
+    if (!m_pendingClientEncodings.contains(clientId)) {
+        return;
+    }
+    qCDebug(dcJsonRpc()) << "Switching client" << clientId << "to" << m_pendingClientEncodings.value(clientId);
+    m_clientEncodings.insert(clientId, m_pendingClientEncodings.take(clientId));
+    m_clientParsers.remove(clientId);
+    m_clientCborParsers.remove(clientId);
+}
+
+QByteArray JsonRPCServerImplementation::encodeMessage(Encoding encoding, const QVariant &message) const
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5,12,0)
+    if (encoding == EncodingCbor) {
+        // Convert through QJsonValue so CBOR clients get exactly the same values as JSON clients (e.g. uuids as strings)
+        return QCborValue::fromJsonValue(QJsonValue::fromVariant(message)).toCbor();
+    }
+#else
+    Q_UNUSED(encoding)
+#endif
+    return QJsonDocument::fromVariant(message).toJson(QJsonDocument::Compact);
+}
+
+void JsonRPCServerImplementation::sendEncodedData(TransportInterface *interface, const QList<QUuid> &clients, Encoding encoding, const QByteArray &data)
+{
+    if (encoding == EncodingCbor) {
+        interface->sendBinaryData(clients, data);
+    } else {
+        interface->sendData(clients, data);
+    }
+}
+
+void JsonRPCServerImplementation::sendCachedResponse(TransportInterface *interface, const QUuid &clientId, int commandId, const QString &cacheKey)
+{
+    Encoding encoding = m_clientEncodings.value(clientId);
+    CachedResponse cached = m_responseCache.value(cacheKey);
+    QByteArray data;
+#if QT_VERSION >= QT_VERSION_CHECK(5,12,0)
+    QByteArray id = encoding == EncodingCbor ? QCborValue(commandId).toCbor() : QByteArray::number(commandId);
+#else
+    QByteArray id = QByteArray::number(commandId);
+#endif
+    data.reserve(cached.head.size() + id.size() + cached.tail.size());
+    data.append(cached.head).append(id).append(cached.tail);
+    qCDebug(dcJsonRpcTraffic()) << "Sending cached data:" << data;
+    sendEncodedData(interface, {clientId}, encoding, data);
+}
+
+void JsonRPCServerImplementation::cacheResponse(const QString &cacheKey, Encoding encoding, const QVariantMap &params, const QString &deprecationWarning)
+{
+    // Encode the response with a placeholder id and split it there. The keys are sorted in both encodings,
+    // so the top level id comes before the params and is the first match.
+    const int placeholderId = std::numeric_limits<int>::max();
+    QVariantMap response;
+    response.insert("id", placeholderId);
+    response.insert("status", "success");
+    response.insert("params", params);
+    if (!deprecationWarning.isEmpty()) {
+        response.insert("deprecationWarning", deprecationWarning);
+    }
+    QByteArray data = encodeMessage(encoding, response);
+
+    QByteArray key = "\"id\":";
+    QByteArray id = QByteArray::number(placeholderId);
+#if QT_VERSION >= QT_VERSION_CHECK(5,12,0)
+    if (encoding == EncodingCbor) {
+        key = QCborValue(QStringLiteral("id")).toCbor();
+        id = QCborValue(placeholderId).toCbor();
+    }
+#endif
+    int index = data.indexOf(key + id);
+    if (index < 0) {
+        qCWarning(dcJsonRpc()) << "Unable to locate the id in the encoded response. Not caching" << cacheKey;
+        return;
+    }
+    index += key.length();
+
+    CachedResponse cached;
+    cached.head = data.left(index);
+    cached.tail = data.mid(index + id.length());
+    m_responseCache.insert(cacheKey, cached);
+}
+
+void JsonRPCServerImplementation::clearResponseCache()
+{
+    if (!m_responseCache.isEmpty()) {
+        qCDebug(dcJsonRpc()) << "Clearing" << m_responseCache.count() << "cached responses";
+    }
+    m_responseCache.clear();
 }
 
 QVariantMap JsonRPCServerImplementation::createWelcomeMessage(TransportInterface *interface, const QUuid &clientId) const
@@ -580,6 +799,8 @@ QVariantMap JsonRPCServerImplementation::createWelcomeMessage(TransportInterface
     if (!cacheHashes.isEmpty()) {
         handshake.insert("cacheHashes", cacheHashes);
     }
+    handshake.insert("encoding", enumValueName(m_pendingClientEncodings.value(clientId, m_clientEncodings.value(clientId))));
+    handshake.insert("compression", m_compressedClients.contains(clientId) || m_pendingClientCompression.contains(clientId));
     return handshake;
 }
 
@@ -604,6 +825,10 @@ void JsonRPCServerImplementation::setup()
 
     connect(NymeaCore::instance()->cloudManager(), &CloudManager::pairingReply, this, &JsonRPCServerImplementation::pairingFinished);
     connect(NymeaCore::instance()->cloudManager(), &CloudManager::connectionStateChanged, this, &JsonRPCServerImplementation::onCloudConnectionStateChanged);
+
+    // Cached catalog replies are outdated once plugins have been loaded or reconfigured
+    connect(NymeaCore::instance(), &NymeaCore::initialized, this, [this](){ clearResponseCache(); });
+    connect(NymeaCore::instance(), &NymeaCore::pluginConfigChanged, this, [this](){ clearResponseCache(); });
 }
 
 void JsonRPCServerImplementation::processData(const QUuid &clientId, const QByteArray &data)
@@ -612,23 +837,23 @@ void JsonRPCServerImplementation::processData(const QUuid &clientId, const QByte
 
     TransportInterface *interface = qobject_cast<TransportInterface *>(sender());
 
-    // Handle packet fragmentation
-    QByteArray buffer = m_clientBuffers[clientId];
-    buffer.append(data);
-    int splitIndex = buffer.indexOf("}\n{");
-    while (splitIndex > -1) {
-        processJsonPacket(interface, clientId, buffer.left(splitIndex + 1));
-        buffer = buffer.right(buffer.length() - splitIndex - 2);
-        splitIndex = buffer.indexOf("}\n{");
+    if (m_clientEncodings.value(clientId) == EncodingCbor) {
+        processCborData(interface, clientId, data);
+        return;
     }
-    if (buffer.trimmed().endsWith("}")) {
-        processJsonPacket(interface, clientId, buffer);
-        buffer.clear();
+
+    // Handle packet fragmentation and pipelined requests
+    JsonFrameParser &parser = m_clientParsers[clientId];
+    const QList<QByteArray> frames = parser.append(data);
+    int pendingSize = parser.pendingSize();
+
+    foreach (const QByteArray &frame, frames) {
+        processJsonPacket(interface, clientId, frame);
     }
-    m_clientBuffers[clientId] = buffer;
 
-    if (buffer.size() > 1024 * 1024) {
+    if (pendingSize > 1024 * 1024) {
         qCWarning(dcJsonRpc()) << "Client buffer larger than 1MB and no valid data. Dropping client connection.";
+        m_clientParsers.remove(clientId);
         interface->terminateClientConnection(clientId);
     }
 }
@@ -644,20 +869,120 @@ void JsonRPCServerImplementation::processJsonPacket(TransportInterface *interfac
         return;
     }
 
-    QVariantMap message = jsonDoc.toVariant().toMap();
+    processMessage(interface, clientId, jsonDoc.toVariant());
+}
+
+void JsonRPCServerImplementation::processCborData(TransportInterface *interface, const QUuid &clientId, const QByteArray &data)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5,12,0)
+    // CBOR items are self delimiting. Only decode complete messages, and all of them before processing any.
+    CborFrameParser &parser = m_clientCborParsers[clientId];
+    QList<QByteArray> frames = parser.append(data);
+
+    QVariantList messages;
+    foreach (const QByteArray &frame, frames) {
+        QCborParserError error;
+        QCborValue value = QCborValue::fromCbor(frame, &error);
+        if (error.error != QCborError::NoError) {
+            qCWarning(dcJsonRpc()) << "Failed to parse CBOR data:" << error.errorString();
+            sendErrorResponse(interface, clientId, -1, QString("Failed to parse CBOR data: %1").arg(error.errorString()));
+            continue;
+        }
+        messages.append(value.toJsonValue().toVariant());
+    }
+
+    if (parser.pendingSize() > 1024 * 1024) {
+        qCWarning(dcJsonRpc()) << "Client buffer larger than 1MB and no valid data. Dropping client connection.";
+        interface->terminateClientConnection(clientId);
+        return;
+    }
+
+    foreach (const QVariant &message, messages) {
+        processMessage(interface, clientId, message);
+    }
+#else
+    Q_UNUSED(interface)
+    Q_UNUSED(clientId)
+    Q_UNUSED(data)
+#endif
+}
+
+void JsonRPCServerImplementation::processMessage(TransportInterface *interface, const QUuid &clientId, const QVariant &message)
+{
+    if (message.type() != QVariant::List) {
+        dispatchRequest(interface, clientId, message.toMap());
+        return;
+    }
 
+    // A batch of requests. Process all of them and reply with a single array of responses.
+    QVariantList requests = message.toList();
+    if (requests.isEmpty()) {
+        qCWarning(dcJsonRpc()) << "Received an empty batch request.";
+        sendErrorResponse(interface, clientId, -1, "Invalid batch request: The batch must contain at least one request.");
+        return;
+    }
+
+    int batchId = m_nextBatchId++;
+    Batch batch;
+    batch.clientId = clientId;
+    batch.responses.reserve(requests.count());
+    for (int i = 0; i < requests.count(); i++) {
+        batch.responses.append(QVariant());
+    }
+    batch.pendingResponses = requests.count();
+    m_batches.insert(batchId, batch);
+
+    qCDebug(dcJsonRpc()) << "Processing batch of" << requests.count() << "requests from client" << clientId;
+    for (int i = 0; i < requests.count(); i++) {
+        // The batch is discarded if the client has been dropped while processing it
+        if (!m_batches.contains(batchId)) {
+            return;
+        }
+        dispatchRequest(interface, clientId, requests.at(i).toMap(), batchId, i);
+    }
+}
+
+void JsonRPCServerImplementation::dispatchRequest(TransportInterface *interface, const QUuid &clientId, const QVariantMap &message, int batchId, int batchIndex)
+{
+    // Requests are processed in order. Once a client reaches the limit of concurrently running async calls, queue up
+    // everything that follows until calls have finished.
+    QList<QueuedRequest> &queue = m_queuedRequests[clientId];
+    if (!queue.isEmpty() || m_clientPendingReplies.value(clientId) >= m_maxConcurrentReplies) {
+        qCDebug(dcJsonRpc()) << "Client" << clientId << "has" << m_clientPendingReplies.value(clientId) << "calls pending. Queueing request.";
+        QueuedRequest request;
+        request.interface = interface;
+        request.message = message;
+        request.batchId = batchId;
+        request.batchIndex = batchIndex;
+        queue.append(request);
+        return;
+    }
+    processRequest(interface, clientId, message, batchId, batchIndex);
+}
+
+void JsonRPCServerImplementation::processQueuedRequests(const QUuid &clientId)
+{
+    while (m_queuedRequests.contains(clientId) && !m_queuedRequests.value(clientId).isEmpty()
+           && m_clientPendingReplies.value(clientId) < m_maxConcurrentReplies) {
+        QueuedRequest request = m_queuedRequests[clientId].takeFirst();
+        processRequest(request.interface, clientId, request.message, request.batchId, request.batchIndex);
+    }
+}
+
+void JsonRPCServerImplementation::processRequest(TransportInterface *interface, const QUuid &clientId, const QVariantMap &message, int batchId, int batchIndex)
+{
     bool success;
     int commandId = message.value("id").toInt(&success);
     if (!success) {
         qCWarning(dcJsonRpc) << "Error parsing command. Missing \"id\":" << message;
-        sendErrorResponse(interface, clientId, commandId, "Error parsing command. Missing 'id'");
+        sendErrorResponse(interface, clientId, commandId, "Error parsing command. Missing 'id'", batchId, batchIndex);
         return;
     }
 
     QStringList commandList = message.value("method").toString().split('.');
     if (commandList.count() != 2) {
         qCWarning(dcJsonRpc) << "Error parsing method.\nGot:" << message.value("method").toString() << "\nExpected: \"Namespace.method\"";
-        sendErrorResponse(interface, clientId, commandId, QString("Error parsing method. Got: '%1'', Expected: 'Namespace.method'").arg(message.value("method").toString()));
+        sendErrorResponse(interface, clientId, commandId, QString("Error parsing method. Got: '%1'', Expected: 'Namespace.method'").arg(message.value("method").toString()), batchId, batchIndex);
         return;
     }
     QString targetNamespace = commandList.first();
@@ -671,7 +996,9 @@ void JsonRPCServerImplementation::processJsonPacket(TransportInterface *interfac
         // if there is no user in the system yet, let's fail unless this is special method for authentication itself
         if (NymeaCore::instance()->userManager()->initRequired()) {
             if (!authExemptMethodsNoUser.contains(targetNamespace + "." + method) && (token.isEmpty() || !NymeaCore::instance()->userManager()->verifyToken(token))) {
-                sendUnauthorizedResponse(interface, clientId, commandId, "Initial setup required. Call Users.CreateUser first.");
+                sendUnauthorizedResponse(interface, clientId, commandId, "Initial setup required. Call Users.CreateUser first.", batchId, batchIndex);
+                // Send what the batch has collected so far, it would be discarded with the connection otherwise
+                flushBatch(interface, clientId, batchId);
                 qCWarning(dcJsonRpc()) << "Initial setup required but client does not call the setup. Dropping connection.";
                 interface->terminateClientConnection(clientId);
                 return;
@@ -679,7 +1006,9 @@ void JsonRPCServerImplementation::processJsonPacket(TransportInterface *interfac
         } else {
             // ok, we have a user. if there isn't a valid token, let's fail unless this is a Authenticate, Introspect  Hello call
             if (!authExemptMethodsWithUser.contains(targetNamespace + "." + method) && (token.isEmpty() || !NymeaCore::instance()->userManager()->verifyToken(token))) {
-                sendUnauthorizedResponse(interface, clientId, commandId, "Forbidden: Invalid token.");
+                sendUnauthorizedResponse(interface, clientId, commandId, "Forbidden: Invalid token.", batchId, batchIndex);
+                // Send what the batch has collected so far, it would be discarded with the connection otherwise
+                flushBatch(interface, clientId, batchId);
                 qCWarning(dcJsonRpc()) << "Client did not not present a valid token. Dropping connection.";
                 interface->terminateClientConnection(clientId);
                 return;
@@ -691,32 +1020,31 @@ void JsonRPCServerImplementation::processJsonPacket(TransportInterface *interfac
     JsonHandler *handler = m_handlers.value(targetNamespace);
     if (!handler) {
         qCWarning(dcJsonRpc()) << "JSON RPC method called for invalid namespace:" << targetNamespace;
-        sendErrorResponse(interface, clientId, commandId, "No such namespace");
+        sendErrorResponse(interface, clientId, commandId, "No such namespace", batchId, batchIndex);
         return;
     }
     if (!handler->jsonMethods().contains(method)) {
         qCWarning(dcJsonRpc()) << QString("JSON RPC method called for invalid method: %1.%2").arg(targetNamespace).arg(method);
-        sendErrorResponse(interface, clientId, commandId, "No such method");
+        sendErrorResponse(interface, clientId, commandId, "No such method", batchId, batchIndex);
         return;
     }
 
     QVariantMap params = message.value("params").toMap();
 
-    QVariantMap definition = handler->jsonMethods().value(method).toMap().value("params").toMap();
-    JsonValidator validator;
-    JsonValidator::Result validationResult = validator.validateParams(params, targetNamespace + '.' + method, m_api);
+    JsonValidator::Result validationResult = m_validator.validateParams(params, targetNamespace + '.' + method);
     if (!validationResult.success()) {
         qCWarning(dcJsonRpc()) << "JSON RPC parameter verification failed for method" << targetNamespace + '.' + method;
         qCWarning(dcJsonRpc()) << validationResult.errorString() << "in" << validationResult.where();
         qCWarning(dcJsonRpc()) << "Call params:" << qUtf8Printable(QJsonDocument::fromVariant(params).toJson());
-        sendErrorResponse(interface, clientId, commandId, "Invalid params: " + validationResult.errorString() + " in " + validationResult.where());
+        sendErrorResponse(interface, clientId, commandId, "Invalid params: " + validationResult.errorString() + " in " + validationResult.where(), batchId, batchIndex);
         return;
     }
 
     if (!(targetNamespace == "JSONRPC" && method == "Hello")) {
         // This is not the handshake message. If we've waited for it, consider this a protocol violation and drop connection
         if (m_newConnectionWaitTimers.contains(clientId)) {
-            sendErrorResponse(interface, clientId, commandId, "Handshake required. Call JSONRPC.Hello first.");
+            sendErrorResponse(interface, clientId, commandId, "Handshake required. Call JSONRPC.Hello first.", batchId, batchIndex);
+            flushBatch(interface, clientId, batchId);
             qCWarning(dcJsonRpc()) << "Connection requires a handshake but client did not initiate handshake. Dropping connection";
             interface->terminateClientConnection(clientId);
             return;
@@ -733,6 +1061,20 @@ void JsonRPCServerImplementation::processJsonPacket(TransportInterface *interfac
 
     qCDebug(dcJsonRpc()) << "Invoking method" << targetNamespace + '.' +  method << "from client" << clientId;
 
+    // Replies which only depend on the API and the loaded plugins are served from the cache, skipping
+    // packing, encoding and return value validation. Filtered calls and batches take the regular path.
+    static const QStringList cachedMethods = {"JSONRPC.Introspect", "Integrations.GetVendors", "Integrations.GetThingClasses", "Devices.GetSupportedVendors", "Devices.GetSupportedDevices"};
+    QString cacheKey;
+    if (batchId < 0 && params.isEmpty() && cachedMethods.contains(targetNamespace + '.' + method)) {
+        cacheKey = QString("%1:%2:%3").arg(targetNamespace + '.' + method).arg(callContext.locale().name()).arg(m_clientEncodings.value(clientId));
+        if (m_responseCache.contains(cacheKey)) {
+            qCDebug(dcJsonRpc()) << "Sending cached response for" << targetNamespace + '.' + method;
+            sendCachedResponse(interface, clientId, commandId, cacheKey);
+            m_cachedResponsesSent++;
+            return;
+        }
+    }
+
     JsonReply *reply;
     if (handler->metaObject()->indexOfMethod(method.toUtf8() + "(QVariantMap,JsonContext)") >= 0) {
         QMetaObject::invokeMethod(handler, method.toUtf8().data(), Q_RETURN_ARG(JsonReply*, reply), Q_ARG(QVariantMap, params), Q_ARG(JsonContext, callContext));
@@ -742,15 +1084,18 @@ void JsonRPCServerImplementation::processJsonPacket(TransportInterface *interfac
 
     if (reply->type() == JsonReply::TypeAsync) {
         m_asyncReplies.insert(reply, interface);
+        m_clientPendingReplies[clientId]++;
+        if (batchId >= 0) {
+            m_asyncBatchReplies.insert(reply, qMakePair(batchId, batchIndex));
+        }
         reply->setClientId(clientId);
         reply->setCommandId(commandId);
         connect(reply, &JsonReply::finished, this, &JsonRPCServerImplementation::asyncReplyFinished);
         reply->startWait();
     } else {
-        JsonValidator validator;
-        Q_ASSERT_X((targetNamespace == "JSONRPC" && method == "Introspect") || validator.validateReturns(reply->data(), targetNamespace + '.' + method, m_api).success(),
-                   validator.result().where().toUtf8(),
-                   validator.result().errorString().toUtf8() + "\nReturn value:\n" + QJsonDocument::fromVariant(reply->data()).toJson());
+        Q_ASSERT_X((targetNamespace == "JSONRPC" && method == "Introspect") || m_validator.validateReturns(reply->data(), targetNamespace + '.' + method).success(),
+                   m_validator.result().where().toUtf8(),
+                   m_validator.result().errorString().toUtf8() + "\nReturn value:\n" + QJsonDocument::fromVariant(reply->data()).toJson());
 
         QString deprecationWarning;
         if (m_api.value("methods").toMap().value(targetNamespace + '.' + method).toMap().contains("deprecated")) {
@@ -759,8 +1104,24 @@ void JsonRPCServerImplementation::processJsonPacket(TransportInterface *interfac
             qCWarning(dcJsonRpc()) << targetNamespace + '.' + method + ':' << deprecationWarning;
         }
 
-        sendResponse(interface, clientId, commandId, reply->data(), deprecationWarning);
+        if (!cacheKey.isEmpty()) {
+            cacheResponse(cacheKey, m_clientEncodings.value(clientId), reply->data(), deprecationWarning);
+        }
+        if (m_responseCache.contains(cacheKey)) {
+            sendCachedResponse(interface, clientId, commandId, cacheKey);
+        } else {
+            sendResponse(interface, clientId, commandId, reply->data(), deprecationWarning, batchId, batchIndex);
+        }
         reply->deleteLater();
+
+        // An encoding requested in the handshake takes effect once the Hello response went out in the previous one
+        if (targetNamespace == "JSONRPC" && method == "Hello") {
+            if (m_batches.contains(batchId)) {
+                m_batches[batchId].encodingChanged = true;
+            } else {
+                applyPendingEncoding(clientId);
+            }
+        }
     }
 }
 
@@ -768,11 +1129,12 @@ void JsonRPCServerImplementation::sendNotification(const QVariantMap &params)
 {
     JsonHandler *handler = qobject_cast<JsonHandler *>(sender());
     QMetaMethod method = handler->metaObject()->method(senderSignalIndex());
+    QString notificationName = handler->name() + "." + method.name();
 
-    QVariantMap notification;
-    notification.insert("id", m_notificationId++);
-    notification.insert("notification", handler->name() + "." + method.name());
-
+    // Group the subscribed clients by their locale and transport
+    QHash<QString, QLocale> locales;
+    QHash<QString, QHash<TransportInterface*, QList<QUuid> > > receivers;
+    int clientCount = 0;
     foreach (const QUuid &clientId, m_clientNotifications.keys()) {
 
         // Check if this client wants to be notified
@@ -780,31 +1142,169 @@ void JsonRPCServerImplementation::sendNotification(const QVariantMap &params)
             continue;
         }
 
-        // Add deprecation warning if necessary
-        if (m_api.value("notifications").toMap().value(handler->name() + '.' + method.name()).toMap().contains("deprecated")) {
-            QString deprecationMessage = m_api.value("notifications").toMap().value(handler->name() + '.' + method.name()).toMap().value("deprecated").toString();
-            qCWarning(dcJsonRpc()) << "Client" << clientId << "uses deprecated API. Please update client implementation!";
-            qCWarning(dcJsonRpc()) << handler->name() + '.' + method.name() + ':' << deprecationMessage;
-            notification.insert("deprecationWarning", deprecationMessage);
+        if (m_clientNotificationFilters.contains(clientId)) {
+            if (notificationFiltered(clientId, params)) {
+                continue;
+            }
+            if (coalesceNotification(clientId, handler, method.name(), params)) {
+                continue;
+            }
         }
 
         QLocale locale = m_clientLocales.value(clientId);
-        QVariantMap translatedParams = handler->translateNotification(method.name(), params, locale);
+        locales.insert(locale.name(), locale);
+        receivers[locale.name()][m_clientTransports.value(clientId)].append(clientId);
+        clientCount++;
+    }
 
-        JsonValidator validator;
-        Q_ASSERT_X(validator.validateNotificationParams(translatedParams, handler->name() + '.' + method.name(), m_api).success(),
-                   validator.result().where().toUtf8(),
-                   validator.result().errorString().toUtf8() + "\nGot:" + QJsonDocument::fromVariant(translatedParams).toJson(QJsonDocument::Indented));
+    if (clientCount == 0) {
+        return;
+    }
+
+    QVariantMap notification;
+    notification.insert("id", m_notificationId++);
+    notification.insert("notification", notificationName);
+
+    // Add deprecation warning if necessary
+    if (m_api.value("notifications").toMap().value(notificationName).toMap().contains("deprecated")) {
+        QString deprecationMessage = m_api.value("notifications").toMap().value(notificationName).toMap().value("deprecated").toString();
+        qCWarning(dcJsonRpc()) << "Clients use deprecated API. Please update client implementation!";
+        qCWarning(dcJsonRpc()) << notificationName + ':' << deprecationMessage;
+        notification.insert("deprecationWarning", deprecationMessage);
+    }
+
+    // Translate and serialize the notification only once for each locale and encoding
+    int serializations = 0;
+    foreach (const QString &localeName, receivers.keys()) {
+        QVariantMap translatedParams = handler->translateNotification(method.name(), params, locales.value(localeName));
+
+        Q_ASSERT_X(m_validator.validateNotificationParams(translatedParams, notificationName).success(),
+                   m_validator.result().where().toUtf8(),
+                   m_validator.result().errorString().toUtf8() + "\nGot:" + QJsonDocument::fromVariant(translatedParams).toJson(QJsonDocument::Indented));
 
         notification.insert("params", translatedParams);
 
-        QByteArray data = QJsonDocument::fromVariant(notification).toJson(QJsonDocument::Compact);
+        QHash<Encoding, QByteArray> encodedNotifications;
+        QHash<TransportInterface*, QList<QUuid> > transports = receivers.value(localeName);
+        foreach (TransportInterface *transport, transports.keys()) {
+            QHash<Encoding, QList<QUuid> > clientsByEncoding;
+            foreach (const QUuid &clientId, transports.value(transport)) {
+                clientsByEncoding[m_clientEncodings.value(clientId)].append(clientId);
+            }
+            foreach (Encoding encoding, clientsByEncoding.keys()) {
+                if (!encodedNotifications.contains(encoding)) {
+                    encodedNotifications.insert(encoding, encodeMessage(encoding, notification));
+                    qCDebug(dcJsonRpcTraffic()) << "Notification content:" << encodedNotifications.value(encoding);
+                    serializations++;
+                }
+                qCDebug(dcJsonRpc()) << "Sending notification" << notificationName << "to clients" << clientsByEncoding.value(encoding);
+                sendEncodedData(transport, clientsByEncoding.value(encoding), encoding, encodedNotifications.value(encoding));
+            }
+        }
+    }
+
+    m_savedNotificationSerializations += clientCount - serializations;
+}
+
+quint64 JsonRPCServerImplementation::savedNotificationSerializations() const
+{
+    return m_savedNotificationSerializations;
+}
+
+quint64 JsonRPCServerImplementation::cachedResponsesSent() const
+{
+    return m_cachedResponsesSent;
+}
+
+bool JsonRPCServerImplementation::notificationFiltered(const QUuid &clientId, const QVariantMap &params) const
+{
+    const NotificationFilter &filter = *m_clientNotificationFilters.constFind(clientId);
+
+    if (!filter.thingIds.isEmpty()) {
+        QVariant thingId = params.contains("thingId") ? params.value("thingId") : params.value("deviceId");
+        if (!thingId.isValid() && params.contains("event")) {
+            QVariantMap event = params.value("event").toMap();
+            thingId = event.contains("thingId") ? event.value("thingId") : event.value("deviceId");
+        }
+        if (thingId.isValid() && !filter.thingIds.contains(thingId.toUuid())) {
+            return true;
+        }
+    }
+
+    if (!filter.stateTypeIds.isEmpty() && params.contains("stateTypeId")) {
+        if (!filter.stateTypeIds.contains(params.value("stateTypeId").toUuid())) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool JsonRPCServerImplementation::coalesceNotification(const QUuid &clientId, JsonHandler *handler, const QString &method, const QVariantMap &params)
+{
+    NotificationFilter &filter = m_clientNotificationFilters[clientId];
+
+    // Only state changes are coalesced, anything else is sent right away
+    if (filter.coalescingInterval <= 0 || !params.contains("stateTypeId")) {
+        return false;
+    }
+
+    QString thingId = params.contains("thingId") ? params.value("thingId").toString() : params.value("deviceId").toString();
+    QString key = handler->name() + '.' + method + thingId + params.value("stateTypeId").toString();
+    if (!filter.pendingNotifications.contains(key)) {
+        filter.pendingKeys.append(key);
+    }
+    PendingNotification pending;
+    pending.handler = handler;
+    pending.method = method;
+    pending.params = params;
+    filter.pendingNotifications.insert(key, pending);
+
+    if (!filter.coalescingTimer->isActive()) {
+        filter.coalescingTimer->start();
+    }
+    return true;
+}
 
-        qCDebug(dcJsonRpc()) << "Sending notification" << handler->name() + "." + method.name() << "to client" << clientId;
+void JsonRPCServerImplementation::flushCoalescedNotifications(const QUuid &clientId)
+{
+    if (!m_clientNotificationFilters.contains(clientId) || !m_clientTransports.contains(clientId)) {
+        return;
+    }
+    NotificationFilter &filter = m_clientNotificationFilters[clientId];
+    QLocale locale = m_clientLocales.value(clientId);
+
+    qCDebug(dcJsonRpc()) << "Sending" << filter.pendingKeys.count() << "coalesced notifications to client" << clientId;
+    foreach (const QString &key, filter.pendingKeys) {
+        PendingNotification pending = filter.pendingNotifications.value(key);
+        QString notificationName = pending.handler->name() + '.' + pending.method;
+
+        QVariantMap notification;
+        notification.insert("id", m_notificationId++);
+        notification.insert("notification", notificationName);
+        if (m_api.value("notifications").toMap().value(notificationName).toMap().contains("deprecated")) {
+            notification.insert("deprecationWarning", m_api.value("notifications").toMap().value(notificationName).toMap().value("deprecated").toString());
+        }
+        notification.insert("params", pending.handler->translateNotification(pending.method, pending.params, locale));
+
+        Encoding encoding = m_clientEncodings.value(clientId);
+        QByteArray data = encodeMessage(encoding, notification);
         qCDebug(dcJsonRpcTraffic()) << "Notification content:" << data;
+        sendEncodedData(m_clientTransports.value(clientId), {clientId}, encoding, data);
+    }
+    filter.pendingKeys.clear();
+    filter.pendingNotifications.clear();
+}
 
-        m_clientTransports.value(clientId)->sendData(clientId, data);
+void JsonRPCServerImplementation::removeNotificationFilter(const QUuid &clientId)
+{
+    if (!m_clientNotificationFilters.contains(clientId)) {
+        return;
     }
+    // Don't lose state changes which are still waiting to be sent
+    flushCoalescedNotifications(clientId);
+    NotificationFilter filter = m_clientNotificationFilters.take(clientId);
+    delete filter.coalescingTimer;
 }
 
 void JsonRPCServerImplementation::sendClientNotification(const QUuid &clientId, const QVariantMap &params)
@@ -822,10 +1322,9 @@ void JsonRPCServerImplementation::sendClientNotification(const QUuid &clientId,
     notification.insert("notification", handler->name() + "." + method.name());
     notification.insert("params", params);
 
-    JsonValidator validator;
-    Q_ASSERT_X(validator.validateNotificationParams(params, handler->name() + '.' + method.name(), m_api).success(),
-               validator.result().where().toUtf8(),
-               validator.result().errorString().toUtf8() + "\nGot:" + QJsonDocument::fromVariant(params).toJson(QJsonDocument::Indented));
+    Q_ASSERT_X(m_validator.validateNotificationParams(params, handler->name() + '.' + method.name()).success(),
+               m_validator.result().where().toUtf8(),
+               m_validator.result().errorString().toUtf8() + "\nGot:" + QJsonDocument::fromVariant(params).toJson(QJsonDocument::Indented));
 
     if (m_api.value("notifications").toMap().value(handler->name() + '.' + method.name()).toMap().contains("deprecated")) {
         QString deprecationMessage = m_api.value("notifications").toMap().value(handler->name() + '.' + method.name()).toMap().value("deprecated").toString();
@@ -834,27 +1333,41 @@ void JsonRPCServerImplementation::sendClientNotification(const QUuid &clientId,
         notification.insert("deprecationWarning", deprecationMessage);
     }
 
-    QByteArray data = QJsonDocument::fromVariant(notification).toJson(QJsonDocument::Compact);
+    Encoding encoding = m_clientEncodings.value(clientId);
+    QByteArray data = encodeMessage(encoding, notification);
     qCDebug(dcJsonRpcTraffic()) << "Notification content:" << data;
     qCDebug(dcJsonRpc()) << "Sending notification:" << handler->name() + "." + method.name();
-    m_clientTransports.value(clientId)->sendData(clientId, data);
+    sendEncodedData(m_clientTransports.value(clientId), {clientId}, encoding, data);
 }
 
 void JsonRPCServerImplementation::asyncReplyFinished()
 {
     JsonReply *reply = qobject_cast<JsonReply *>(sender());
     TransportInterface *interface = m_asyncReplies.take(reply);
+    int batchId = -1;
+    int batchIndex = -1;
+    if (m_asyncBatchReplies.contains(reply)) {
+        QPair<int, int> batchReply = m_asyncBatchReplies.take(reply);
+        batchId = batchReply.first;
+        batchIndex = batchReply.second;
+    }
     if (!interface) {
         qCWarning(dcJsonRpc()) << "Got an async reply but the requesting connection has vanished.";
         reply->deleteLater();
         return;
     }
+
+    // Free the slot for this client, but only process queued requests after this response has been sent
+    bool clientConnected = m_clientPendingReplies.value(reply->clientId()) > 0;
+    if (clientConnected) {
+        m_clientPendingReplies[reply->clientId()]--;
+    }
+
     if (!reply->timedOut()) {
-        JsonValidator validator;
         QString method = reply->handler()->name() + '.' + reply->method();
-        Q_ASSERT_X(validator.validateReturns(reply->data(), method, m_api).success()
-                   ,validator.result().where().toUtf8()
-                   ,validator.result().errorString().toUtf8() + "\nReturn value:\n" + QJsonDocument::fromVariant(reply->data()).toJson());
+        Q_ASSERT_X(m_validator.validateReturns(reply->data(), method).success()
+                   ,m_validator.result().where().toUtf8()
+                   ,m_validator.result().errorString().toUtf8() + "\nReturn value:\n" + QJsonDocument::fromVariant(reply->data()).toJson());
 
         QString deprecationWarning;
         if (m_api.value("methods").toMap().value(method).toMap().contains("deprecated")) {
@@ -863,10 +1376,14 @@ void JsonRPCServerImplementation::asyncReplyFinished()
             qCWarning(dcJsonRpc()) << method + ':' << deprecationWarning;
         }
 
-        sendResponse(interface, reply->clientId(), reply->commandId(), reply->data(), deprecationWarning);
+        sendResponse(interface, reply->clientId(), reply->commandId(), reply->data(), deprecationWarning, batchId, batchIndex);
     } else {
         qCWarning(dcJsonRpc()) << "RPC call timed out:" << reply->handler()->name() << ":" << reply->method();
-        sendErrorResponse(interface, reply->clientId(), reply->commandId(), "Command timed out");
+        sendErrorResponse(interface, reply->clientId(), reply->commandId(), "Command timed out", batchId, batchIndex);
+    }
+
+    if (clientConnected) {
+        processQueuedRequests(reply->clientId());
     }
 
     reply->deleteLater();
@@ -1005,6 +1522,8 @@ bool JsonRPCServerImplementation::registerHandler(JsonHandler *handler)
     // Checks completed. Store new API
     qCDebug(dcJsonRpc()) << "Registering JSON RPC handler:" << handler->name();
     m_api = apiIncludingThis;
+    m_validator.setApi(m_api);
+    clearResponseCache();
 
     m_handlers.insert(handler->name(), handler);
     for (int i = 0; i < handler->metaObject()->methodCount(); ++i) {
@@ -1046,7 +1565,22 @@ void JsonRPCServerImplementation::clientDisconnected(const QUuid &clientId)
     qCDebug(dcJsonRpc()) << "Client disconnected:" << clientId;
     m_clientTransports.remove(clientId);
     m_clientNotifications.remove(clientId);
-    m_clientBuffers.remove(clientId);
+    if (m_clientNotificationFilters.contains(clientId)) {
+        delete m_clientNotificationFilters.take(clientId).coalescingTimer;
+    }
+    m_clientParsers.remove(clientId);
+    m_clientCborParsers.remove(clientId);
+    m_clientEncodings.remove(clientId);
+    m_pendingClientEncodings.remove(clientId);
+    m_pendingClientCompression.remove(clientId);
+    m_compressedClients.remove(clientId);
+    m_clientPendingReplies.remove(clientId);
+    m_queuedRequests.remove(clientId);
+    foreach (int batchId, m_batches.keys()) {
+        if (m_batches.value(batchId).clientId == clientId) {
+            m_batches.remove(batchId);
+        }
+    }
     m_clientLocales.remove(clientId);
     if (m_pushButtonTransactions.values().contains(clientId)) {
         NymeaCore::instance()->userManager()->cancelPushButtonAuth(m_pushButtonTransactions.key(clientId));
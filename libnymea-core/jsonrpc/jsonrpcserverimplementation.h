@@ -33,6 +33,9 @@
 
 #include "jsonrpc/jsonrpcserver.h"
 #include "jsonrpc/jsonhandler.h"
+#include "jsonvalidator.h"
+#include "jsonframeparser.h"
+#include "cborframeparser.h"
 #include "transportinterface.h"
 #include "usermanager/usermanager.h"
 
@@ -42,6 +45,7 @@
 
 #include <QObject>
 #include <QVariantMap>
+#include <QSet>
 #include <QString>
 #include <QSslConfiguration>
 
@@ -53,6 +57,12 @@ class JsonRPCServerImplementation: public JsonHandler, public JsonRPCServer
 {
     Q_OBJECT
 public:
+    enum Encoding {
+        EncodingJson,
+        EncodingCbor
+    };
+    Q_ENUM(Encoding)
+
     JsonRPCServerImplementation(const QSslConfiguration &sslConfiguration = QSslConfiguration(), QObject *parent = nullptr);
 
     // JsonHandler API implementation
@@ -84,15 +94,33 @@ public:
     bool registerHandler(JsonHandler *handler) override;
     bool registerExperienceHandler(JsonHandler *handler, int majorVersion, int minorVersion) override;
 
+    // Number of notification serializations avoided by sending the same buffer to all clients sharing a locale
+    quint64 savedNotificationSerializations() const;
+    // Number of replies sent straight from the response cache
+    quint64 cachedResponsesSent() const;
+
 private:
     QHash<QString, JsonHandler *> handlers() const;
 
-    void sendResponse(TransportInterface *interface, const QUuid &clientId, int commandId, const QVariantMap &params = QVariantMap(), const QString &deprecationWarning = QString());
-    void sendErrorResponse(TransportInterface *interface, const QUuid &clientId, int commandId, const QString &error);
-    void sendUnauthorizedResponse(TransportInterface *interface, const QUuid &clientId, int commandId, const QString &error);
+    void sendResponse(TransportInterface *interface, const QUuid &clientId, int commandId, const QVariantMap &params = QVariantMap(), const QString &deprecationWarning = QString(), int batchId = -1, int batchIndex = -1);
+    void sendErrorResponse(TransportInterface *interface, const QUuid &clientId, int commandId, const QString &error, int batchId = -1, int batchIndex = -1);
+    void sendUnauthorizedResponse(TransportInterface *interface, const QUuid &clientId, int commandId, const QString &error, int batchId = -1, int batchIndex = -1);
+    void sendResponseData(TransportInterface *interface, const QUuid &clientId, const QVariantMap &response, int batchId, int batchIndex);
+    void flushBatch(TransportInterface *interface, const QUuid &clientId, int batchId);
+    void applyPendingEncoding(const QUuid &clientId);
+    QByteArray encodeMessage(Encoding encoding, const QVariant &message) const;
+    void sendEncodedData(TransportInterface *interface, const QList<QUuid> &clients, Encoding encoding, const QByteArray &data);
+    void sendCachedResponse(TransportInterface *interface, const QUuid &clientId, int commandId, const QString &cacheKey);
+    void cacheResponse(const QString &cacheKey, Encoding encoding, const QVariantMap &params, const QString &deprecationWarning);
+    void clearResponseCache();
     QVariantMap createWelcomeMessage(TransportInterface *interface, const QUuid &clientId) const;
 
     void processJsonPacket(TransportInterface *interface, const QUuid &clientId, const QByteArray &data);
+    void processCborData(TransportInterface *interface, const QUuid &clientId, const QByteArray &data);
+    void processMessage(TransportInterface *interface, const QUuid &clientId, const QVariant &message);
+    void dispatchRequest(TransportInterface *interface, const QUuid &clientId, const QVariantMap &message, int batchId = -1, int batchIndex = -1);
+    void processQueuedRequests(const QUuid &clientId);
+    void processRequest(TransportInterface *interface, const QUuid &clientId, const QVariantMap &message, int batchId, int batchIndex);
 
 private slots:
     void setup();
@@ -112,15 +140,71 @@ private slots:
     void onPushButtonAuthFinished(int transactionId, bool success, const QByteArray &token);
 
 private:
+    struct PendingNotification {
+        JsonHandler *handler = nullptr;
+        QString method;
+        QVariantMap params;
+    };
+    // Per client filters set by SetNotificationStatus in addition to the namespaces
+    struct NotificationFilter {
+        QSet<QUuid> thingIds;
+        QSet<QUuid> stateTypeIds;
+        int coalescingInterval = 0;
+        QTimer *coalescingTimer = nullptr;
+        QStringList pendingKeys;
+        QHash<QString, PendingNotification> pendingNotifications;
+    };
+
+    // Responses of a batch request, sent as one array once all calls in the batch have finished
+    struct Batch {
+        QUuid clientId;
+        QVariantList responses;
+        int pendingResponses = 0;
+        bool encodingChanged = false;
+    };
+    // An encoded reply split around its id, so it can be sent for any call without encoding the params again
+    struct CachedResponse {
+        QByteArray head;
+        QByteArray tail;
+    };
+    struct QueuedRequest {
+        TransportInterface *interface = nullptr;
+        QVariantMap message;
+        int batchId = -1;
+        int batchIndex = -1;
+    };
+
+    bool notificationFiltered(const QUuid &clientId, const QVariantMap &params) const;
+    bool coalesceNotification(const QUuid &clientId, JsonHandler *handler, const QString &method, const QVariantMap &params);
+    void flushCoalescedNotifications(const QUuid &clientId);
+    void removeNotificationFilter(const QUuid &clientId);
+
     QVariantMap m_api;
+    JsonValidator m_validator;
     QHash<JsonHandler*, QString> m_experiences;
     QMap<TransportInterface*, bool> m_interfaces; // Interface, authenticationRequired
     QHash<QString, JsonHandler *> m_handlers;
     QHash<JsonReply *, TransportInterface *> m_asyncReplies;
+    QHash<JsonReply *, QPair<int, int> > m_asyncBatchReplies; // reply, (batchId, batchIndex)
+    QHash<int, Batch> m_batches;
+    int m_nextBatchId = 0;
+    QHash<QUuid, QList<QueuedRequest> > m_queuedRequests;
+    QHash<QUuid, int> m_clientPendingReplies;
+    // Maximum number of async calls a single client may have running at the same time
+    int m_maxConcurrentReplies = 16;
+    // Replies of methods which only depend on the API and the loaded plugins, by method, locale and encoding
+    QHash<QString, CachedResponse> m_responseCache;
 
     QHash<QUuid, TransportInterface*> m_clientTransports;
-    QHash<QUuid, QByteArray> m_clientBuffers;
+    QHash<QUuid, JsonFrameParser> m_clientParsers;
+    QHash<QUuid, CborFrameParser> m_clientCborParsers;
+    QHash<QUuid, Encoding> m_clientEncodings;
+    // Encodings and compression requested in JSONRPC.Hello, applied once the Hello response has been sent
+    QHash<QUuid, Encoding> m_pendingClientEncodings;
+    QSet<QUuid> m_pendingClientCompression;
+    QSet<QUuid> m_compressedClients;
     QHash<QUuid, QStringList> m_clientNotifications;
+    QHash<QUuid, NotificationFilter> m_clientNotificationFilters;
     QHash<QUuid, QLocale> m_clientLocales;
     QHash<int, QUuid> m_pushButtonTransactions;
     QHash<QUuid, QTimer*> m_newConnectionWaitTimers;
@@ -128,6 +212,8 @@ private:
     QHash<QString, JsonReply*> m_pairingRequests;
 
     int m_notificationId;
+    quint64 m_savedNotificationSerializations = 0;
+    quint64 m_cachedResponsesSent = 0;
 
     QString formatAssertion(const QString &targetNamespace, const QString &method, QMetaMethod::MethodType methodType, JsonHandler *handler, const QVariantMap &data) const;
 };
@@ -80,27 +80,91 @@ bool JsonValidator::checkRefs(const QVariantMap &map, const QVariantMap &api)
 
 }
 
-JsonValidator::Result JsonValidator::validateParams(const QVariantMap &params, const QString &method, const QVariantMap &api)
+JsonValidator::~JsonValidator()
 {
-    QVariantMap paramDefinition = api.value("methods").toMap().value(method).toMap().value("params").toMap();
-    m_result = validateMap(params, paramDefinition, api, QIODevice::WriteOnly);
-    m_result.setWhere(method + ", param " + m_result.where());
+    qDeleteAll(m_nodes);
+}
+
+void JsonValidator::setApi(const QVariantMap &api)
+{
+    qDeleteAll(m_nodes);
+    m_nodes.clear();
+    m_enums.clear();
+    m_flags.clear();
+    m_types.clear();
+    m_methods.clear();
+    m_notifications.clear();
+
+    // Create all named nodes first so references can be resolved regardless of the order and for recursive types
+    QVariantMap enums = api.value("enums").toMap();
+    foreach (const QString &enumName, enums.keys()) {
+        Node *node = createNode();
+        node->kind = Node::KindEnum;
+        node->name = enumName;
+        foreach (const QVariant &value, enums.value(enumName).toList()) {
+            node->enumValues.insert(value.toString());
+        }
+        m_enums.insert(enumName, node);
+    }
+    QVariantMap flags = api.value("flags").toMap();
+    foreach (const QString &flagName, flags.keys()) {
+        m_flags.insert(flagName, createNode());
+    }
+    QVariantMap types = api.value("types").toMap();
+    foreach (const QString &typeName, types.keys()) {
+        m_types.insert(typeName, createNode());
+    }
+
+    foreach (const QString &flagName, flags.keys()) {
+        Node *node = m_flags.value(flagName);
+        node->kind = Node::KindFlags;
+        node->name = flagName;
+        node->entry = compile(flags.value(flagName).toList().first());
+    }
+    foreach (const QString &typeName, types.keys()) {
+        compileInto(m_types.value(typeName), types.value(typeName));
+    }
+
+    QVariantMap methods = api.value("methods").toMap();
+    foreach (const QString &methodName, methods.keys()) {
+        QVariantMap method = methods.value(methodName).toMap();
+        Definition definition;
+        definition.params = compile(method.value("params").toMap());
+        definition.returns = compile(method.value("returns").toMap());
+        m_methods.insert(methodName, definition);
+    }
+    QVariantMap notifications = api.value("notifications").toMap();
+    foreach (const QString &notificationName, notifications.keys()) {
+        Definition definition;
+        definition.params = compile(notifications.value(notificationName).toMap().value("params").toMap());
+        m_notifications.insert(notificationName, definition);
+    }
+}
+
+JsonValidator::Result JsonValidator::validateParams(const QVariantMap &params, const QString &method)
+{
+    m_result = validateMap(params, m_methods.value(method).params, QIODevice::WriteOnly);
+    if (!m_result.success()) {
+        m_result.setWhere(method + ", param " + m_result.where());
+    }
     return m_result;
 }
 
-JsonValidator::Result JsonValidator::validateReturns(const QVariantMap &returns, const QString &method, const QVariantMap &api)
+JsonValidator::Result JsonValidator::validateReturns(const QVariantMap &returns, const QString &method)
 {
-    QVariantMap returnsDefinition = api.value("methods").toMap().value(method).toMap().value("returns").toMap();
-    m_result = validateMap(returns, returnsDefinition, api, QIODevice::ReadOnly);
-    m_result.setWhere(method + ", returns " + m_result.where());
+    m_result = validateMap(returns, m_methods.value(method).returns, QIODevice::ReadOnly);
+    if (!m_result.success()) {
+        m_result.setWhere(method + ", returns " + m_result.where());
+    }
     return m_result;
 }
 
-JsonValidator::Result JsonValidator::validateNotificationParams(const QVariantMap &params, const QString &notification, const QVariantMap &api)
+JsonValidator::Result JsonValidator::validateNotificationParams(const QVariantMap &params, const QString &notification)
 {
-    QVariantMap paramDefinition = api.value("notifications").toMap().value(notification).toMap().value("params").toMap();
-    m_result = validateMap(params, paramDefinition, api, QIODevice::ReadOnly);
-    m_result.setWhere(notification + ", param " + m_result.where());
+    m_result = validateMap(params, m_notifications.value(notification).params, QIODevice::ReadOnly);
+    if (!m_result.success()) {
+        m_result.setWhere(notification + ", param " + m_result.where());
+    }
     return m_result;
 }
 
@@ -109,180 +173,230 @@ JsonValidator::Result JsonValidator::result() const
     return m_result;
 }
 
-JsonValidator::Result JsonValidator::validateMap(const QVariantMap &map, const QVariantMap &definition, const QVariantMap &api, QIODevice::OpenMode openMode)
+JsonValidator::Node *JsonValidator::createNode()
 {
-    // Make sure all required values are available
-    foreach (const QString &key, definition.keys()) {
+    Node *node = new Node();
+    m_nodes.append(node);
+    return node;
+}
+
+JsonValidator::Node *JsonValidator::compile(const QVariant &definition)
+{
+    // References point to the shared named nodes
+    if (definition.type() == QVariant::String && definition.toString().startsWith("$ref:")) {
+        return resolveRef(definition.toString().remove("$ref:"));
+    }
+    Node *node = createNode();
+    compileInto(node, definition);
+    return node;
+}
+
+void JsonValidator::compileInto(Node *node, const QVariant &definition)
+{
+    if (definition.type() == QVariant::String) {
+        QString typeName = definition.toString();
+        if (typeName.startsWith("$ref:")) {
+            node->kind = Node::KindRef;
+            node->name = typeName.remove("$ref:");
+            node->entry = resolveRef(node->name);
+            return;
+        }
+        node->kind = Node::KindBasic;
+        node->name = typeName;
+        node->basicType = JsonHandler::enumNameToValue<JsonHandler::BasicType>(typeName);
+        node->variantType = JsonHandler::basicTypeToVariantType(node->basicType);
+        return;
+    }
+
+    if (definition.type() == QVariant::Map) {
+        node->kind = Node::KindMap;
+        QVariantMap map = definition.toMap();
         QRegExp isOptional = QRegExp("^([a-z]:)*o:.*");
-        if (isOptional.exactMatch(key)) {
+        QRegExp isReadOnly = QRegExp("^([a-z]:)*r:.*");
+        foreach (const QString &key, map.keys()) {
+            Field field;
+            field.definitionKey = key;
+            field.name = key;
+            field.name.remove(QRegExp("^(o:|r:|d:)*"));
+            field.optional = isOptional.exactMatch(key);
+            field.readOnly = isReadOnly.exactMatch(key);
+            field.node = compile(map.value(key));
+            node->fieldIndex.insert(field.name, node->fields.count());
+            node->fields.append(field);
+        }
+        return;
+    }
+
+    if (definition.type() == QVariant::List) {
+        node->kind = Node::KindList;
+        node->entry = compile(definition.toList().first());
+        node->name = definition.toList().first().toString();
+        return;
+    }
+
+    node->kind = Node::KindInvalid;
+}
+
+JsonValidator::Node *JsonValidator::resolveRef(const QString &refName) const
+{
+    if (m_enums.contains(refName)) {
+        return m_enums.value(refName);
+    }
+    if (m_flags.contains(refName)) {
+        return m_flags.value(refName);
+    }
+    return m_types.value(refName);
+}
+
+JsonValidator::Result JsonValidator::validateMap(const QVariantMap &map, const Node *node, QIODevice::OpenMode openMode)
+{
+    if (!node || node->kind != Node::KindMap) {
+        return map.isEmpty() ? Result(true) : Result(false, "Invalid key: " + map.firstKey());
+    }
+
+    // Make sure all required values are available
+    foreach (const Field &field, node->fields) {
+        if (field.optional) {
             continue;
         }
-        QRegExp isReadOnly = QRegExp("^([a-z]:)*r:.*");
-        if (isReadOnly.exactMatch(key) && openMode.testFlag(QIODevice::WriteOnly)) {
+        if (field.readOnly && openMode.testFlag(QIODevice::WriteOnly)) {
             continue;
         }
-        QString trimmedKey = key;
-        trimmedKey.remove(QRegExp("^(o:|r:|d:)*"));
-        if (!map.contains(trimmedKey)) {
-            return Result(false, "Missing required key: " + key, key);
+        if (!map.contains(field.name)) {
+            return Result(false, "Missing required key: " + field.definitionKey, field.definitionKey);
         }
     }
 
     // Make sure given values are valid
-    foreach (const QString &key, map.keys()) {
+    for (QVariantMap::const_iterator it = map.constBegin(); it != map.constEnd(); ++it) {
         // Is the key allowed in here?
-        QVariant expectedValue = definition.value(key);
-        foreach (const QString &definitionKey, definition.keys()) {
-            QRegExp regExp = QRegExp("(o:|r:|d:)*" + key);
-            if (regExp.exactMatch(definitionKey)) {
-                expectedValue = definition.value(definitionKey);
-            }
-        }
-        if (!expectedValue.isValid()) {
-            expectedValue = definition.value("o:" + key);
-        }
-        if (!expectedValue.isValid()) {
-            expectedValue = definition.value("d:" + key);
-        }
-        if (!expectedValue.isValid()) {
-            return Result(false, "Invalid key: " + key);
+        int index = node->fieldIndex.value(it.key(), -1);
+        if (index < 0) {
+            return Result(false, "Invalid key: " + it.key());
         }
 
         // Validate content
-        QVariant value = map.value(key);
-
-        Result result = validateEntry(value, expectedValue, api, openMode);
+        Result result = validateEntry(it.value(), node->fields.at(index).node, openMode);
         if (!result.success()) {
-            result.setWhere(key + '.' + result.where());
-            result.setErrorString(result.errorString());
+            result.setWhere(it.key() + '.' + result.where());
             return result;
         }
-
-   }
+    }
 
     return Result(true);
 }
 
-JsonValidator::Result JsonValidator::validateEntry(const QVariant &value, const QVariant &definition, const QVariantMap &api, QIODevice::OpenMode openMode)
+JsonValidator::Result JsonValidator::validateEntry(const QVariant &value, const Node *node, QIODevice::OpenMode openMode)
 {
-    if (definition.type() == QVariant::String) {
-        QString expectedTypeName = definition.toString();
-
-        if (expectedTypeName.startsWith("$ref:")) {
-            QString refName = expectedTypeName;
-            refName.remove("$ref:");
-
-            // Refs might be enums
-            QVariantMap enums = api.value("enums").toMap();
-            if (enums.contains(refName)) {
-                QVariant refDefinition = enums.value(refName);
-
-                QVariantList enumList = refDefinition.toList();
-                if (!enumList.contains(value.toString())) {
-                    return Result(false, "Expected enum " + refName + " but got " + value.toJsonDocument().toJson());
-                }
-                return Result(true);
-            }
-            // Or flags
-            QVariantMap flags = api.value("flags").toMap();
-            if (flags.contains(refName)) {
-                QVariant refDefinition = flags.value(refName);
-                if (value.type() != QVariant::StringList) {
-                    return Result(false, "Expected flags " + refName + " but got " + value.toString());
-                }
-                QString flagEnum = refDefinition.toList().first().toString();
-                foreach (const QVariant &flagsEntry, value.toList()) {
-                    Result result = validateEntry(flagsEntry, flagEnum, api, openMode);
-                    if (!result.success()) {
-                        return result;
-                    }
-                }
-                return Result(true);
-            }
-
-            QVariantMap types = api.value("types").toMap();
-            QVariant refDefinition = types.value(refName);
-            return validateEntry(value, refDefinition, api, openMode);
-        }
-
-        JsonHandler::BasicType expectedBasicType = JsonHandler::enumNameToValue<JsonHandler::BasicType>(expectedTypeName);
-        QVariant::Type expectedVariantType = JsonHandler::basicTypeToVariantType(expectedBasicType);
+    if (!node) {
+        Q_ASSERT_X(false, "JsonValildator", "Incomplete validation. Unexpected type in template");
+        return Result(false);
+    }
 
-        // Verify basic compatiblity
-        if (expectedBasicType != JsonHandler::Variant && !value.canConvert(expectedVariantType)) {
-            return Result(false, "Invalid value. Expected: " + definition.toString() + ", Got: " + value.toString());
+    switch (node->kind) {
+    case Node::KindEnum:
+        if (!node->enumValues.contains(value.toString())) {
+            return Result(false, "Expected enum " + node->name + " but got " + value.toJsonDocument().toJson());
         }
+        return Result(true);
 
-        // Any string converts fine to Uuid, but the resulting uuid might be null
-        if (expectedBasicType == JsonHandler::Uuid && value.toUuid().isNull()) {
-            return Result(false, "Invalid Uuid: " + value.toString());
-        }
-        // Make sure ints are valid
-        if (expectedBasicType == JsonHandler::Int) {
-            bool ok;
-            value.toLongLong(&ok);
-            if (!ok) {
-                return Result(false, "Invalid Int: " + value.toString());
-            }
+    case Node::KindFlags:
+        if (value.type() != QVariant::StringList) {
+            return Result(false, "Expected flags " + node->name + " but got " + value.toString());
         }
-        // UInts
-        if (expectedBasicType == JsonHandler::Uint) {
-            bool ok;
-            value.toULongLong(&ok);
-            if (!ok) {
-                return Result(false, "Invalid UInt: " + value.toString());
-            }
-        }
-        // Double
-        if (expectedBasicType == JsonHandler::Double) {
-            bool ok;
-            value.toDouble(&ok);
-            if (!ok) {
-                return Result(false, "Invalid Double: " + value.toString());
-            }
-        }
-        // Color
-        if (expectedBasicType == JsonHandler::Color) {
-            QColor color = value.value<QColor>();
-            if (!color.isValid()) {
-                return Result(false, "Invalid Color: " + value.toString());
-            }
-        }
-        // Time
-        if (expectedBasicType == JsonHandler::Time) {
-            QTime time = QTime::fromString(value.toString(), "hh:mm");
-            if (!time.isValid()) {
-                return Result(false, "Invalid Time: " + value.toString());
+        foreach (const QString &flagsEntry, value.toStringList()) {
+            Result result = validateEntry(flagsEntry, node->entry, openMode);
+            if (!result.success()) {
+                return result;
             }
         }
-
-
         return Result(true);
-    }
 
-    if (definition.type() == QVariant::Map) {
+    case Node::KindRef:
+        return validateEntry(value, node->entry, openMode);
+
+    case Node::KindMap:
         if (value.type() != QVariant::Map) {
             return Result(false, "Invalid value. Expected a map bug received: " + value.toString());
         }
-        return validateMap(value.toMap(), definition.toMap(), api, openMode);
-    }
+        return validateMap(value.toMap(), node, openMode);
 
-    if (definition.type() == QVariant::List) {
-        QVariantList list = definition.toList();
-        QVariant entryDefinition = list.first();
+    case Node::KindList:
         if (value.type() != QVariant::List && value.type() != QVariant::StringList) {
-            return Result(false, "Expected list of " + entryDefinition.toString() + " but got value of type " + value.typeName() + "\n" + QJsonDocument::fromVariant(value).toJson());
+            return Result(false, "Expected list of " + node->name + " but got value of type " + value.typeName() + "\n" + QJsonDocument::fromVariant(value).toJson());
         }
         foreach (const QVariant &entry, value.toList()) {
-            Result result = validateEntry(entry, entryDefinition, api, openMode);
+            Result result = validateEntry(entry, node->entry, openMode);
             if (!result.success()) {
                 return result;
             }
         }
         return Result(true);
+
+    case Node::KindBasic:
+        break;
+
+    case Node::KindInvalid:
+        Q_ASSERT_X(false, "JsonValildator", "Incomplete validation. Unexpected type in template");
+        return Result(false);
+    }
+
+    // Verify basic compatiblity
+    if (node->basicType != JsonHandler::Variant && !value.canConvert(node->variantType)) {
+        return Result(false, "Invalid value. Expected: " + node->name + ", Got: " + value.toString());
+    }
+
+    switch (node->basicType) {
+    case JsonHandler::Uuid:
+        // Any string converts fine to Uuid, but the resulting uuid might be null
+        if (value.toUuid().isNull()) {
+            return Result(false, "Invalid Uuid: " + value.toString());
+        }
+        break;
+    case JsonHandler::Int: {
+        // Make sure ints are valid
+        bool ok;
+        value.toLongLong(&ok);
+        if (!ok) {
+            return Result(false, "Invalid Int: " + value.toString());
+        }
+        break;
+    }
+    case JsonHandler::Uint: {
+        bool ok;
+        value.toULongLong(&ok);
+        if (!ok) {
+            return Result(false, "Invalid UInt: " + value.toString());
+        }
+        break;
+    }
+    case JsonHandler::Double: {
+        bool ok;
+        value.toDouble(&ok);
+        if (!ok) {
+            return Result(false, "Invalid Double: " + value.toString());
+        }
+        break;
     }
-    Q_ASSERT_X(false, "JsonValildator", "Incomplete validation. Unexpected type in template");
-    return Result(false);
+    case JsonHandler::Color: {
+        QColor color = value.value<QColor>();
+        if (!color.isValid()) {
+            return Result(false, "Invalid Color: " + value.toString());
+        }
+        break;
+    }
+    case JsonHandler::Time: {
+        QTime time = QTime::fromString(value.toString(), "hh:mm");
+        if (!time.isValid()) {
+            return Result(false, "Invalid Time: " + value.toString());
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    return Result(true);
 }
 
 }
@@ -31,9 +31,14 @@
 #ifndef JSONVALIDATOR_H
 #define JSONVALIDATOR_H
 
+#include "jsonrpc/jsonhandler.h"
+
 #include <QPair>
 #include <QVariant>
 #include <QIODevice>
+#include <QHash>
+#include <QSet>
+#include <QVector>
 
 namespace nymeaserver {
 
@@ -60,17 +65,70 @@ public:
     };
 
     JsonValidator() {}
+    ~JsonValidator();
 
     static bool checkRefs(const QVariantMap &map, const QVariantMap &api);
 
-    Result validateParams(const QVariantMap &params, const QString &method, const QVariantMap &api);
-    Result validateReturns(const QVariantMap &returns, const QString &method, const QVariantMap &api);
-    Result validateNotificationParams(const QVariantMap &params, const QString &notification, const QVariantMap &api);
+    // Compiles the given introspection data into the validation tree used by the validate methods
+    void setApi(const QVariantMap &api);
+
+    Result validateParams(const QVariantMap &params, const QString &method);
+    Result validateReturns(const QVariantMap &returns, const QString &method);
+    Result validateNotificationParams(const QVariantMap &params, const QString &notification);
 
     Result result() const;
+
 private:
-    Result validateMap(const QVariantMap &map, const QVariantMap &definition, const QVariantMap &api, QIODevice::OpenMode openMode);
-    Result validateEntry(const QVariant &value, const QVariant &definition, const QVariantMap &api, QIODevice::OpenMode openMode);
+    Q_DISABLE_COPY(JsonValidator)
+
+    struct Node;
+    struct Field {
+        QString name;
+        QString definitionKey;
+        bool optional = false;
+        bool readOnly = false;
+        Node *node = nullptr;
+    };
+    struct Node {
+        enum Kind {
+            KindInvalid,
+            KindBasic,
+            KindEnum,
+            KindFlags,
+            KindMap,
+            KindList,
+            KindRef
+        };
+        Kind kind = KindInvalid;
+        // The type or reference name, used for error messages
+        QString name;
+        JsonHandler::BasicType basicType = JsonHandler::Variant;
+        QVariant::Type variantType = QVariant::Invalid;
+        QSet<QString> enumValues;
+        QVector<Field> fields;
+        QHash<QString, int> fieldIndex;
+        // Entries of lists, the enum of flags or the target of a reference
+        Node *entry = nullptr;
+    };
+    struct Definition {
+        Node *params = nullptr;
+        Node *returns = nullptr;
+    };
+
+    Node *createNode();
+    Node *compile(const QVariant &definition);
+    void compileInto(Node *node, const QVariant &definition);
+    Node *resolveRef(const QString &refName) const;
+
+    Result validateMap(const QVariantMap &map, const Node *node, QIODevice::OpenMode openMode);
+    Result validateEntry(const QVariant &value, const Node *node, QIODevice::OpenMode openMode);
+
+    QList<Node*> m_nodes;
+    QHash<QString, Node*> m_enums;
+    QHash<QString, Node*> m_flags;
+    QHash<QString, Node*> m_types;
+    QHash<QString, Definition> m_methods;
+    QHash<QString, Definition> m_notifications;
 
     Result m_result;
 };
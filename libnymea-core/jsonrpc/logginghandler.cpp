@@ -46,6 +46,7 @@ LoggingHandler::LoggingHandler(QObject *parent) :
     registerEnum<Logging::LoggingLevel>();
     registerEnum<Logging::LoggingEventType>();
     registerEnum<Logging::LoggingError>();
+    registerEnum<Logging::SeriesFunction>();
 
     // Objects
     registerObject<LogEntry, LogEntries>();
@@ -66,7 +67,12 @@ LoggingHandler::LoggingHandler(QObject *parent) :
                    "1) offset 0, maxCount 1000: Entries 0 to 9999\n"
                    "2) offset 10000, maxCount 1000: Entries 10000 - 19999\n"
                    "3) offset 20000, maxCount 1000: Entries 20000 - 29999\n"
-                   "...";
+                   "...\n\n"
+                   "For deep pagination, the cursor should be preferred over the offset. If a limit is given "
+                   "and the result set is full, the reply contains a nextCursor. Passing it as cursor in the "
+                   "next request returns the entries following the last entry of the previous page. Fetching "
+                   "a page using a cursor is as fast as fetching the first page and the pages stay stable while "
+                   "new entries are added to the log. A cursor can't be combined with an offset.";
     QVariantMap timeFilter;
     timeFilter.insert("o:startDate", enumValueName(Int));
     timeFilter.insert("o:endDate", enumValueName(Int));
@@ -80,12 +86,35 @@ LoggingHandler::LoggingHandler(QObject *parent) :
     params.insert("o:values", QVariantList() << enumValueName(Variant));
     params.insert("o:limit", enumValueName(Int));
     params.insert("o:offset", enumValueName(Int));
+    params.insert("o:cursor", enumValueName(String));
     returns.insert("loggingError", enumRef<Logging::LoggingError>());
     returns.insert("o:logEntries", objectRef<LogEntries>());
     returns.insert("count", enumValueName(Int));
     returns.insert("offset", enumValueName(Int));
+    returns.insert("o:nextCursor", enumValueName(String));
     registerMethod("GetLogEntries", description, params, returns);
 
+    params.clear(); returns.clear();
+    description = "Get the logged values of a thing's state, aggregated into buckets of the given size "
+                  "(in seconds). The optional from and to parameters (in seconds since epoch) limit the "
+                  "time range. Each bucket in the returned series contains the start of the bucket (in ms "
+                  "since epoch) and the aggregated value of all entries in this bucket. Buckets without "
+                  "entries are omitted. The function defaults to SeriesFunctionAverage. Average, minimum "
+                  "and maximum are only meaningful for numeric states while SeriesFunctionLast returns "
+                  "the last value logged in each bucket as is.";
+    params.insert("thingId", enumValueName(Uuid));
+    params.insert("typeId", enumValueName(Uuid));
+    params.insert("o:from", enumValueName(Int));
+    params.insert("o:to", enumValueName(Int));
+    params.insert("bucketSize", enumValueName(Int));
+    params.insert("o:function", enumRef<Logging::SeriesFunction>());
+    returns.insert("loggingError", enumRef<Logging::LoggingError>());
+    QVariantMap seriesPoint;
+    seriesPoint.insert("timestamp", enumValueName(Int));
+    seriesPoint.insert("value", enumValueName(Variant));
+    returns.insert("o:series", QVariantList() << seriesPoint);
+    registerMethod("GetSeries", description, params, returns);
+
     // Notifications
     params.clear();
     description = "Emitted whenever an entry is appended to the logging system. ";
@@ -125,6 +154,29 @@ JsonReply* LoggingHandler::GetLogEntries(const QVariantMap &params) const
 {
     LogFilter filter = unpackLogFilter(params);
 
+    if (params.contains("cursor")) {
+        QVariantMap returns;
+        returns.insert("loggingError", enumValueName<Logging::LoggingError>(Logging::LoggingErrorInvalidFilterParameter));
+
+        // The cursor already defines where the page starts
+        if (params.contains("offset")) {
+            qCWarning(dcJsonRpc()) << "A log cursor can't be combined with an offset.";
+            return createReply(returns);
+        }
+
+        if (!NymeaCore::instance()->logEngine()->supportsCursor()) {
+            qCWarning(dcJsonRpc()) << "The log database driver does not support cursor based pagination.";
+            return createReply(returns);
+        }
+
+        qint64 timestamp; qint64 rowId;
+        if (!unpackCursor(params.value("cursor").toString(), &timestamp, &rowId)) {
+            qCWarning(dcJsonRpc()) << "Invalid log cursor:" << params.value("cursor").toString();
+            return createReply(returns);
+        }
+        filter.setCursor(timestamp, rowId);
+    }
+
     LogEntriesFetchJob *job = NymeaCore::instance()->logEngine()->fetchLogEntries(filter);
 
     JsonReply *reply = createAsyncReply("GetLogEntries");
@@ -141,6 +193,58 @@ JsonReply* LoggingHandler::GetLogEntries(const QVariantMap &params) const
         returns.insert("offset", filter.offset());
         returns.insert("count", entries.count());
 
+        // A full page means there might be more entries
+        if (filter.limit() > 0 && entries.count() == filter.limit()) {
+            returns.insert("nextCursor", packCursor(job->results().last().timestamp().toMSecsSinceEpoch(), job->lastRowId()));
+        }
+
+        reply->setData(returns);
+        reply->finished();
+    });
+
+    return reply;
+}
+
+JsonReply *LoggingHandler::GetSeries(const QVariantMap &params) const
+{
+    ThingId thingId = ThingId(params.value("thingId").toString());
+    QUuid typeId = params.value("typeId").toUuid();
+    qint64 bucketSize = params.value("bucketSize").toLongLong() * 1000;
+
+    QDateTime from; QDateTime to;
+    if (params.contains("from"))
+        from = QDateTime::fromTime_t(params.value("from").toUInt());
+
+    if (params.contains("to"))
+        to = QDateTime::fromTime_t(params.value("to").toUInt());
+
+    Logging::SeriesFunction function = Logging::SeriesFunctionAverage;
+    if (params.contains("function"))
+        function = enumNameToValue<Logging::SeriesFunction>(params.value("function").toString());
+
+    if (bucketSize <= 0 || (from.isValid() && to.isValid() && from > to)) {
+        QVariantMap returns;
+        returns.insert("loggingError", enumValueName<Logging::LoggingError>(Logging::LoggingErrorInvalidFilterParameter));
+        return createReply(returns);
+    }
+
+    LogSeriesFetchJob *job = NymeaCore::instance()->logEngine()->fetchSeries(thingId, typeId, from, to, bucketSize, function);
+
+    JsonReply *reply = createAsyncReply("GetSeries");
+
+    connect(job, &LogSeriesFetchJob::finished, reply, [reply, job](){
+        QVariantList series;
+        typedef QPair<QDateTime, QVariant> SeriesPoint;
+        foreach (const SeriesPoint &result, job->results()) {
+            QVariantMap point;
+            point.insert("timestamp", result.first.toMSecsSinceEpoch());
+            point.insert("value", result.second);
+            series.append(point);
+        }
+        QVariantMap returns;
+        returns.insert("loggingError", enumValueName<Logging::LoggingError>(Logging::LoggingErrorNoError));
+        returns.insert("series", series);
+
         reply->setData(returns);
         reply->finished();
     });
@@ -274,4 +378,22 @@ LogFilter LoggingHandler::unpackLogFilter(const QVariantMap &logFilterMap)
     return filter;
 }
 
+QString LoggingHandler::packCursor(qint64 timestamp, qint64 rowId)
+{
+    QByteArray cursor = QByteArray::number(timestamp) + ':' + QByteArray::number(rowId);
+    return QString::fromUtf8(cursor.toBase64(QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals));
+}
+
+bool LoggingHandler::unpackCursor(const QString &cursor, qint64 *timestamp, qint64 *rowId)
+{
+    QList<QByteArray> parts = QByteArray::fromBase64(cursor.toUtf8(), QByteArray::Base64UrlEncoding).split(':');
+    if (parts.count() != 2) {
+        return false;
+    }
+    bool timestampOk = false; bool rowIdOk = false;
+    *timestamp = parts.at(0).toLongLong(&timestampOk);
+    *rowId = parts.at(1).toLongLong(&rowIdOk);
+    return timestampOk && rowIdOk;
+}
+
 }
@@ -45,6 +45,7 @@ public:
     QString name() const override;
 
     Q_INVOKABLE JsonReply *GetLogEntries(const QVariantMap &params) const;
+    Q_INVOKABLE JsonReply *GetSeries(const QVariantMap &params) const;
 
 signals:
     void LogEntryAdded(const QVariantMap &params);
@@ -55,6 +56,9 @@ private:
 
     static LogFilter unpackLogFilter(const QVariantMap &logFilterMap);
 
+    static QString packCursor(qint64 timestamp, qint64 rowId);
+    static bool unpackCursor(const QString &cursor, qint64 *timestamp, qint64 *rowId);
+
 private slots:
     void logEntryAdded(const LogEntry &entry);
     void logDatabaseUpdated();
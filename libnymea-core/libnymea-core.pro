@@ -5,7 +5,7 @@ include(../nymea.pri)
 
 QT += bluetooth dbus qml sql websockets serialport
 INCLUDEPATH += $$top_srcdir/libnymea $$top_builddir
-LIBS += -L$$top_builddir/libnymea/ -lnymea -lssl -lcrypto
+LIBS += -L$$top_builddir/libnymea/ -lnymea -lssl -lcrypto -lz
 
 CONFIG += link_pkgconfig
 PKGCONFIG += nymea-mqtt nymea-networkmanager nymea-zigbee nymea-remoteproxyclient nymea-gpio
@@ -99,9 +99,13 @@ HEADERS += nymeacore.h \
     servers/httpreply.h \
     servers/bluetoothserver.h \
     servers/websocketserver.h \
+    servers/compressioncontext.h \
     servers/mqttbroker.h \
+    servers/mqtttopictrie.h \
     jsonrpc/jsonrpcserverimplementation.h \
     jsonrpc/jsonvalidator.h \
+    jsonrpc/jsonframeparser.h \
+    jsonrpc/cborframeparser.h \
     jsonrpc/integrationshandler.h \
     jsonrpc/devicehandler.h \
     jsonrpc/ruleshandler.h \
@@ -192,10 +196,14 @@ SOURCES += nymeacore.cpp \
     servers/httprequest.cpp \
     servers/httpreply.cpp \
     servers/websocketserver.cpp \
+    servers/compressioncontext.cpp \
     servers/bluetoothserver.cpp \
     servers/mqttbroker.cpp \
+    servers/mqtttopictrie.cpp \
     jsonrpc/jsonrpcserverimplementation.cpp \
     jsonrpc/jsonvalidator.cpp \
+    jsonrpc/jsonframeparser.cpp \
+    jsonrpc/cborframeparser.cpp \
     jsonrpc/integrationshandler.cpp \
     jsonrpc/devicehandler.cpp \
     jsonrpc/ruleshandler.cpp \
@@ -46,9 +46,10 @@
 #include <QDateTime>
 #include <QFileInfo>
 #include <QTime>
+#include <QTimer>
 #include <QtConcurrent/QtConcurrent>
 
-#define DB_SCHEMA_VERSION 4
+#define DB_SCHEMA_VERSION 5
 
 namespace nymeaserver {
 
@@ -68,7 +69,10 @@ LogEngine::LogEngine(const QString &driver, const QString &dbName, const QString
     m_db.setDatabaseName(dbName);
     m_db.setHostName(hostname);
     m_trimSize = qRound(0.01 * m_dbMaxSize);
-    m_maxQueueLength = 1000;
+
+    m_commitTimer.setSingleShot(true);
+    m_commitTimer.setInterval(250);
+    connect(&m_commitTimer, &QTimer::timeout, this, &LogEngine::flushPendingEntries);
 
     qCDebug(dcLogEngine) << "Opening logging database" << m_db.databaseName() << "(Max size:" << m_dbMaxSize << "trim size:" << m_trimSize << ")";
 
@@ -94,6 +98,8 @@ LogEngine::LogEngine(const QString &driver, const QString &dbName, const QString
 
 LogEngine::~LogEngine()
 {
+    flushPendingEntries();
+
     // Process the job queue before allowing to shut down
     while (m_currentJob) {
         qCDebug(dcLogEngine()) << "Waiting for job to finish... (" << m_jobQueue.count() << "jobs left in queue)";
@@ -115,6 +121,18 @@ void LogEngine::setThingManager(ThingManager *thingManager)
 
 LogEntriesFetchJob *LogEngine::fetchLogEntries(const LogFilter &filter)
 {
+    bool hasRowId = supportsCursor();
+    if (filter.hasCursor() && !hasRowId) {
+        // Without a rowid, entries sharing the timestamp of the last entry would be skipped.
+        qCWarning(dcLogEngine()) << "Cursor based pagination is not supported with the" << m_db.driverName() << "driver.";
+        LogEntriesFetchJob *fetchJob = new LogEntriesFetchJob(this);
+        QTimer::singleShot(0, fetchJob, [fetchJob](){
+            fetchJob->finished();
+            fetchJob->deleteLater();
+        });
+        return fetchJob;
+    }
+
     QList<LogEntry> results;
 
     QString limitString;
@@ -125,16 +143,33 @@ LogEntriesFetchJob *LogEngine::fetchLogEntries(const LogFilter &filter)
         limitString.append(QString("OFFSET %1").arg(QString::number(filter.offset())));
     }
 
-    QString queryString;
-    if (filter.isEmpty()) {
-        queryString = QString("SELECT * FROM entries ORDER BY timestamp DESC %1;").arg(limitString);
-    } else {
-        queryString = QString("SELECT * FROM entries WHERE %1 ORDER BY timestamp DESC %2;").arg(filter.queryString()).arg(limitString);
+    QStringList conditions;
+    QVariantList bindValues = filter.values();
+    if (!filter.isEmpty()) {
+        conditions.append(QString("(%1)").arg(filter.queryString().trimmed()));
     }
 
-    DatabaseJob *job = new DatabaseJob(m_db, queryString, filter.values());
+    if (filter.hasCursor()) {
+        // Keyset pagination: continue right after the last entry of the previous page. The range on the
+        // timestamp comes first so SQLite can search the timestamp index instead of scanning it.
+        conditions.append("(timestamp <= ? AND (timestamp < ? OR rowid < ?))");
+        bindValues << filter.cursorTimestamp() << filter.cursorTimestamp() << filter.cursorRowId();
+    }
+
+    QString queryString = hasRowId ? "SELECT rowid AS rowId, * FROM entries " : "SELECT * FROM entries ";
+    if (!conditions.isEmpty()) {
+        queryString.append(QString("WHERE %1 ").arg(conditions.join(" AND ")));
+    }
+    queryString.append(hasRowId ? "ORDER BY timestamp DESC, rowid DESC " : "ORDER BY timestamp DESC ");
+    queryString.append(limitString.trimmed() + ";");
+
+    DatabaseJob *job = new DatabaseJob(m_db, queryString, bindValues);
     LogEntriesFetchJob *fetchJob = new LogEntriesFetchJob(this);
 
+    // Entries not written yet need to be committed before they can be fetched
+    bool hasPendingEntries = !m_pendingEntries.isEmpty();
+    flushPendingEntries();
+
     connect(job, &DatabaseJob::finished, this, [job, fetchJob](){
         fetchJob->deleteLater();
         if (job->error().isValid()) {
@@ -156,12 +191,94 @@ LogEntriesFetchJob *LogEngine::fetchLogEntries(const LogFilter &filter)
             entry.setActive(result.value("active").toBool());
 
             fetchJob->m_results.append(entry);
+            fetchJob->m_lastRowId = result.value("rowId").toLongLong();
         }
         qCDebug(dcLogEngine) << "Fetched" << fetchJob->results().count() << "entries for db query:" << job->executedQuery();
         fetchJob->finished();
     });
 
-    enqueJob(job, true);
+    enqueJob(job, !hasPendingEntries);
+
+    return fetchJob;
+}
+
+LogSeriesFetchJob *LogEngine::fetchSeries(const ThingId &thingId, const QUuid &typeId, const QDateTime &from, const QDateTime &to, qint64 bucketSize, Logging::SeriesFunction function)
+{
+    QStringList conditions;
+    QVariantList bindValues;
+
+    // Buckets are aligned to the start of the requested range
+    qint64 origin = from.isValid() ? from.toMSecsSinceEpoch() : 0;
+    bindValues << origin << bucketSize;
+
+    conditions.append("thingId = ?");
+    bindValues << thingId.toString();
+    conditions.append("typeId = ?");
+    bindValues << typeId.toString();
+    if (from.isValid()) {
+        conditions.append("timestamp >= ?");
+        bindValues << from.toMSecsSinceEpoch();
+    }
+    if (to.isValid()) {
+        conditions.append("timestamp <= ?");
+        bindValues << to.toMSecsSinceEpoch();
+    }
+
+    QString bucket = "timestamp - ((timestamp - ?) % ?)";
+    QString queryString;
+    switch (function) {
+    case Logging::SeriesFunctionAverage:
+        queryString = QString("SELECT %1 AS bucket, AVG(CAST(value AS REAL)) AS value FROM entries WHERE %2 GROUP BY bucket ORDER BY bucket;");
+        break;
+    case Logging::SeriesFunctionMinimum:
+        queryString = QString("SELECT %1 AS bucket, MIN(CAST(value AS REAL)) AS value FROM entries WHERE %2 GROUP BY bucket ORDER BY bucket;");
+        break;
+    case Logging::SeriesFunctionMaximum:
+        queryString = QString("SELECT %1 AS bucket, MAX(CAST(value AS REAL)) AS value FROM entries WHERE %2 GROUP BY bucket ORDER BY bucket;");
+        break;
+    case Logging::SeriesFunctionLast:
+        if (supportsCursor()) {
+            // SQLite takes bare columns of an aggregate query from the row holding the maximum, which is the newest one
+            queryString = QString("SELECT %1 AS bucket, value, MAX(rowid) FROM entries WHERE %2 GROUP BY bucket ORDER BY bucket;");
+        } else {
+            // There is no portable aggregate for the last value, reduce the ordered rows while reading them
+            queryString = QString("SELECT %1 AS bucket, value FROM entries WHERE %2 ORDER BY timestamp;");
+        }
+        break;
+    }
+    queryString = queryString.arg(bucket).arg(conditions.join(" AND "));
+
+    DatabaseJob *job = new DatabaseJob(m_db, queryString, bindValues);
+    LogSeriesFetchJob *fetchJob = new LogSeriesFetchJob(this);
+
+    bool hasPendingEntries = !m_pendingEntries.isEmpty();
+    flushPendingEntries();
+
+    connect(job, &DatabaseJob::finished, this, [job, fetchJob, function](){
+        fetchJob->deleteLater();
+        if (job->error().isValid()) {
+            qCWarning(dcLogEngine) << "Error fetching log series. Driver error:" << job->error().driverText() << "Database error:" << job->error().databaseText();
+            fetchJob->finished();
+            return;
+        }
+
+        foreach (const QSqlRecord &result, job->results()) {
+            QDateTime bucketStart = QDateTime::fromMSecsSinceEpoch(result.value("bucket").toLongLong());
+            if (function == Logging::SeriesFunctionLast) {
+                if (!fetchJob->m_results.isEmpty() && fetchJob->m_results.last().first == bucketStart) {
+                    fetchJob->m_results.last().second = result.value("value");
+                    continue;
+                }
+                fetchJob->m_results.append(qMakePair(bucketStart, result.value("value")));
+            } else {
+                fetchJob->m_results.append(qMakePair(bucketStart, QVariant(result.value("value").toDouble())));
+            }
+        }
+        qCDebug(dcLogEngine) << "Fetched" << fetchJob->m_results.count() << "series buckets for db query:" << job->executedQuery();
+        fetchJob->finished();
+    });
+
+    enqueJob(job, !hasPendingEntries);
 
     return fetchJob;
 }
@@ -191,7 +308,13 @@ ThingsFetchJob *LogEngine::fetchThings()
 
 bool LogEngine::jobsRunning() const
 {
-    return !m_jobQueue.isEmpty() || m_currentJob;
+    return !m_jobQueue.isEmpty() || m_currentJob || !m_pendingEntries.isEmpty();
+}
+
+bool LogEngine::supportsCursor() const
+{
+    // Only SQLite provides an implicit rowid to order entries sharing the same timestamp
+    return m_db.driverName() == "QSQLITE";
 }
 
 void LogEngine::setMaxLogEntries(int maxLogEntries, int trimSize)
@@ -201,9 +324,15 @@ void LogEngine::setMaxLogEntries(int maxLogEntries, int trimSize)
     trim();
 }
 
+void LogEngine::setCommitInterval(int msecs)
+{
+    m_commitTimer.setInterval(qMax(0, msecs));
+}
+
 void LogEngine::clearDatabase()
 {
     qCWarning(dcLogEngine) << "Clearing logging database.";
+    flushPendingEntries();
 
     QString queryDeleteString = QString("DELETE FROM entries;");
 
@@ -346,6 +475,7 @@ void LogEngine::logRuleExitActionsExecuted(const Rule &rule)
 void LogEngine::removeThingLogs(const ThingId &thingId)
 {
     qCDebug(dcLogEngine) << "Deleting log entries from device" << thingId.toString();
+    flushPendingEntries();
 
     QString queryDeleteString = QString("DELETE FROM entries WHERE thingId = '%1';").arg(thingId.toString());
 
@@ -366,6 +496,7 @@ void LogEngine::removeThingLogs(const ThingId &thingId)
 void LogEngine::removeRuleLogs(const RuleId &ruleId)
 {
     qCDebug(dcLogEngine) << "Deleting log entries from rule" << ruleId.toString();
+    flushPendingEntries();
 
     QString queryDeleteString = QString("DELETE FROM entries WHERE typeId = '%1';").arg(ruleId.toString());
 
@@ -388,52 +519,56 @@ void LogEngine::removeRuleLogs(const RuleId &ruleId)
 void LogEngine::appendLogEntry(const LogEntry &entry)
 {
     qCDebug(dcLogEngine()) << "Adding log entry:" << entry;
-    QString queryString = QString("INSERT INTO entries (timestamp, loggingEventType, loggingLevel, sourceType, typeId, thingId, value, active, errorCode) values (?, ?, ?, ?, ?, ?, ?, ?, ?);");
-    QVariantList bindValues;
-    bindValues.append(entry.timestamp().toMSecsSinceEpoch());
-    bindValues.append(entry.eventType());
-    bindValues.append(entry.level());
-    bindValues.append(entry.source());
-    bindValues.append(entry.typeId().toString());
-    bindValues.append(entry.thingId().toString());
-    bindValues.append(LogValueTool::convertVariantToString(entry.value()));
-    bindValues.append(entry.active());
-    bindValues.append(entry.errorCode());
+    m_pendingEntries.append(entry);
 
-    DatabaseJob *job = new DatabaseJob(m_db, queryString, bindValues);
+    if (m_pendingEntries.count() >= m_maxBatchSize) {
+        flushPendingEntries();
+    } else if (!m_commitTimer.isActive()) {
+        m_commitTimer.start();
+    }
+}
 
-    // Check for log flooding. If we are exceeding the queue we'll start flagging log events of a certain type.
-    // If we'll get more log events of the same type while the queue is still exceededd, we'll discard the old
-    // ones and queue up the new one instead. The most recent one is more important (i.e. we don't want to lose
-    // the last event in a series).
-    if (m_jobQueue.count() > m_maxQueueLength) {
-        qCDebug(dcLogEngine()) << "An excessive amount of data is being logged. (" << m_jobQueue.length() << "jobs in the queue)";
-        if (m_flaggedJobs.contains(entry.typeId().toString() + entry.thingId().toString())) {
-            if (m_flaggedJobs.value(entry.typeId().toString() + entry.thingId().toString()).count() > 10) {
-                qCWarning(dcLogEngine()) << "Discarding log entry because of excessive log flooding.";
-                DatabaseJob *job = m_flaggedJobs[entry.typeId().toString() + entry.thingId().toString()].takeFirst();
-                int jobIdx = m_jobQueue.indexOf(job);
-                m_jobQueue.takeAt(jobIdx)->deleteLater();
-            }
-        }
-        m_flaggedJobs[entry.typeId().toString() + entry.thingId().toString()].append(job);
+void LogEngine::flushPendingEntries()
+{
+    m_commitTimer.stop();
+    if (m_pendingEntries.isEmpty()) {
+        return;
     }
 
-    connect(job, &DatabaseJob::finished, this, [this, job, entry](){
+    QList<LogEntry> entries = m_pendingEntries;
+    m_pendingEntries.clear();
 
-        m_flaggedJobs[entry.typeId().toString() + entry.thingId().toString()].removeAll(job);
+    QString queryString = QString("INSERT INTO entries (timestamp, loggingEventType, loggingLevel, sourceType, typeId, thingId, value, active, errorCode) values (?, ?, ?, ?, ?, ?, ?, ?, ?);");
+    QList<QVariantList> batchBindValues;
+    foreach (const LogEntry &entry, entries) {
+        QVariantList bindValues;
+        bindValues.append(entry.timestamp().toMSecsSinceEpoch());
+        bindValues.append(entry.eventType());
+        bindValues.append(entry.level());
+        bindValues.append(entry.source());
+        bindValues.append(entry.typeId().toString());
+        bindValues.append(entry.thingId().toString());
+        bindValues.append(LogValueTool::convertVariantToString(entry.value()));
+        bindValues.append(entry.active());
+        bindValues.append(entry.errorCode());
+        batchBindValues.append(bindValues);
+    }
 
+    DatabaseJob *job = new DatabaseJob(m_db, queryString, batchBindValues);
+
+    connect(job, &DatabaseJob::finished, this, [this, job, entries](){
         if (job->error().type() != QSqlError::NoError) {
-            qCWarning(dcLogEngine) << "Error writing log entry. Driver error:" << job->error().driverText() << "Database error:" << job->error().databaseText();
-            qCWarning(dcLogEngine) << entry;
+            qCWarning(dcLogEngine) << "Error writing" << entries.count() - job->writtenRows() << "of" << entries.count() << "log entries. Driver error:" << job->error().driverText() << "Database error:" << job->error().databaseText();
             m_dbMalformed = true;
-            return;
+        } else {
+            qCDebug(dcLogEngine()) << "Committed" << entries.count() << "log entries.";
         }
 
+        for (int i = 0; i < job->writtenRows(); i++) {
+            emit logEntryAdded(entries.at(i));
+        }
 
-        emit logEntryAdded(entry);
-
-        m_entryCount++;
+        m_entryCount += job->writtenRows();
         trim();
     });
 
@@ -462,16 +597,33 @@ void LogEngine::trim()
     }
     QDateTime startTime = QDateTime::currentDateTime();
 
-    QString queryDeleteString = QString("DELETE FROM entries WHERE ROWID IN (SELECT ROWID FROM entries ORDER BY timestamp DESC LIMIT -1 OFFSET %1);").arg(QString::number(m_dbMaxSize - m_trimSize));
+    int keepCount = m_dbMaxSize - m_trimSize;
+    QString queryDeleteString;
+    if (keepCount <= 0) {
+        queryDeleteString = QString("DELETE FROM entries;");
+    } else if (m_db.driverName() == "QSQLITE") {
+        // Rowids grow with every insert, so the newest entries are the ones with the highest rowid. Removing the
+        // logs of a thing leaves gaps, so the cutoff is the first rowid which doesn't need to be kept.
+        queryDeleteString = QString("DELETE FROM entries WHERE rowid <= (SELECT rowid FROM entries ORDER BY rowid DESC LIMIT 1 OFFSET %1);").arg(keepCount);
+    } else {
+        queryDeleteString = QString("DELETE FROM entries ORDER BY timestamp ASC LIMIT %1;").arg(m_entryCount - keepCount);
+    }
 
     DatabaseJob *deleteJob = new DatabaseJob(m_db, queryDeleteString);
 
     connect(deleteJob, &DatabaseJob::finished, this, [this, deleteJob, startTime](){
         if (deleteJob->error().type() != QSqlError::NoError) {
             qCWarning(dcLogEngine) << "Error deleting oldest log entries to keep size. Driver error:" << deleteJob->error().driverText() << "Database error:" << deleteJob->error().databaseText();
+            return;
         }
-        qCDebug(dcLogEngine()) << "Ran housekeeping on log database in" << startTime.msecsTo(QDateTime::currentDateTime()) << "ms. (Deleted" << m_entryCount - (m_dbMaxSize - m_trimSize) << "entries)";
-        m_entryCount = m_dbMaxSize - m_trimSize;
+
+        if (deleteJob->numRowsAffected() >= 0) {
+            m_entryCount = qMax(0, m_entryCount - deleteJob->numRowsAffected());
+        } else {
+            // The driver can't tell, count again
+            checkDBSize();
+        }
+        qCDebug(dcLogEngine()) << "Ran housekeeping on log database in" << startTime.msecsTo(QDateTime::currentDateTime()) << "ms. (Deleted" << deleteJob->numRowsAffected() << "entries)";
 
         emit logDatabaseUpdated();
     });
@@ -525,6 +677,37 @@ void LogEngine::processQueue()
         QSqlQuery query(job->m_db);
         query.prepare(job->m_queryString);
 
+        if (!job->m_batchBindValues.isEmpty()) {
+            // Reuse the prepared query for all rows and commit them at once. If no transaction
+            // can be started, every row gets committed on its own and the written rows are kept.
+            bool transaction = job->m_db.transaction();
+            if (!transaction) {
+                qCWarning(dcLogEngine()) << "Could not start transaction, writing" << job->m_batchBindValues.count() << "rows one by one. Database error:" << job->m_db.lastError().databaseText();
+            }
+            foreach (const QVariantList &bindValues, job->m_batchBindValues) {
+                foreach (const QVariant &value, bindValues) {
+                    query.addBindValue(value);
+                }
+                if (!query.exec()) {
+                    break;
+                }
+                job->m_writtenRows++;
+            }
+            job->m_error = query.lastError();
+            job->m_executedQuery = query.executedQuery();
+            if (transaction) {
+                if (job->m_error.isValid()) {
+                    job->m_db.rollback();
+                    job->m_writtenRows = 0;
+                } else if (!job->m_db.commit()) {
+                    job->m_error = job->m_db.lastError();
+                    job->m_db.rollback();
+                    job->m_writtenRows = 0;
+                }
+            }
+            return job;
+        }
+
         foreach (const QVariant &value, job->m_bindValues) {
             query.addBindValue(value);
         }
@@ -533,6 +716,7 @@ void LogEngine::processQueue()
 
         job->m_error = query.lastError();
         job->m_executedQuery = query.executedQuery();
+        job->m_numRowsAffected = query.numRowsAffected();
 
         if (!query.lastError().isValid()) {
             while (query.next()) {
@@ -603,8 +787,8 @@ bool LogEngine::migrateDatabaseVersion3to4()
     }
     qCDebug(dcLogEngine()) << "Created new entries table:" << m_db.lastError().text();
 
-    qCDebug(dcLogEngine()) << "Updating database version to" << DB_SCHEMA_VERSION;
-    m_db.exec(QString("UPDATE metadata SET data = %1 WHERE `key` = 'version';").arg(DB_SCHEMA_VERSION));
+    qCDebug(dcLogEngine()) << "Updating database version to 4";
+    m_db.exec("UPDATE metadata SET data = 4 WHERE `key` = 'version';");
     if (m_db.lastError().isValid()) {
         qCWarning(dcLogEngine) << "Error updating database verion 3 -> 4. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
         return false;
@@ -616,6 +800,39 @@ bool LogEngine::migrateDatabaseVersion3to4()
 
 }
 
+bool LogEngine::migrateDatabaseVersion4to5()
+{
+    if (!createIndexes()) {
+        qCWarning(dcLogEngine) << "Error migrating database verion 4 -> 5 (creating indexes).";
+        return false;
+    }
+
+    m_db.exec("UPDATE metadata SET data = 5 WHERE `key` = 'version';");
+    if (m_db.lastError().isValid()) {
+        qCWarning(dcLogEngine) << "Error updating database verion 4 -> 5. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+        return false;
+    }
+
+    qCDebug(dcLogEngine()) << "Migrated database schema from version 4 to 5.";
+    return true;
+}
+
+bool LogEngine::createIndexes()
+{
+    QStringList indexQueries;
+    indexQueries << "CREATE INDEX IF NOT EXISTS idx_entries_timestamp ON entries (timestamp);";
+    indexQueries << "CREATE INDEX IF NOT EXISTS idx_entries_thingId_typeId_timestamp ON entries (thingId, typeId, timestamp);";
+    indexQueries << "CREATE INDEX IF NOT EXISTS idx_entries_sourceType_timestamp ON entries (sourceType, timestamp);";
+    foreach (const QString &indexQuery, indexQueries) {
+        m_db.exec(indexQuery);
+        if (m_db.lastError().isValid()) {
+            qCWarning(dcLogEngine) << "Error creating index on log entries. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+            return false;
+        }
+    }
+    return true;
+}
+
 void LogEngine::migrateEntries3to4()
 {
     QString selectQuery = QString("SELECT * FROM _entries_v3;");
@@ -718,6 +935,15 @@ bool LogEngine::initDB(const QString &username, const QString &password)
         return false;
     }
 
+    if (m_db.driverName() == "QSQLITE") {
+        // Write ahead logging allows committing batches without blocking readers
+        m_db.exec("PRAGMA journal_mode = WAL;");
+        m_db.exec("PRAGMA synchronous = NORMAL;");
+        if (m_db.lastError().isValid()) {
+            qCWarning(dcLogEngine()) << "Error enabling write ahead logging. Driver error:" << m_db.lastError().driverText() << "Database error:" << m_db.lastError().databaseText();
+        }
+    }
+
     if (!m_db.tables().contains("metadata")) {
         qCDebug(dcLogEngine()) << "Empty Database. Setting up metadata...";
         m_db.exec("CREATE TABLE metadata (`key` VARCHAR(10), data VARCHAR(40));");
@@ -743,6 +969,17 @@ bool LogEngine::initDB(const QString &username, const QString &password)
             }
         }
 
+        // Migration from 4 -> 5
+        if (version == 4) {
+            if (!migrateDatabaseVersion4to5()) {
+                qCWarning(dcLogEngine()) << "Migration process failed.";
+                return false;
+            } else {
+                // Successfully migrated
+                version = 5;
+            }
+        }
+
         if (version != DB_SCHEMA_VERSION) {
             qCWarning(dcLogEngine) << "Log schema version not matching! Schema upgrade not implemented for this version change.";
             return false;
@@ -804,6 +1041,9 @@ bool LogEngine::initDB(const QString &username, const QString &password)
             return false;
         }
 
+        if (!createIndexes()) {
+            return false;
+        }
 
     }
 
@@ -52,6 +52,7 @@ namespace nymeaserver {
 
 class DatabaseJob;
 class LogEntriesFetchJob;
+class LogSeriesFetchJob;
 class ThingsFetchJob;
 
 class LogEngine: public QObject
@@ -64,11 +65,14 @@ public:
     void setThingManager(ThingManager *thingManager);
 
     LogEntriesFetchJob *fetchLogEntries(const LogFilter &filter = LogFilter());
+    LogSeriesFetchJob *fetchSeries(const ThingId &thingId, const QUuid &typeId, const QDateTime &from, const QDateTime &to, qint64 bucketSize, Logging::SeriesFunction function);
     ThingsFetchJob *fetchThings();
 
     bool jobsRunning() const;
+    bool supportsCursor() const;
 
     void setMaxLogEntries(int maxLogEntries, int trimSize);
+    void setCommitInterval(int msecs);
     void clearDatabase();
 
     void removeThingLogs(const ThingId &thingId);
@@ -102,11 +106,15 @@ private:
     bool migrateDatabaseVersion3to4();
     void migrateEntries3to4();
     void finalizeMigration3To4();
+    bool migrateDatabaseVersion4to5();
+    bool createIndexes();
 
 private slots:
     void checkDBSize();
     void trim();
 
+    void flushPendingEntries();
+
     void enqueJob(DatabaseJob *job, bool priority = false);
     void processQueue();
     void handleJobFinished();
@@ -123,9 +131,11 @@ private:
 
     ThingManager *m_thingManager = nullptr;
 
-    // When maxQueueLength is exceeded, jobs will be flagged and discarded if this source logs more events
-    int m_maxQueueLength;
-    QHash<QString, QList<DatabaseJob*>> m_flaggedJobs;
+    // New entries are collected and written in a single transaction when the commit timer
+    // times out or maxBatchSize is reached
+    QList<LogEntry> m_pendingEntries;
+    QTimer m_commitTimer;
+    int m_maxBatchSize = 1000;
 
     QList<DatabaseJob*> m_jobQueue;
     DatabaseJob *m_currentJob = nullptr;
@@ -143,9 +153,20 @@ public:
     {
     }
 
+    // Executes the query once per entry in batchBindValues within a single transaction
+    DatabaseJob(const QSqlDatabase &db, const QString &queryString, const QList<QVariantList> &batchBindValues):
+        m_db(db),
+        m_queryString(queryString),
+        m_batchBindValues(batchBindValues)
+    {
+    }
+
     QString executedQuery() const { return m_executedQuery; }
     QSqlError error() const { return m_error; }
     QList<QSqlRecord> results() const { return m_results; }
+    // Number of batch rows which made it into the database, even if the job failed afterwards
+    int writtenRows() const { return m_writtenRows; }
+    int numRowsAffected() const { return m_numRowsAffected; }
 
 signals:
     void finished();
@@ -154,10 +175,13 @@ private:
     QSqlDatabase m_db;
     QString m_queryString;
     QVariantList m_bindValues;
+    QList<QVariantList> m_batchBindValues;
 
     QString m_executedQuery;
     QSqlError m_error;
     QList<QSqlRecord> m_results;
+    int m_writtenRows = 0;
+    int m_numRowsAffected = -1;
 
     friend class LogEngine;
 };
@@ -168,10 +192,26 @@ class LogEntriesFetchJob: public QObject
 public:
     LogEntriesFetchJob(QObject *parent): QObject(parent) {}
     QList<LogEntry> results() { return m_results; }
+    qint64 lastRowId() const { return m_lastRowId; }
 signals:
     void finished();
 private:
     QList<LogEntry> m_results;
+    qint64 m_lastRowId = 0;
+    friend class LogEngine;
+};
+
+class LogSeriesFetchJob: public QObject
+{
+    Q_OBJECT
+public:
+    LogSeriesFetchJob(QObject *parent): QObject(parent) {}
+    // Pairs of bucket start and aggregated value, sorted by bucket start
+    QList<QPair<QDateTime, QVariant> > results() { return m_results; }
+signals:
+    void finished();
+private:
+    QList<QPair<QDateTime, QVariant> > m_results;
     friend class LogEngine;
 };
 
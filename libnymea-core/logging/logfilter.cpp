@@ -228,6 +228,37 @@ int LogFilter::offset() const
     return m_offset;
 }
 
+/*! Set the cursor for the result set to the entry with the given \a timestamp and \a rowId.
+ * Only entries older than this entry will be returned. In contrast to the \l{offset}, the cursor
+ * does not require the database to skip over all newer entries and the returned page stays
+ * stable while new entries are appended to the database.
+ * \sa{setLimit}
+ */
+void LogFilter::setCursor(qint64 timestamp, qint64 rowId)
+{
+    m_hasCursor = true;
+    m_cursorTimestamp = timestamp;
+    m_cursorRowId = rowId;
+}
+
+/*! Returns true if a cursor has been set on this \l{LogFilter}. \sa{setCursor} */
+bool LogFilter::hasCursor() const
+{
+    return m_hasCursor;
+}
+
+/*! Returns the timestamp (in ms since epoch) of the cursor entry. \sa{setCursor} */
+qint64 LogFilter::cursorTimestamp() const
+{
+    return m_cursorTimestamp;
+}
+
+/*! Returns the database row id of the cursor entry. \sa{setCursor} */
+qint64 LogFilter::cursorRowId() const
+{
+    return m_cursorRowId;
+}
+
 /*! Returns true if this \l{LogFilter} is empty. */
 bool LogFilter::isEmpty() const
 {
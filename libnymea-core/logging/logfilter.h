@@ -77,6 +77,11 @@ public:
     void setOffset(int offset);
     int offset() const;
 
+    void setCursor(qint64 timestamp, qint64 rowId);
+    bool hasCursor() const;
+    qint64 cursorTimestamp() const;
+    qint64 cursorRowId() const;
+
     bool isEmpty() const;
 
 private:
@@ -89,6 +94,9 @@ private:
     QVariantList m_values;
     int m_limit = -1;
     int m_offset = 0;
+    bool m_hasCursor = false;
+    qint64 m_cursorTimestamp = 0;
+    qint64 m_cursorRowId = 0;
 
     QString createDateString() const;
     QString createTimeFilterString(QPair<QDateTime, QDateTime> timeFilter) const;
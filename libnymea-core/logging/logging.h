@@ -74,6 +74,14 @@ public:
     };
     Q_ENUM(LoggingEventType)
 
+    enum SeriesFunction {
+        SeriesFunctionAverage,
+        SeriesFunctionMinimum,
+        SeriesFunctionMaximum,
+        SeriesFunctionLast
+    };
+    Q_ENUM(SeriesFunction)
+
     Logging(QObject *parent = nullptr);
 };
 
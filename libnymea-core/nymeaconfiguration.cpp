@@ -219,6 +219,12 @@ NymeaConfiguration::NymeaConfiguration(QObject *parent) :
     settings.setValue("logDBUser", logDBUser());
     settings.setValue("logDBPassword", logDBPassword());
     settings.setValue("logDBMaxEntries", logDBMaxEntries());
+    settings.setValue("logDBCommitInterval", logDBCommitInterval());
+    settings.endGroup();
+
+    // Write defaults for the thing state cache
+    settings.beginGroup("ThingStates");
+    settings.setValue("stateCacheFlushInterval", stateCacheFlushInterval());
     settings.endGroup();
 }
 
@@ -555,6 +561,20 @@ int NymeaConfiguration::logDBMaxEntries() const
     return settings.value("logDBMaxEntries", 200000).toInt();
 }
 
+int NymeaConfiguration::logDBCommitInterval() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("Logs");
+    return settings.value("logDBCommitInterval", 250).toInt();
+}
+
+int NymeaConfiguration::stateCacheFlushInterval() const
+{
+    NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
+    settings.beginGroup("ThingStates");
+    return settings.value("stateCacheFlushInterval", 10000).toInt();
+}
+
 QString NymeaConfiguration::sslCertificate() const
 {
     NymeaSettings settings(NymeaSettings::SettingsRoleGlobal);
@@ -631,6 +651,7 @@ void NymeaConfiguration::storeServerConfig(const QString &group, const ServerCon
     settings.setValue("port", config.port);
     settings.setValue("sslEnabled", config.sslEnabled);
     settings.setValue("authenticationEnabled", config.authenticationEnabled);
+    settings.setValue("compressionEnabled", config.compressionEnabled);
     settings.endGroup();
     settings.endGroup();
 }
@@ -646,6 +667,7 @@ ServerConfiguration NymeaConfiguration::readServerConfig(const QString &group, c
     config.port = settings.value("port").toUInt();
     config.sslEnabled = settings.value("sslEnabled", true).toBool();
     config.authenticationEnabled = settings.value("authenticationEnabled", true).toBool();
+    config.compressionEnabled = settings.value("compressionEnabled", false).toBool();
     settings.endGroup();
     settings.endGroup();
     return config;
@@ -46,6 +46,7 @@ class ServerConfiguration {
     Q_PROPERTY(uint port MEMBER port)
     Q_PROPERTY(bool sslEnabled MEMBER sslEnabled)
     Q_PROPERTY(bool authenticationEnabled MEMBER authenticationEnabled)
+    Q_PROPERTY(bool compressionEnabled MEMBER compressionEnabled USER true)
 public:
     QString id;
     QHostAddress address;
@@ -54,13 +55,15 @@ public:
     uint port = 0;
     bool sslEnabled = true;
     bool authenticationEnabled = true;
+    bool compressionEnabled = false;
 
     bool operator==(const ServerConfiguration &other) const {
         return id == other.id
                 && address == other.address
                 && port == other.port
                 && sslEnabled == other.sslEnabled
-                && authenticationEnabled == other.authenticationEnabled;
+                && authenticationEnabled == other.authenticationEnabled
+                && compressionEnabled == other.compressionEnabled;
     }
 };
 
@@ -180,6 +183,10 @@ public:
     QString logDBUser() const;
     QString logDBPassword() const;
     int logDBMaxEntries() const;
+    int logDBCommitInterval() const;
+
+    // Thing states
+    int stateCacheFlushInterval() const;
 
 private:
     QHash<QString, ServerConfiguration> m_tcpServerConfigs;
@@ -85,6 +85,7 @@ NymeaCore::NymeaCore(QObject *parent) :
 
 void NymeaCore::init(const QStringList &additionalInterfaces) {
     qCDebug(dcCore()) << "Initializing NymeaCore";
+    m_startupTimer.start();
 
     qCDebug(dcPlatform()) << "Loading platform abstraction";
     m_platform = new Platform(this);
@@ -122,12 +123,14 @@ void NymeaCore::init(const QStringList &additionalInterfaces) {
 
     qCDebug(dcCore) << "Creating Thing Manager (locale:" << m_configuration->locale() << ")";
     m_thingManager = new ThingManagerImplementation(m_hardwareManager, m_configuration->locale(), this);
+    m_thingManager->setStateCacheFlushInterval(m_configuration->stateCacheFlushInterval());
 
     qCDebug(dcCore) << "Creating Rule Engine";
     m_ruleEngine = new RuleEngine(this);
 
     qCDebug(dcCore) << "Creating Log Engine";
     m_logger = new LogEngine(m_configuration->logDBDriver(), m_configuration->logDBName(), m_configuration->logDBHost(), m_configuration->logDBUser(), m_configuration->logDBPassword(), m_configuration->logDBMaxEntries(), this);
+    m_logger->setCommitInterval(m_configuration->logDBCommitInterval());
     m_logger->setThingManager(m_thingManager);
 
     qCDebug(dcCore()) << "Creating Script Engine";
@@ -176,6 +179,7 @@ void NymeaCore::init(const QStringList &additionalInterfaces) {
     connect(m_timeManager, &TimeManager::dateTimeChanged, this, &NymeaCore::onDateTimeChanged);
 
     m_logger->logSystemEvent(m_timeManager->currentDateTime(), true);
+    m_coreSetupTime = m_startupTimer.elapsed();
 }
 
 /*! Destructor of the \l{NymeaCore}. */
@@ -819,6 +823,8 @@ void NymeaCore::onThingDisappeared(const ThingId &thingId)
 
 void NymeaCore::thingManagerLoaded()
 {
+    qint64 thingsLoadedTime = m_startupTimer.elapsed();
+
     m_ruleEngine->init();
     // Evaluate rules on current time
     onDateTimeChanged(m_timeManager->currentDateTime());
@@ -826,6 +832,11 @@ void NymeaCore::thingManagerLoaded()
     // Tell hardare resources we're done with loading stuff...
     m_hardwareManager->thingsLoaded();
 
+    qint64 totalTime = m_startupTimer.elapsed();
+    qCInfo(dcCore()).nospace() << "Startup finished in " << totalTime << " ms (core setup: " << m_coreSetupTime << " ms"
+                               << ", plugins and things: " << thingsLoadedTime - m_coreSetupTime << " ms"
+                               << ", rules: " << totalTime - thingsLoadedTime << " ms)";
+
     emit initialized();
 
     // Do some houskeeping...
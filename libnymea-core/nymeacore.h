@@ -49,6 +49,7 @@
 #include "debugserverhandler.h"
 
 #include <QObject>
+#include <QElapsedTimer>
 
 class Thing;
 
@@ -159,6 +160,10 @@ private:
 
     QList<RuleId> m_executingRules;
 
+    // Startup timing report
+    QElapsedTimer m_startupTimer;
+    qint64 m_coreSetupTime = 0;
+
 private slots:
     void gotEvent(const Event &event);
     void onDateTimeChanged(const QDateTime &dateTime);
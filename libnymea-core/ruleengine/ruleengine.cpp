@@ -166,7 +166,7 @@ QList<Rule> RuleEngine::evaluateEvent(const Event &event)
     }
 
     QList<Rule> rules;
-    foreach (const RuleId &id, ruleIds()) {
+    foreach (const RuleId &id, candidateRules(event, thingClass)) {
         Rule rule = m_rules.value(id);
         if (!rule.enabled()) {
             qCDebug(dcRuleEngineDebug()).nospace().noquote() << "Skipping rule " << rule.name() << " (" << rule.id().toString() << ") "  << " because it is disabled.";
@@ -175,7 +175,9 @@ QList<Rule> RuleEngine::evaluateEvent(const Event &event)
 
         // If we have a state based on this event
         if (containsState(rule.stateEvaluator(), event)) {
-            rule.setStatesActive(rule.stateEvaluator().evaluate());
+            StateEvaluator stateEvaluator = rule.stateEvaluator();
+            rule.setStatesActive(stateEvaluator.evaluateStateChange(event));
+            rule.setStateEvaluator(stateEvaluator);
             m_rules[rule.id()] = rule;
         }
 
@@ -489,7 +491,8 @@ RuleEngine::RuleError RuleEngine::removeRule(const RuleId &ruleId, bool fromEdit
     }
 
     m_ruleIds.takeAt(index);
-    m_rules.remove(ruleId);
+    unindexRule(m_rules.take(ruleId));
+    m_ruleOrder.remove(ruleId);
     m_activeRules.removeAll(ruleId);
 
     NymeaSettings settings(NymeaSettings::SettingsRoleRules);
@@ -522,7 +525,13 @@ RuleEngine::RuleError RuleEngine::enableRule(const RuleId &ruleId)
         return RuleErrorNoError;
 
     rule.setEnabled(true);
+    // The states might have changed while the rule was disabled
+    StateEvaluator stateEvaluator = rule.stateEvaluator();
+    stateEvaluator.compile();
+    rule.setStateEvaluator(stateEvaluator);
+    rule.setStatesActive(stateEvaluator.result());
     m_rules[ruleId] = rule;
+    m_pendingRules.insert(ruleId);
     saveRule(rule);
     emit ruleConfigurationChanged(rule);
 
@@ -788,7 +797,8 @@ void RuleEngine::removeThingFromRule(const RuleId &id, const ThingId &thingId)
     if (actions.isEmpty() && exitActions.isEmpty()) {
         // The rule doesn't have any actions any more and is useless at this point... let's remove it altogether
         qCDebug(dcRuleEngine()) << "Rule" << rule.name() << "(" + rule.id().toString() + ")" << "does not have any actions any more. Removing it.";
-        m_rules.take(id);
+        unindexRule(m_rules.take(id));
+        m_ruleOrder.remove(id);
         emit ruleRemoved(id);
         return;
     }
@@ -801,7 +811,9 @@ void RuleEngine::removeThingFromRule(const RuleId &id, const ThingId &thingId)
     newRule.setTimeDescriptor(rule.timeDescriptor());
     newRule.setActions(actions);
     newRule.setExitActions(exitActions);
+    unindexRule(rule);
     m_rules[id] = newRule;
+    indexRule(newRule);
 
     // save it
     saveRule(newRule);
@@ -922,6 +934,105 @@ bool RuleEngine::containsState(const StateEvaluator &stateEvaluator, const Event
     return false;
 }
 
+void RuleEngine::indexRule(const Rule &rule)
+{
+    foreach (const EventDescriptor &eventDescriptor, rule.eventDescriptors()) {
+        if (eventDescriptor.type() == EventDescriptor::TypeThing) {
+            m_thingIndex[qMakePair<QUuid, QUuid>(eventDescriptor.thingId(), eventDescriptor.eventTypeId())].insert(rule.id());
+        } else {
+            m_interfaceIndex[eventDescriptor.interface()].insert(rule.id());
+        }
+    }
+    indexStateEvaluator(rule.stateEvaluator(), rule.id(), true);
+
+    // A newly added rule might become active on the next event, no matter which one
+    m_pendingRules.insert(rule.id());
+}
+
+void RuleEngine::unindexRule(const Rule &rule)
+{
+    foreach (const EventDescriptor &eventDescriptor, rule.eventDescriptors()) {
+        if (eventDescriptor.type() == EventDescriptor::TypeThing) {
+            QPair<QUuid, QUuid> key = qMakePair<QUuid, QUuid>(eventDescriptor.thingId(), eventDescriptor.eventTypeId());
+            m_thingIndex[key].remove(rule.id());
+            if (m_thingIndex.value(key).isEmpty()) {
+                m_thingIndex.remove(key);
+            }
+        } else {
+            m_interfaceIndex[eventDescriptor.interface()].remove(rule.id());
+            if (m_interfaceIndex.value(eventDescriptor.interface()).isEmpty()) {
+                m_interfaceIndex.remove(eventDescriptor.interface());
+            }
+        }
+    }
+    indexStateEvaluator(rule.stateEvaluator(), rule.id(), false);
+    m_pendingRules.remove(rule.id());
+}
+
+void RuleEngine::indexStateEvaluator(const StateEvaluator &stateEvaluator, const RuleId &ruleId, bool insert)
+{
+    // Mirrors the matching done in containsState()
+    const StateDescriptor descriptor = stateEvaluator.stateDescriptor();
+    if (descriptor.isValid()) {
+        QList<QPair<QUuid, QUuid> > keys;
+        QStringList interfaces;
+        if (descriptor.type() == StateDescriptor::TypeThing) {
+            keys.append(qMakePair<QUuid, QUuid>(descriptor.thingId(), descriptor.stateTypeId()));
+            if (!descriptor.valueThingId().isNull()) {
+                keys.append(qMakePair<QUuid, QUuid>(descriptor.valueThingId(), descriptor.valueStateTypeId()));
+            }
+        } else {
+            interfaces.append(descriptor.interface());
+        }
+
+        foreach (const auto &key, keys) {
+            if (insert) {
+                m_thingIndex[key].insert(ruleId);
+            } else if (m_thingIndex.contains(key)) {
+                m_thingIndex[key].remove(ruleId);
+                if (m_thingIndex.value(key).isEmpty()) {
+                    m_thingIndex.remove(key);
+                }
+            }
+        }
+        foreach (const QString &interface, interfaces) {
+            if (insert) {
+                m_interfaceIndex[interface].insert(ruleId);
+            } else if (m_interfaceIndex.contains(interface)) {
+                m_interfaceIndex[interface].remove(ruleId);
+                if (m_interfaceIndex.value(interface).isEmpty()) {
+                    m_interfaceIndex.remove(interface);
+                }
+            }
+        }
+    }
+
+    foreach (const StateEvaluator &childEvaluator, stateEvaluator.childEvaluators()) {
+        indexStateEvaluator(childEvaluator, ruleId, insert);
+    }
+}
+
+/*! Returns the ids of all rules which might be affected by the given \a event, in the order
+    they have been added to the engine. Rules not referencing the event's thing, its event or state
+    type or one of the interfaces of its \a thingClass are not contained.
+*/
+QList<RuleId> RuleEngine::candidateRules(const Event &event, const ThingClass &thingClass)
+{
+    QSet<RuleId> candidates = m_pendingRules;
+    m_pendingRules.clear();
+
+    candidates.unite(m_thingIndex.value(qMakePair<QUuid, QUuid>(event.thingId(), event.eventTypeId())));
+    foreach (const QString &interface, thingClass.interfaces()) {
+        candidates.unite(m_interfaceIndex.value(interface));
+    }
+
+    QList<RuleId> ret = candidates.toList();
+    std::sort(ret.begin(), ret.end(), [this](const RuleId &a, const RuleId &b) {
+        return m_ruleOrder.value(a) < m_ruleOrder.value(b);
+    });
+    return ret;
+}
+
 RuleEngine::RuleError RuleEngine::checkRuleAction(const RuleAction &ruleAction, const Rule &rule)
 {
     if (!ruleAction.isValid()) {
@@ -1102,11 +1213,16 @@ QVariant::Type RuleEngine::getEventParamType(const EventTypeId &eventTypeId, con
 void RuleEngine::appendRule(const Rule &rule)
 {
     Rule newRule = rule;
-    newRule.setStatesActive(newRule.stateEvaluator().evaluate());
+    StateEvaluator stateEvaluator = newRule.stateEvaluator();
+    stateEvaluator.compile();
+    newRule.setStateEvaluator(stateEvaluator);
+    newRule.setStatesActive(stateEvaluator.result());
     newRule.setTimeActive(newRule.timeDescriptor().evaluate(QDateTime(), QDateTime::currentDateTime()));
     qCDebug(dcRuleEngine()) << "Adding Rule:" << newRule;
     m_rules.insert(rule.id(), newRule);
     m_ruleIds.append(rule.id());
+    m_ruleOrder.insert(rule.id(), m_ruleSequence++);
+    indexRule(newRule);
 }
 
 void RuleEngine::saveRule(const Rule &rule)
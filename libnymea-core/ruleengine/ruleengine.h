@@ -40,6 +40,7 @@
 #include <QList>
 #include <QUuid>
 #include <QSettings>
+#include <QSet>
 
 namespace nymeaserver {
 
@@ -114,6 +115,11 @@ private:
     bool containsEvent(const Rule &rule, const Event &event, const ThingClassId &thingClassId);
     bool containsState(const StateEvaluator &stateEvaluator, const Event &stateChangeEvent);
 
+    void indexRule(const Rule &rule);
+    void unindexRule(const Rule &rule);
+    void indexStateEvaluator(const StateEvaluator &stateEvaluator, const RuleId &ruleId, bool insert);
+    QList<RuleId> candidateRules(const Event &event, const ThingClass &thingClass);
+
     RuleError checkRuleAction(const RuleAction &ruleAction, const Rule &rule);
     RuleError checkRuleActionParam(const RuleActionParam &ruleActionParam, const ActionType &actionType, const Rule &rule);
 
@@ -130,6 +136,13 @@ private:
     QHash<RuleId, Rule> m_rules; // ...but use a Hash for faster finding
     QList<RuleId> m_activeRules;
 
+    // Inverted indexes to only visit rules which can possibly match an event
+    QHash<RuleId, quint64> m_ruleOrder;
+    quint64 m_ruleSequence = 0;
+    QHash<QPair<QUuid, QUuid>, QSet<RuleId> > m_thingIndex; // (thingId, eventTypeId/stateTypeId)
+    QHash<QString, QSet<RuleId> > m_interfaceIndex;
+    QSet<RuleId> m_pendingRules; // Rules to be evaluated on the next event regardless of the index
+
     QDateTime m_lastEvaluationTime;
 };
 
@@ -58,6 +58,7 @@ StateDescriptor StateEvaluator::stateDescriptor() const
 void StateEvaluator::setStateDescriptor(const StateDescriptor &stateDescriptor)
 {
     m_stateDescriptor = stateDescriptor;
+    m_compiled = false;
 }
 
 StateEvaluators StateEvaluator::childEvaluators() const
@@ -68,11 +69,13 @@ StateEvaluators StateEvaluator::childEvaluators() const
 void StateEvaluator::setChildEvaluators(const StateEvaluators &stateEvaluators)
 {
     m_childEvaluators = stateEvaluators;
+    m_compiled = false;
 }
 
 void StateEvaluator::appendEvaluator(const StateEvaluator &stateEvaluator)
 {
     m_childEvaluators.append(stateEvaluator);
+    m_compiled = false;
 }
 
 Types::StateOperator StateEvaluator::operatorType() const
@@ -83,6 +86,7 @@ Types::StateOperator StateEvaluator::operatorType() const
 void StateEvaluator::setOperatorType(Types::StateOperator operatorType)
 {
     m_operatorType = operatorType;
+    m_compiled = false;
 }
 
 bool StateEvaluator::evaluate() const
@@ -123,6 +127,61 @@ bool StateEvaluator::evaluate() const
     return true;
 }
 
+void StateEvaluator::compile()
+{
+    m_containedStates.clear();
+    m_containsInterfaces = false;
+    m_convertedStateValue = QVariant();
+
+    if (m_stateDescriptor.isValid()) {
+        if (m_stateDescriptor.type() == StateDescriptor::TypeThing) {
+            m_containedStates.insert(qMakePair<QUuid, QUuid>(m_stateDescriptor.thingId(), m_stateDescriptor.stateTypeId()));
+            Thing *thing = NymeaCore::instance()->thingManager()->findConfiguredThing(m_stateDescriptor.thingId());
+            if (thing && !m_stateDescriptor.stateValue().isNull()) {
+                QVariant convertedValue = m_stateDescriptor.stateValue();
+                if (convertedValue.convert(thing->state(m_stateDescriptor.stateTypeId()).value().type())) {
+                    m_convertedStateValue = convertedValue;
+                }
+            }
+        } else {
+            m_containsInterfaces = true;
+        }
+        if (!m_stateDescriptor.valueThingId().isNull() && !m_stateDescriptor.valueStateTypeId().isNull()) {
+            m_containedStates.insert(qMakePair<QUuid, QUuid>(m_stateDescriptor.valueThingId(), m_stateDescriptor.valueStateTypeId()));
+        }
+    }
+
+    for (int i = 0; i < m_childEvaluators.count(); i++) {
+        m_childEvaluators[i].compile();
+        m_containedStates.unite(m_childEvaluators.at(i).m_containedStates);
+        m_containsInterfaces |= m_childEvaluators.at(i).m_containsInterfaces;
+    }
+
+    m_descriptorResult = m_stateDescriptor.isValid() ? evaluateCompiledDescriptor() : true;
+    updateResult();
+    m_compiled = true;
+}
+
+bool StateEvaluator::evaluateStateChange(const Event &stateChangeEvent)
+{
+    if (!m_compiled) {
+        compile();
+        return m_result;
+    }
+
+    Thing *thing = nullptr;
+    if (m_containsInterfaces) {
+        thing = NymeaCore::instance()->thingManager()->findConfiguredThing(stateChangeEvent.thingId());
+    }
+    processStateChange(qMakePair<QUuid, QUuid>(stateChangeEvent.thingId(), stateChangeEvent.eventTypeId()), thing);
+    return m_result;
+}
+
+bool StateEvaluator::result() const
+{
+    return m_result;
+}
+
 bool StateEvaluator::containsThing(const ThingId &thingId) const
 {
     if (m_stateDescriptor.thingId() == thingId || m_stateDescriptor.valueThingId() == thingId)
@@ -144,6 +203,7 @@ void StateEvaluator::removeThing(const ThingId &thingId)
     for (int i = 0; i < m_childEvaluators.count(); i++) {
         m_childEvaluators[i].removeThing(thingId);
     }
+    m_compiled = false;
 }
 
 QList<ThingId> StateEvaluator::containedThings() const
@@ -339,7 +399,7 @@ bool StateEvaluator::isEmpty() const
     return !m_stateDescriptor.isValid() && m_childEvaluators.isEmpty();
 }
 
-bool StateEvaluator::evaluateDescriptor(const StateDescriptor &descriptor) const
+bool StateEvaluator::evaluateDescriptor(const StateDescriptor &descriptor, const QVariant &convertedValue) const
 {
     if (descriptor.type() == StateDescriptor::TypeThing) {
         qCDebug(dcRuleEngineDebug()) << "Evaluating thing based state descriptor";
@@ -356,24 +416,28 @@ bool StateEvaluator::evaluateDescriptor(const StateDescriptor &descriptor) const
         }
 
         if (!descriptor.stateValue().isNull()) {
-            QVariant convertedValue = descriptor.stateValue();
-            bool res = convertedValue.convert(state.value().type());
-            if (!res) {
-                return false;
+            // Use the pre-converted value if given and still matching the state type
+            QVariant value = convertedValue;
+            if (!value.isValid() || value.type() != state.value().type()) {
+                value = descriptor.stateValue();
+                bool res = value.convert(state.value().type());
+                if (!res) {
+                    return false;
+                }
             }
             switch (descriptor.operatorType()) {
             case Types::ValueOperatorEquals:
-                return state.value() == convertedValue;
+                return state.value() == value;
             case Types::ValueOperatorGreater:
-                return state.value() > convertedValue;
+                return state.value() > value;
             case Types::ValueOperatorGreaterOrEqual:
-                return state.value() >= convertedValue;
+                return state.value() >= value;
             case Types::ValueOperatorLess:
-                return state.value() < convertedValue;
+                return state.value() < value;
             case Types::ValueOperatorLessOrEqual:
-                return state.value() <= convertedValue;
+                return state.value() <= value;
             case Types::ValueOperatorNotEquals:
-                return state.value() != convertedValue;
+                return state.value() != value;
             }
 
         } else if (!descriptor.valueThingId().isNull() && !descriptor.valueStateTypeId().isNull()) {
@@ -410,14 +474,7 @@ bool StateEvaluator::evaluateDescriptor(const StateDescriptor &descriptor) const
 
         foreach (Thing* thing, NymeaCore::instance()->thingManager()->configuredThings()) {
             if (thing->thingClass().interfaces().contains(descriptor.interface())) {
-                qCDebug(dcRuleEngineDebug()) << "Thing" << thing->name() << "has matching interface";
-                StateType stateType = thing->thingClass().stateTypes().findByName(descriptor.interfaceState());
-                State state = thing->state(stateType.id());
-                // Generate a thing based state descriptor and run again
-                StateDescriptor temporaryDescriptor(stateType.id(), thing->id(), descriptor.stateValue(), descriptor.operatorType());
-                temporaryDescriptor.setValueThingId(descriptor.valueThingId());
-                temporaryDescriptor.setValueStateTypeId(descriptor.valueStateTypeId());
-                if (evaluateDescriptor(temporaryDescriptor)) {
+                if (evaluateInterfaceThing(descriptor, thing)) {
                     return true;
                 }
             }
@@ -427,6 +484,105 @@ bool StateEvaluator::evaluateDescriptor(const StateDescriptor &descriptor) const
     return false;
 }
 
+bool StateEvaluator::evaluateInterfaceThing(const StateDescriptor &descriptor, Thing *thing) const
+{
+    qCDebug(dcRuleEngineDebug()) << "Thing" << thing->name() << "has matching interface";
+    StateType stateType = thing->thingClass().stateTypes().findByName(descriptor.interfaceState());
+    // Generate a thing based state descriptor and run again
+    StateDescriptor temporaryDescriptor(stateType.id(), thing->id(), descriptor.stateValue(), descriptor.operatorType());
+    temporaryDescriptor.setValueThingId(descriptor.valueThingId());
+    temporaryDescriptor.setValueStateTypeId(descriptor.valueStateTypeId());
+    return evaluateDescriptor(temporaryDescriptor);
+}
+
+bool StateEvaluator::evaluateCompiledDescriptor()
+{
+    if (m_stateDescriptor.type() == StateDescriptor::TypeThing) {
+        return evaluateDescriptor(m_stateDescriptor, m_convertedStateValue);
+    }
+
+    // Cache the result for each thing implementing the interface
+    m_interfaceResults.clear();
+    foreach (Thing* thing, NymeaCore::instance()->thingManager()->findConfiguredThings(m_stateDescriptor.interface())) {
+        m_interfaceResults.insert(thing->id(), evaluateInterfaceThing(m_stateDescriptor, thing));
+    }
+    return interfaceResult();
+}
+
+bool StateEvaluator::interfaceResult() const
+{
+    for (auto it = m_interfaceResults.constBegin(); it != m_interfaceResults.constEnd(); ++it) {
+        // Things might have been removed in the meantime
+        if (it.value() && NymeaCore::instance()->thingManager()->findConfiguredThing(it.key())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void StateEvaluator::updateInterfaceThings()
+{
+    // Things implementing the interface might have been added or removed since the results have been cached
+    QHash<ThingId, bool> interfaceResults;
+    foreach (Thing* thing, NymeaCore::instance()->thingManager()->findConfiguredThings(m_stateDescriptor.interface())) {
+        if (m_interfaceResults.contains(thing->id())) {
+            interfaceResults.insert(thing->id(), m_interfaceResults.value(thing->id()));
+        } else {
+            interfaceResults.insert(thing->id(), evaluateInterfaceThing(m_stateDescriptor, thing));
+        }
+    }
+    m_interfaceResults = interfaceResults;
+}
+
+void StateEvaluator::processStateChange(const QPair<QUuid, QUuid> &state, Thing *thing)
+{
+    if (!m_containedStates.contains(state) && !(m_containsInterfaces && thing)) {
+        // Nothing in this subtree depends on the changed state
+        return;
+    }
+
+    if (m_stateDescriptor.isValid()) {
+        bool valueStateChanged = !m_stateDescriptor.valueThingId().isNull()
+                && state == qMakePair<QUuid, QUuid>(m_stateDescriptor.valueThingId(), m_stateDescriptor.valueStateTypeId());
+        if (m_stateDescriptor.type() == StateDescriptor::TypeThing) {
+            if (valueStateChanged || state == qMakePair<QUuid, QUuid>(m_stateDescriptor.thingId(), m_stateDescriptor.stateTypeId())) {
+                m_descriptorResult = evaluateDescriptor(m_stateDescriptor, m_convertedStateValue);
+            }
+        } else if (valueStateChanged) {
+            // All things implementing the interface are compared to the changed value
+            m_descriptorResult = evaluateCompiledDescriptor();
+        } else {
+            updateInterfaceThings();
+            if (thing && m_interfaceResults.contains(thing->id())) {
+                m_interfaceResults.insert(thing->id(), evaluateInterfaceThing(m_stateDescriptor, thing));
+            }
+            m_descriptorResult = interfaceResult();
+        }
+    }
+
+    for (int i = 0; i < m_childEvaluators.count(); i++) {
+        m_childEvaluators[i].processStateChange(state, thing);
+    }
+
+    updateResult();
+}
+
+void StateEvaluator::updateResult()
+{
+    if (m_operatorType == Types::StateOperatorOr) {
+        m_result = m_stateDescriptor.isValid() && m_descriptorResult;
+        for (int i = 0; !m_result && i < m_childEvaluators.count(); i++) {
+            m_result = m_childEvaluators.at(i).m_result;
+        }
+        return;
+    }
+
+    m_result = m_descriptorResult;
+    for (int i = 0; m_result && i < m_childEvaluators.count(); i++) {
+        m_result = m_childEvaluators.at(i).m_result;
+    }
+}
+
 QDebug operator<<(QDebug dbg, const StateEvaluator &stateEvaluator)
 {
     dbg.nospace() << "StateEvaluator: Operator:" << stateEvaluator.operatorType() << endl << "  " << stateEvaluator.stateDescriptor() << endl;
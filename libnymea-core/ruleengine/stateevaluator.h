@@ -35,8 +35,11 @@
 #include "types/statedescriptor.h"
 
 #include <QDebug>
+#include <QHash>
+#include <QSet>
 
 class NymeaSettings;
+class Thing;
 
 namespace nymeaserver {
 class StateEvaluator;
@@ -73,6 +76,11 @@ public:
     void setOperatorType(Types::StateOperator operatorType);
 
     bool evaluate() const;
+
+    void compile();
+    bool evaluateStateChange(const Event &stateChangeEvent);
+    bool result() const;
+
     bool containsThing(const ThingId &thingId) const;
 
     void removeThing(const ThingId &thingId);
@@ -85,13 +93,28 @@ public:
     bool isEmpty() const;
 
 private:
-    bool evaluateDescriptor(const StateDescriptor &descriptor) const;
+    bool evaluateDescriptor(const StateDescriptor &descriptor, const QVariant &convertedValue = QVariant()) const;
+    bool evaluateInterfaceThing(const StateDescriptor &descriptor, Thing *thing) const;
+    bool evaluateCompiledDescriptor();
+    bool interfaceResult() const;
+    void updateInterfaceThings();
+    void processStateChange(const QPair<QUuid, QUuid> &state, Thing *thing);
+    void updateResult();
 
 private:
     StateDescriptor m_stateDescriptor;
 
     QList<StateEvaluator> m_childEvaluators;
     Types::StateOperator m_operatorType;
+
+    // Compiled form, see compile()
+    bool m_compiled = false;
+    QVariant m_convertedStateValue;
+    QSet<QPair<QUuid, QUuid> > m_containedStates; // (thingId, stateTypeId) in this subtree
+    bool m_containsInterfaces = false;
+    QHash<ThingId, bool> m_interfaceResults;
+    bool m_descriptorResult = true;
+    bool m_result = false;
 };
 
 
@@ -92,6 +92,17 @@ void BluetoothServer::sendData(const QList<QUuid> &clients, const QByteArray &da
         sendData(client, data);
 }
 
+/*! Send the given binary \a data to the client with the given \a clientId, without line termination. */
+void BluetoothServer::sendBinaryData(const QUuid &clientId, const QByteArray &data)
+{
+    QBluetoothSocket *client = m_clientList.value(clientId);
+    if (!client)
+        return;
+
+    qCDebug(dcBluetoothServerTraffic()) << "Send binary data:" << data.toHex();
+    client->write(data);
+}
+
 void BluetoothServer::terminateClientConnection(const QUuid &clientId)
 {
     QBluetoothSocket *client = m_clientList.value(clientId);
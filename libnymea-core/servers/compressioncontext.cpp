@@ -0,0 +1,131 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "compressioncontext.h"
+
+#include <string.h>
+
+namespace nymeaserver {
+
+static const char deflateMessageTail[] = { '\x00', '\x00', '\xff', '\xff' };
+
+CompressionContext::CompressionContext(Format format):
+    m_format(format)
+{
+    int windowBits = format == FormatZlib ? MAX_WBITS : -MAX_WBITS;
+
+    memset(&m_deflateStream, 0, sizeof(m_deflateStream));
+    m_deflateValid = deflateInit2(&m_deflateStream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+
+    memset(&m_inflateStream, 0, sizeof(m_inflateStream));
+    m_inflateValid = inflateInit2(&m_inflateStream, windowBits) == Z_OK;
+}
+
+CompressionContext::~CompressionContext()
+{
+    if (m_deflateValid) {
+        deflateEnd(&m_deflateStream);
+    }
+    if (m_inflateValid) {
+        inflateEnd(&m_inflateStream);
+    }
+}
+
+bool CompressionContext::isValid() const
+{
+    return m_deflateValid && m_inflateValid;
+}
+
+QByteArray CompressionContext::compress(const QByteArray &data)
+{
+    QByteArray output;
+    if (!m_deflateValid) {
+        return output;
+    }
+    char buffer[16384];
+
+    m_deflateStream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.constData()));
+    m_deflateStream.avail_in = static_cast<uInt>(data.size());
+    do {
+        m_deflateStream.next_out = reinterpret_cast<Bytef*>(buffer);
+        m_deflateStream.avail_out = sizeof(buffer);
+        if (deflate(&m_deflateStream, Z_SYNC_FLUSH) == Z_STREAM_ERROR) {
+            return QByteArray();
+        }
+        output.append(buffer, static_cast<int>(sizeof(buffer) - m_deflateStream.avail_out));
+    } while (m_deflateStream.avail_out == 0);
+
+    if (m_format == FormatDeflateMessage && output.endsWith(QByteArray::fromRawData(deflateMessageTail, sizeof(deflateMessageTail)))) {
+        output.chop(sizeof(deflateMessageTail));
+    }
+    return output;
+}
+
+bool CompressionContext::decompress(const QByteArray &data, QByteArray *output)
+{
+    if (!m_inflateValid) {
+        return false;
+    }
+
+    QByteArray input = data;
+    if (m_format == FormatDeflateMessage) {
+        input.append(deflateMessageTail, sizeof(deflateMessageTail));
+    }
+
+    const int initialSize = output->size();
+    char buffer[16384];
+    m_inflateStream.next_in = reinterpret_cast<Bytef*>(input.data());
+    m_inflateStream.avail_in = static_cast<uInt>(input.size());
+    do {
+        m_inflateStream.next_out = reinterpret_cast<Bytef*>(buffer);
+        m_inflateStream.avail_out = sizeof(buffer);
+        int result = inflate(&m_inflateStream, Z_SYNC_FLUSH);
+        if (result == Z_NEED_DICT || result == Z_DATA_ERROR || result == Z_MEM_ERROR || result == Z_STREAM_ERROR) {
+            return false;
+        }
+        int inflated = static_cast<int>(sizeof(buffer) - m_inflateStream.avail_out);
+        if (output->size() + inflated - initialSize > maxDecompressedSize) {
+            // Refuse to inflate data growing beyond any valid message
+            return false;
+        }
+        output->append(buffer, inflated);
+        if (result == Z_STREAM_END) {
+            // The peer finished its stream. Anything following starts a new one.
+            inflateReset(&m_inflateStream);
+        } else if (result == Z_BUF_ERROR) {
+            // Need more input
+            break;
+        }
+    } while (m_inflateStream.avail_out == 0 || m_inflateStream.avail_in > 0);
+
+    return true;
+}
+
+}
@@ -0,0 +1,77 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef COMPRESSIONCONTEXT_H
+#define COMPRESSIONCONTEXT_H
+
+#include <QByteArray>
+
+#include <zlib.h>
+
+namespace nymeaserver {
+
+// Persistent deflate/inflate streams for one client connection. The compression state is kept across
+// messages, so repetitive payloads like notifications compress to a fraction of their size.
+class CompressionContext
+{
+public:
+    enum Format {
+        // A continuous zlib stream, flushed after each message
+        FormatZlib,
+        // Raw deflate data per message with the trailing sync flush marker removed (RFC 7692)
+        FormatDeflateMessage
+    };
+
+    // Data inflating to more than this is rejected. Matches the size limit for buffered JSON-RPC messages.
+    static const int maxDecompressedSize = 1024 * 1024;
+
+    explicit CompressionContext(Format format);
+    ~CompressionContext();
+
+    // False if zlib failed to set up the streams
+    bool isValid() const;
+
+    QByteArray compress(const QByteArray &data);
+    // Returns false on invalid data or if the data inflates to more than maxDecompressedSize
+    bool decompress(const QByteArray &data, QByteArray *output);
+
+private:
+    Q_DISABLE_COPY(CompressionContext)
+
+    Format m_format;
+    z_stream m_deflateStream;
+    z_stream m_inflateStream;
+    bool m_deflateValid = false;
+    bool m_inflateValid = false;
+};
+
+}
+
+#endif // COMPRESSIONCONTEXT_H
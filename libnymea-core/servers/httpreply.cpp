@@ -57,6 +57,8 @@
         The request has no content but it was expected.
     \value Found
         The resource was found.
+    \value NotModified
+        The resource did not change since the version the client has cached.
     \value PermanentRedirect
         The resource redirects permanent to given url.
     \value BadRequest
@@ -392,6 +394,9 @@ QByteArray HttpReply::getHttpReasonPhrase(const HttpReply::HttpStatusCode &statu
     case Found:
         response = QString("Found").toUtf8();
         break;
+    case NotModified:
+        response = QString("Not Modified").toUtf8();
+        break;
     case PermanentRedirect:
         response = QString("Permanent Redirect").toUtf8();
         break;
@@ -52,6 +52,7 @@ public:
         Accepted                = 202,
         NoContent               = 204,
         Found                   = 302,
+        NotModified             = 304,
         PermanentRedirect       = 308,
         BadRequest              = 400,
         Forbidden               = 403,
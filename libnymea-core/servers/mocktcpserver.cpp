@@ -66,7 +66,7 @@ void MockTcpServer::sendData(const QUuid &clientId, const QByteArray &data)
 void MockTcpServer::sendData(const QList<QUuid> &clients, const QByteArray &data)
 {
     foreach (const QUuid &clientId, clients) {
-        sendData(clientId, data + '\n');
+        sendData(clientId, data);
     }
 }
 
@@ -37,6 +37,7 @@
 
 #include <mqtt.h>
 #include "nymeaconfiguration.h"
+#include "mqtttopictrie.h"
 
 class MqttServer;
 
@@ -83,11 +84,17 @@ signals:
     void policyRemoved(const MqttPolicy &policy);
 
 private:
+    // The topic filters of a policy, compiled for the authorizer whenever the policy changes
+    struct CompiledPolicy {
+        MqttTopicTrie subscribeFilters;
+        MqttTopicTrie publishFilters;
+    };
+
     MqttServer* m_server = nullptr;
     NymeaMqttAuthorizer *m_authorizer = nullptr;
     QHash<int, ServerConfiguration> m_configs;
     QHash<QString, MqttPolicy> m_policies;
-
+    QHash<QString, CompiledPolicy> m_compiledPolicies;
 
     friend class NymeaMqttAuthorizer;
 };
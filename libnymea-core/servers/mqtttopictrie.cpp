@@ -0,0 +1,137 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "mqtttopictrie.h"
+
+namespace nymeaserver {
+
+MqttTopicTrie::MqttTopicTrie()
+{
+    // The root node
+    m_nodes.append(Node());
+}
+
+MqttTopicTrie::MqttTopicTrie(const QStringList &topicFilters):
+    MqttTopicTrie()
+{
+    foreach (const QString &topicFilter, topicFilters) {
+        addTopicFilter(topicFilter);
+    }
+}
+
+void MqttTopicTrie::addTopicFilter(const QString &topicFilter)
+{
+    int nodeIndex = 0;
+    foreach (const QString &level, topicFilter.split('/')) {
+        nodeIndex = child(nodeIndex, level);
+    }
+    m_nodes[nodeIndex].terminal = true;
+    if (topicFilter.endsWith('#')) {
+        m_nodes[nodeIndex].prefix = true;
+    }
+}
+
+bool MqttTopicTrie::isEmpty() const
+{
+    return m_nodes.count() == 1;
+}
+
+bool MqttTopicTrie::matches(const QString &topic) const
+{
+    if (isEmpty()) {
+        return false;
+    }
+    return matches(0, topic, 0);
+}
+
+int MqttTopicTrie::child(int nodeIndex, const QString &level)
+{
+    int childIndex = -1;
+    if (level == QStringLiteral("+")) {
+        childIndex = m_nodes.at(nodeIndex).singleLevelWildcard;
+    } else if (level == QStringLiteral("#")) {
+        childIndex = m_nodes.at(nodeIndex).multiLevelWildcard;
+    } else {
+        childIndex = m_nodes.at(nodeIndex).children.value(level, -1);
+    }
+    if (childIndex >= 0) {
+        return childIndex;
+    }
+
+    // Note: appending may reallocate m_nodes, don't hold references to nodes across this
+    childIndex = m_nodes.count();
+    m_nodes.append(Node());
+    if (level == QStringLiteral("+")) {
+        m_nodes[nodeIndex].singleLevelWildcard = childIndex;
+    } else if (level == QStringLiteral("#")) {
+        m_nodes[nodeIndex].multiLevelWildcard = childIndex;
+    } else {
+        m_nodes[nodeIndex].children.insert(level, childIndex);
+    }
+    return childIndex;
+}
+
+// position is the start of the next topic level in topic, or -1 if all levels have been consumed
+bool MqttTopicTrie::matches(int nodeIndex, const QString &topic, int position) const
+{
+    const Node &node = m_nodes.at(nodeIndex);
+    if (node.prefix) {
+        return true;
+    }
+
+    if (position < 0) {
+        // "a/#" also allows its parent level "a"
+        return node.terminal || (node.multiLevelWildcard >= 0 && m_nodes.at(node.multiLevelWildcard).terminal);
+    }
+
+    int end = topic.indexOf('/', position);
+    QStringRef level = end < 0 ? topic.midRef(position) : topic.midRef(position, end - position);
+    int next = end < 0 ? -1 : end + 1;
+
+    // A requested filter ending with '#' covers any number of levels. Only a '#' in the filters may grant it.
+    if (level == QLatin1String("#")) {
+        return node.multiLevelWildcard >= 0 && matches(node.multiLevelWildcard, topic, next);
+    }
+
+    int childIndex = node.children.value(level.toString(), -1);
+    if (childIndex >= 0 && matches(childIndex, topic, next)) {
+        return true;
+    }
+    if (node.singleLevelWildcard >= 0 && matches(node.singleLevelWildcard, topic, next)) {
+        return true;
+    }
+    // A '#' which is not the last level only covers a single level
+    if (node.multiLevelWildcard >= 0 && matches(node.multiLevelWildcard, topic, next)) {
+        return true;
+    }
+    return false;
+}
+
+}
@@ -96,6 +96,7 @@ TcpServer::~TcpServer()
 {
     qCDebug(dcTcpServer()) << "Shutting down \"TCP Server\"" << serverUrl().toString();
     stopServer();
+    qDeleteAll(m_compressionContexts);
 }
 
 /*! Returns the URL of this server. */
@@ -127,12 +128,57 @@ void TcpServer::sendData(const QUuid &clientId, const QByteArray &data)
     client = m_clientList.value(clientId);
     if (client) {
         qCDebug(dcTcpServerTraffic()) << "Sending to client" << clientId.toString() << data;
-        client->write(data + '\n');
+        if (m_compressionContexts.contains(clientId)) {
+            client->write(m_compressionContexts.value(clientId)->compress(data + '\n'));
+        } else {
+            client->write(data + '\n');
+        }
+    } else {
+        qCWarning(dcTcpServer()) << "Client" << clientId.toString() << "unknown to this transport";
+    }
+}
+
+/*! Sending binary \a data to the client with the given \a clientId. The data is written as is, without line termination.*/
+void TcpServer::sendBinaryData(const QUuid &clientId, const QByteArray &data)
+{
+    QTcpSocket *client = m_clientList.value(clientId);
+    if (client) {
+        qCDebug(dcTcpServerTraffic()) << "Sending binary data to client" << clientId.toString() << data.toHex();
+        if (m_compressionContexts.contains(clientId)) {
+            client->write(m_compressionContexts.value(clientId)->compress(data));
+        } else {
+            client->write(data);
+        }
     } else {
         qCWarning(dcTcpServer()) << "Client" << clientId.toString() << "unknown to this transport";
     }
 }
 
+/*! Returns true if compression is enabled in the configuration of this server. */
+bool TcpServer::compressionSupported() const
+{
+    return configuration().compressionEnabled;
+}
+
+/*! Enables compression for the client with the given \a clientId. From now on, all data in both directions is
+    a zlib stream, flushed after each message. */
+void TcpServer::enableCompression(const QUuid &clientId)
+{
+    if (!m_clientList.contains(clientId) || m_compressionContexts.contains(clientId)) {
+        return;
+    }
+    qCDebug(dcTcpServer()) << "Enabling compression for client" << clientId.toString();
+    CompressionContext *context = new CompressionContext(CompressionContext::FormatZlib);
+    if (!context->isValid()) {
+        // The client has been told to use compression already, there is no way to talk to it any more
+        qCWarning(dcTcpServer()) << "Failed to set up compression for client" << clientId.toString() << ". Closing connection.";
+        delete context;
+        terminateClientConnection(clientId);
+        return;
+    }
+    m_compressionContexts.insert(clientId, context);
+}
+
 void TcpServer::onClientConnected(QSslSocket *socket)
 {
     QUuid clientId = QUuid::createUuid();
@@ -146,6 +192,7 @@ void TcpServer::onClientDisconnected(QSslSocket *socket)
     QUuid clientId = m_clientList.key(socket);
     qCDebug(dcTcpServer()) << "Client disconnected:" << clientId.toString() << "(Remote address:" << socket->peerAddress().toString() << ")";
     m_clientList.take(clientId);
+    delete m_compressionContexts.take(clientId);
     emit clientDisconnected(clientId);
 }
 
@@ -160,6 +207,18 @@ void TcpServer::onDataAvailable(QSslSocket * socket, const QByteArray &data)
 {
     qCDebug(dcTcpServerTraffic()) << "Emitting data available";
     QUuid clientId = m_clientList.key(socket);
+    if (m_compressionContexts.contains(clientId)) {
+        QByteArray decompressed;
+        if (!m_compressionContexts.value(clientId)->decompress(data, &decompressed)) {
+            qCWarning(dcTcpServer()) << "Failed to decompress data from client" << clientId.toString() << ". Closing connection.";
+            socket->close();
+            return;
+        }
+        if (!decompressed.isEmpty()) {
+            emit dataAvailable(clientId, decompressed);
+        }
+        return;
+    }
     emit dataAvailable(clientId, data);
 }
 
@@ -41,6 +41,7 @@
 #include <QDebug>
 
 #include "transportinterface.h"
+#include "compressioncontext.h"
 
 #include "loggingcategories.h"
 
@@ -86,6 +87,10 @@ public:
 
     void sendData(const QUuid &clientId, const QByteArray &data) override;
     void sendData(const QList<QUuid> &clients, const QByteArray &data) override;
+    void sendBinaryData(const QUuid &clientId, const QByteArray &data) override;
+
+    bool compressionSupported() const override;
+    void enableCompression(const QUuid &clientId) override;
 
     void terminateClientConnection(const QUuid &clientId) override;
 
@@ -94,6 +99,7 @@ private:
 
     SslServer *m_server = nullptr;
     QHash<QUuid, QTcpSocket *> m_clientList;
+    QHash<QUuid, CompressionContext *> m_compressionContexts;
 
     QSslConfiguration m_sslConfig;
 
@@ -100,9 +100,101 @@
 #include <QUuid>
 #include <QUrl>
 #include <QFile>
+#include <QLocale>
+#include <QCryptographicHash>
 
 namespace nymeaserver {
 
+// Upper limit for the static files and icons kept in memory (bytes)
+static const int s_responseCacheSize = 32 * 1024 * 1024;
+
+static QByteArray contentTypeForSuffix(const QString &suffix)
+{
+    static const QHash<QString, QByteArray> contentTypes = {
+        {"html", "text/html; charset=\"utf-8\";"},
+        {"css", "text/css; charset=\"utf-8\";"},
+        {"pdf", "application/pdf"},
+        {"js", "text/javascript; charset=\"utf-8\";"},
+        {"ttf", "application/x-font-ttf"},
+        {"eot", "application/vnd.ms-fontobject"},
+        {"woff", "application/x-font-woff"},
+        {"jpg", "image/jpeg"},
+        {"jpeg", "image/jpeg"},
+        {"png", "image/png"},
+        {"ico", "image/x-icon"},
+        {"svg", "image/svg+xml; charset=\"utf-8\";"}
+    };
+    return contentTypes.value(suffix.toLower());
+}
+
+static QByteArray createEtag(const QByteArray &data)
+{
+    return '"' + QCryptographicHash::hash(data, QCryptographicHash::Md5).toHex() + '"';
+}
+
+static QByteArray httpDate(const QDateTime &dateTime)
+{
+    return QLocale::c().toString(dateTime.toUTC(), "ddd, dd MMM yyyy hh:mm:ss 'GMT'").toLatin1();
+}
+
+static QByteArray requestHeader(const HttpRequest &request, const QByteArray &name)
+{
+    // Header field names are case-insensitive (RFC 7230 3.2)
+    QHash<QByteArray, QByteArray> headers = request.rawHeaderList();
+    foreach (const QByteArray &key, headers.keys()) {
+        if (key.toLower() == name)
+            return headers.value(key);
+    }
+    return QByteArray();
+}
+
+static bool acceptsGzip(const HttpRequest &request)
+{
+    foreach (const QByteArray &coding, requestHeader(request, "accept-encoding").split(',')) {
+        QList<QByteArray> parameters = coding.split(';');
+        if (parameters.first().trimmed().toLower() != "gzip")
+            continue;
+
+        // "gzip;q=0" explicitly refuses the encoding
+        for (int i = 1; i < parameters.count(); i++) {
+            QByteArray parameter = parameters.at(i).trimmed();
+            if (parameter.startsWith("q=") && parameter.mid(2).toDouble() <= 0)
+                return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+static bool isNotModified(const HttpRequest &request, const QByteArray &etag, const QDateTime &lastModified)
+{
+    // If-None-Match takes precedence over If-Modified-Since (RFC 7232 3.3) and uses the weak comparison
+    QByteArray ifNoneMatch = requestHeader(request, "if-none-match");
+    if (!ifNoneMatch.isEmpty()) {
+        foreach (QByteArray tag, ifNoneMatch.split(',')) {
+            tag = tag.trimmed();
+            if (tag.startsWith("W/"))
+                tag.remove(0, 2);
+
+            if (tag == "*" || tag == etag)
+                return true;
+        }
+        return false;
+    }
+
+    QByteArray ifModifiedSince = requestHeader(request, "if-modified-since");
+    if (ifModifiedSince.isEmpty() || !lastModified.isValid())
+        return false;
+
+    QDateTime since = QLocale::c().toDateTime(QString::fromLatin1(ifModifiedSince), "ddd, dd MMM yyyy hh:mm:ss 'GMT'");
+    if (!since.isValid())
+        return false;
+
+    // HTTP dates have a resolution of one second
+    since.setTimeSpec(Qt::UTC);
+    return lastModified.toMSecsSinceEpoch() / 1000 <= since.toMSecsSinceEpoch() / 1000;
+}
+
 /*! Constructs a \l{WebServer} with the given \a configuration, \a sslConfiguration and \a parent.
  *
  *  \sa ServerManager, WebServerConfiguration
@@ -110,7 +202,8 @@ namespace nymeaserver {
 WebServer::WebServer(const WebServerConfiguration &configuration, const QSslConfiguration &sslConfiguration, QObject *parent) :
     QTcpServer(parent),
     m_configuration(configuration),
-    m_sslConfiguration(sslConfiguration)
+    m_sslConfiguration(sslConfiguration),
+    m_responseCache(s_responseCacheSize)
 {
     if (QCoreApplication::instance()->organizationName() == "nymea-test") {
         m_configuration.publicFolder = QCoreApplication::applicationDirPath();
@@ -202,26 +295,126 @@ QString WebServer::fileName(const QString &query)
     return m_configuration.publicFolder + "/" + fileName;
 }
 
-HttpReply *WebServer::processIconRequest(const QString &fileName)
+HttpReply *WebServer::processFileRequest(const HttpRequest &request, const QString &fileName)
 {
+    QFileInfo fileInfo(fileName);
+    QString cacheKey = fileInfo.canonicalFilePath();
+
+    // A pre-compressed variant next to the file will be sent to clients accepting gzip, unless it is older than the file
+    QFileInfo gzipFileInfo(fileName + ".gz");
+    QDateTime gzipLastModified;
+    qint64 gzipSize = -1;
+    if (gzipFileInfo.isFile() && gzipFileInfo.isReadable() && gzipFileInfo.canonicalFilePath().startsWith(QDir(m_configuration.publicFolder).canonicalPath())) {
+        if (gzipFileInfo.lastModified() < fileInfo.lastModified()) {
+            qCDebug(dcWebServer()) << "Ignoring outdated file" << gzipFileInfo.filePath();
+        } else {
+            gzipLastModified = gzipFileInfo.lastModified();
+            gzipSize = gzipFileInfo.size();
+        }
+    }
+
+    // Reload the file if it has been changed on disk since it has been cached. The modification time may have a
+    // resolution of seconds only, so an entry loaded within that time after a change could miss a second change of
+    // the same size. Such entries are loaded again until their files have settled.
+    CachedResponse *cachedResponse = m_responseCache.object(cacheKey);
+    if (cachedResponse && cachedResponse->size == fileInfo.size() && cachedResponse->lastModified == fileInfo.lastModified()
+            && cachedResponse->gzipSize == gzipSize && cachedResponse->gzipLastModified == gzipLastModified
+            && cachedResponse->lastModified.msecsTo(cachedResponse->loadedAt) >= 2000
+            && (!gzipLastModified.isValid() || gzipLastModified.msecsTo(cachedResponse->loadedAt) >= 2000)) {
+        return createCachedReply(request, *cachedResponse);
+    }
+
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly)) {
+        qCWarning(dcWebServer()) << "Could not open file" << file.fileName() << file.errorString();
+        return nullptr;
+    }
+
+    qCDebug(dcWebServer()) << "Load file" << file.fileName();
+    CachedResponse response;
+    response.contentType = contentTypeForSuffix(fileInfo.suffix());
+    response.payload = file.readAll();
+    response.etag = createEtag(response.payload);
+    response.lastModified = fileInfo.lastModified();
+    response.loadedAt = QDateTime::currentDateTime();
+    response.size = fileInfo.size();
+
+    if (gzipSize >= 0) {
+        QFile gzipFile(gzipFileInfo.filePath());
+        if (gzipFile.open(QFile::ReadOnly)) {
+            qCDebug(dcWebServer()) << "Load file" << gzipFile.fileName();
+            response.gzipPayload = gzipFile.readAll();
+            response.gzipEtag = createEtag(response.gzipPayload);
+            response.gzipLastModified = gzipLastModified;
+            response.gzipSize = gzipSize;
+        }
+    }
+
+    // Note: files bigger than the whole cache will not be inserted and get loaded on each request
+    m_responseCache.insert(cacheKey, new CachedResponse(response), response.payload.size() + response.gzipPayload.size());
+    return createCachedReply(request, response);
+}
+
+HttpReply *WebServer::createCachedReply(const HttpRequest &request, const CachedResponse &response)
+{
+    bool gzip = !response.gzipPayload.isEmpty() && acceptsGzip(request);
+    QByteArray etag = gzip ? response.gzipEtag : response.etag;
+
+    HttpReply *reply = HttpReply::createSuccessReply();
+    if (!response.contentType.isEmpty())
+        reply->setHeader(HttpReply::ContentTypeHeader, response.contentType);
+
+    reply->setRawHeader("ETag", etag);
+    if (response.lastModified.isValid())
+        reply->setRawHeader("Last-Modified", httpDate(response.lastModified));
+
+    if (!response.gzipPayload.isEmpty())
+        reply->setRawHeader("Vary", "Accept-Encoding");
+
+    if (isNotModified(request, etag, response.lastModified)) {
+        reply->setHttpStatusCode(HttpReply::NotModified);
+        reply->setPayload(QByteArray());
+        return reply;
+    }
+
+    if (gzip) {
+        reply->setRawHeader("Content-Encoding", "gzip");
+        reply->setPayload(response.gzipPayload);
+    } else {
+        reply->setPayload(response.payload);
+    }
+    return reply;
+}
+
+HttpReply *WebServer::processIconRequest(const HttpRequest &request)
+{
+    QString fileName = request.url().path();
     if (!fileName.endsWith(".png"))
         return HttpReply::createErrorReply(HttpReply::NotFound);
 
+    // The icons are compiled into the resources, encode each of them only once
+    QString cacheKey = ":" + fileName;
+    CachedResponse *cachedResponse = m_responseCache.object(cacheKey);
+    if (cachedResponse)
+        return createCachedReply(request, *cachedResponse);
+
     QByteArray imageData;
 
-    QImage image(":" + fileName);
+    QImage image(cacheKey);
     QBuffer buffer(&imageData);
     buffer.open(QIODevice::WriteOnly);
     image.save(&buffer, "png");
 
-    if (!imageData.isEmpty()) {
-        HttpReply *reply = HttpReply::createSuccessReply();
-        reply->setHeader(HttpReply::ContentTypeHeader, "image/png");
-        reply->setPayload(imageData);
-        return reply;
-    }
+    if (imageData.isEmpty())
+        return HttpReply::createErrorReply(HttpReply::NotFound);
 
-    return HttpReply::createErrorReply(HttpReply::NotFound);
+    CachedResponse response;
+    response.contentType = "image/png";
+    response.payload = imageData;
+    response.etag = createEtag(imageData);
+    response.size = imageData.size();
+    m_responseCache.insert(cacheKey, new CachedResponse(response), imageData.size());
+    return createCachedReply(request, response);
 }
 
 void WebServer::incomingConnection(qintptr socketDescriptor)
@@ -357,7 +550,7 @@ void WebServer::readClient()
 
     // Check icon call
     if (request.url().path().startsWith("/icons/") && request.method() == HttpRequest::Get) {
-        HttpReply *reply = processIconRequest(request.url().path());
+        HttpReply *reply = processIconRequest(request);
         reply->setClientId(clientId);
         sendHttpReply(reply);
         reply->deleteLater();
@@ -431,37 +624,8 @@ void WebServer::readClient()
         if (!verifyFile(socket, path))
             return;
 
-        QFile file(path);
-        if (file.open(QFile::ReadOnly)) {
-            qCDebug(dcWebServer()) << "Load file" << file.fileName();
-            HttpReply *reply = HttpReply::createSuccessReply();
-
-            // Check content type
-            if (file.fileName().endsWith(".html")) {
-                reply->setHeader(HttpReply::ContentTypeHeader, "text/html; charset=\"utf-8\";");
-            } else if (file.fileName().endsWith(".css")) {
-                reply->setHeader(HttpReply::ContentTypeHeader, "text/css; charset=\"utf-8\";");
-            } else if (file.fileName().endsWith(".pdf")) {
-                reply->setHeader(HttpReply::ContentTypeHeader, "application/pdf");
-            } else if (file.fileName().endsWith(".js")) {
-                reply->setHeader(HttpReply::ContentTypeHeader, "text/javascript; charset=\"utf-8\";");
-            } else if (file.fileName().endsWith(".ttf")) {
-                reply->setHeader(HttpReply::ContentTypeHeader, "application/x-font-ttf");
-            } else if (file.fileName().endsWith(".eot")) {
-                reply->setHeader(HttpReply::ContentTypeHeader, "application/vnd.ms-fontobject");
-            } else if (file.fileName().endsWith(".woff")) {
-                reply->setHeader(HttpReply::ContentTypeHeader, "application/x-font-woff");
-            } else if (file.fileName().endsWith(".jpg") || file.fileName().endsWith(".jpeg")) {
-                reply->setHeader(HttpReply::ContentTypeHeader, "image/jpeg");
-            } else if (file.fileName().endsWith(".png") || file.fileName().endsWith(".PNG")) {
-                reply->setHeader(HttpReply::ContentTypeHeader, "image/png");
-            } else if (file.fileName().endsWith(".ico")) {
-                reply->setHeader(HttpReply::ContentTypeHeader, "image/x-icon");
-            } else if (file.fileName().endsWith(".svg")) {
-                reply->setHeader(HttpReply::ContentTypeHeader, "image/svg+xml; charset=\"utf-8\";");
-            }
-
-            reply->setPayload(file.readAll());
+        HttpReply *reply = processFileRequest(request, path);
+        if (reply) {
             reply->setClientId(clientId);
             sendHttpReply(reply);
             reply->deleteLater();
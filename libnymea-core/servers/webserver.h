@@ -35,6 +35,8 @@
 #include <QTcpServer>
 #include <QTcpSocket>
 #include <QHash>
+#include <QCache>
+#include <QDateTime>
 #include <QDir>
 #include <QTimer>
 #include <QImage>
@@ -100,11 +102,29 @@ private:
 
     bool m_enabled = false;
 
+    // A static file or icon, ready to be sent without touching the disk or the image codecs again
+    struct CachedResponse {
+        QByteArray contentType;
+        QByteArray payload;
+        QByteArray etag;
+        QByteArray gzipPayload;
+        QByteArray gzipEtag;
+        QDateTime lastModified;
+        QDateTime gzipLastModified;
+        QDateTime loadedAt;
+        qint64 size = -1;
+        qint64 gzipSize = -1;
+    };
+    QCache<QString, CachedResponse> m_responseCache;
+
     bool verifyFile(QSslSocket *socket, const QString &fileName);
     QString fileName(const QString &query);
 
+    HttpReply *processFileRequest(const HttpRequest &request, const QString &fileName);
+    HttpReply *createCachedReply(const HttpRequest &request, const CachedResponse &response);
+
     QByteArray createServerXmlDocument(QHostAddress address);
-    HttpReply *processIconRequest(const QString &fileName);
+    HttpReply *processIconRequest(const HttpRequest &request);
     HttpReply *processDebugRequest(const QString &requestPath);
 
 protected:
@@ -82,6 +82,7 @@ WebSocketServer::~WebSocketServer()
 {
     qCDebug(dcWebSocketServer()) << "Shutting down \"Websocket server\"" << serverUrl().toString();
     stopServer();
+    qDeleteAll(m_compressionContexts);
 }
 
 /*! Returns the url of this server. */
@@ -100,7 +101,11 @@ void WebSocketServer::sendData(const QUuid &clientId, const QByteArray &data)
     client = m_clientList.value(clientId);
     if (client) {
         qCDebug(dcWebSocketServerTraffic()) << "Sending data to client" << data;
-        client->sendTextMessage(data + '\n');
+        if (m_compressionContexts.contains(clientId)) {
+            client->sendBinaryMessage(m_compressionContexts.value(clientId)->compress(data + '\n'));
+        } else {
+            client->sendTextMessage(data + '\n');
+        }
     } else {
         qCWarning(dcWebSocketServer()) << "Client" << clientId << "unknown to this transport";
     }
@@ -117,6 +122,51 @@ void WebSocketServer::sendData(const QList<QUuid> &clients, const QByteArray &da
     }
 }
 
+/*! Send the given binary \a data to the client with the given \a clientId as a binary message.
+ *
+ * \sa TransportInterface::sendBinaryData()
+ */
+void WebSocketServer::sendBinaryData(const QUuid &clientId, const QByteArray &data)
+{
+    QWebSocket *client = m_clientList.value(clientId);
+    if (client) {
+        qCDebug(dcWebSocketServerTraffic()) << "Sending binary data to client" << data.toHex();
+        if (m_compressionContexts.contains(clientId)) {
+            client->sendBinaryMessage(m_compressionContexts.value(clientId)->compress(data));
+        } else {
+            client->sendBinaryMessage(data);
+        }
+    } else {
+        qCWarning(dcWebSocketServer()) << "Client" << clientId << "unknown to this transport";
+    }
+}
+
+/*! Returns true if compression is enabled in the configuration of this server. */
+bool WebSocketServer::compressionSupported() const
+{
+    return configuration().compressionEnabled;
+}
+
+/*! Enables compression for the client with the given \a clientId. From now on, all messages in both directions
+ * are binary messages, deflated with a persistent context as described for permessage-deflate in RFC 7692.
+ */
+void WebSocketServer::enableCompression(const QUuid &clientId)
+{
+    if (!m_clientList.contains(clientId) || m_compressionContexts.contains(clientId)) {
+        return;
+    }
+    qCDebug(dcWebSocketServer()) << "Enabling compression for client" << clientId.toString();
+    CompressionContext *context = new CompressionContext(CompressionContext::FormatDeflateMessage);
+    if (!context->isValid()) {
+        // The client has been told to use compression already, there is no way to talk to it any more
+        qCWarning(dcWebSocketServer()) << "Failed to set up compression for client" << clientId.toString() << ". Closing connection.";
+        delete context;
+        terminateClientConnection(clientId);
+        return;
+    }
+    m_compressionContexts.insert(clientId, context);
+}
+
 void WebSocketServer::terminateClientConnection(const QUuid &clientId)
 {
     QWebSocket *client = m_clientList.value(clientId);
@@ -160,6 +210,7 @@ void WebSocketServer::onClientDisconnected()
     QUuid clientId = m_clientList.key(client);
     qCDebug(dcWebSocketServer()) << "Client" << clientId.toString() << "disconnected. (Remote address:" << client->peerAddress().toString() << ")" ;
     m_clientList.take(clientId)->deleteLater();
+    delete m_compressionContexts.take(clientId);
     emit clientDisconnected(clientId);
 }
 
@@ -167,7 +218,18 @@ void WebSocketServer::onBinaryMessageReceived(const QByteArray &data)
 {
     QWebSocket *client = qobject_cast<QWebSocket *>(sender());
     QUuid clientId = m_clientList.key(client);
-    qCDebug(dcWebSocketServerTraffic()) << "Binary message from" << clientId.toString() << ":" << data;
+    qCDebug(dcWebSocketServerTraffic()) << "Binary message from" << clientId.toString() << ":" << data.toHex();
+    if (m_compressionContexts.contains(clientId)) {
+        QByteArray decompressed;
+        if (!m_compressionContexts.value(clientId)->decompress(data, &decompressed)) {
+            qCWarning(dcWebSocketServer()) << "Failed to decompress message from client" << clientId.toString() << ". Closing connection.";
+            client->close(QWebSocketProtocol::CloseCodeBadOperation);
+            return;
+        }
+        emit dataAvailable(clientId, decompressed);
+        return;
+    }
+    emit dataAvailable(clientId, data);
 }
 
 void WebSocketServer::onTextMessageReceived(const QString &message)
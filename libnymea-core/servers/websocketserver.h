@@ -39,6 +39,7 @@
 #include <QWebSocketServer>
 
 #include "transportinterface.h"
+#include "compressioncontext.h"
 
 // Note: WebSocket Protocol from the Internet Engineering Task Force (IETF) -> RFC6455 V13:
 //       http://tools.ietf.org/html/rfc6455
@@ -58,12 +59,17 @@ public:
 
     void sendData(const QUuid &clientId, const QByteArray &data) override;
     void sendData(const QList<QUuid> &clients, const QByteArray &data) override;
+    void sendBinaryData(const QUuid &clientId, const QByteArray &data) override;
+
+    bool compressionSupported() const override;
+    void enableCompression(const QUuid &clientId) override;
 
     void terminateClientConnection(const QUuid &clientId) override;
 
 private:
     QWebSocketServer *m_server = nullptr;
     QHash<QUuid, QWebSocket *> m_clientList;
+    QHash<QUuid, CompressionContext *> m_compressionContexts;
     QSslConfiguration m_sslConfiguration;
     bool m_enabled;
 
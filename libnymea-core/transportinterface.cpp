@@ -100,6 +100,43 @@ TransportInterface::TransportInterface(const ServerConfiguration &config, QObjec
 {
 }
 
+/*! Send the binary \a data, i.e. a CBOR encoded message, to the client with the id \a clientId. Unlike
+    sendData(), the data must be sent as is, without any text based framing. The default implementation
+    calls sendData() and is suitable for transports which don't add any framing on their own.
+*/
+void TransportInterface::sendBinaryData(const QUuid &clientId, const QByteArray &data)
+{
+    sendData(clientId, data);
+}
+
+/*! Send the binary \a data to the given \a clients.
+
+    \sa sendBinaryData()
+*/
+void TransportInterface::sendBinaryData(const QList<QUuid> &clients, const QByteArray &data)
+{
+    foreach (const QUuid &clientId, clients) {
+        sendBinaryData(clientId, data);
+    }
+}
+
+/*! Returns true if this transport can compress the connection to its clients. The default implementation returns false.
+
+    \sa enableCompression()
+*/
+bool TransportInterface::compressionSupported() const
+{
+    return false;
+}
+
+/*! Enables compression for all further data exchanged with the client with the given \a clientId in both directions.
+    Only called if compressionSupported() returns true. The default implementation does nothing.
+*/
+void TransportInterface::enableCompression(const QUuid &clientId)
+{
+    Q_UNUSED(clientId)
+}
+
 /*! Set the ServerConfiguration of this TransportInterface to the given \a config. */
 void TransportInterface::setConfiguration(const ServerConfiguration &config)
 {
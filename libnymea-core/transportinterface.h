@@ -50,6 +50,12 @@ public:
     virtual void sendData(const QUuid &clientId, const QByteArray &data) = 0;
     virtual void sendData(const QList<QUuid> &clients, const QByteArray &data) = 0;
 
+    virtual void sendBinaryData(const QUuid &clientId, const QByteArray &data);
+    virtual void sendBinaryData(const QList<QUuid> &clients, const QByteArray &data);
+
+    virtual bool compressionSupported() const;
+    virtual void enableCompression(const QUuid &clientId);
+
     virtual void terminateClientConnection(const QUuid &clientId) = 0;
 
     void setConfiguration(const ServerConfiguration &config);
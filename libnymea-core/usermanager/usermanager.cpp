@@ -110,6 +110,8 @@ UserManager::UserManager(const QString &dbName, QObject *parent):
         }
     }
 
+    m_cacheValid = loadCache();
+
     m_pushButtonDBusService = new PushButtonDBusService("/io/guh/nymead/UserManager", this);
     connect(m_pushButtonDBusService, &PushButtonDBusService::pushButtonPressed, this, &UserManager::onPushButtonPressed);
     m_pushButtonTransaction = qMakePair<int, QString>(-1, QString());
@@ -121,27 +123,14 @@ UserManager::UserManager(const QString &dbName, QObject *parent):
  */
 bool UserManager::initRequired() const
 {
-    QString getTokensQuery = QString("SELECT id, username, creationdate, deviceName FROM tokens;");
-    QSqlQuery result = m_db.exec(getTokensQuery);
-    if (m_db.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcUserManager) << "Query for tokens failed:" << m_db.lastError().databaseText() << m_db.lastError().driverText() << getTokensQuery;
-        // Note: do not return true in case the database access fails.
-        return false;
-    }
-
-    return users().isEmpty() && !result.first();
+    // Note: do not return true in case the database access fails.
+    return m_cacheValid && m_users.isEmpty() && m_tokens.isEmpty();
 }
 
 /*! Returns the list of user names for this UserManager. */
 QStringList UserManager::users() const
 {
-    QString userQuery("SELECT username FROM users;");
-    QSqlQuery result = m_db.exec(userQuery);
-    QStringList ret;
-    while (result.next()) {
-        ret << result.value("username").toString();
-    }
-    return ret;
+    return m_users;
 }
 
 /*! Creates a new user with the given \a username and \a password. Returns the \l UserError to inform about the result. */
@@ -157,24 +146,24 @@ UserManager::UserError UserManager::createUser(const QString &username, const QS
         return UserErrorBadPassword;
     }
 
-    QString checkForDuplicateUserQuery = QString("SELECT * FROM users WHERE lower(username) = \"%1\";").arg(username.toLower());
-    QSqlQuery result = m_db.exec(checkForDuplicateUserQuery);
-    if (result.first()) {
+    if (m_users.contains(username.toLower())) {
         qCWarning(dcUserManager) << "Username already in use";
         return UserErrorDuplicateUserId;
     }
 
     QByteArray salt = QUuid::createUuid().toString().remove(QRegExp("[{}]")).toUtf8();
     QByteArray hashedPassword = QCryptographicHash::hash(QString(password + salt).toUtf8(), QCryptographicHash::Sha512).toBase64();
-    QString queryString = QString("INSERT INTO users(username, password, salt) values(\"%1\", \"%2\", \"%3\");")
-            .arg(username.toLower())
-            .arg(QString::fromUtf8(hashedPassword))
-            .arg(QString::fromUtf8(salt));
-    m_db.exec(queryString);
-    if (m_db.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcUserManager) << "Error creating user:" << m_db.lastError().databaseText() << m_db.lastError().driverText();
+    QSqlQuery query(m_db);
+    query.prepare("INSERT INTO users(username, password, salt) values(?, ?, ?);");
+    query.addBindValue(username.toLower());
+    query.addBindValue(QString::fromUtf8(hashedPassword));
+    query.addBindValue(QString::fromUtf8(salt));
+    query.exec();
+    if (query.lastError().type() != QSqlError::NoError) {
+        qCWarning(dcUserManager) << "Error creating user:" << query.lastError().databaseText() << query.lastError().driverText();
         return UserErrorBackendError;
     }
+    m_users.append(username.toLower());
     return UserErrorNoError;
 }
 
@@ -190,9 +179,7 @@ UserManager::UserError UserManager::changePassword(const QString &username, cons
         return UserErrorBadPassword;
     }
 
-    QString checkForUserExistingQuery = QString("SELECT * FROM users WHERE lower(username) = \"%1\";").arg(username.toLower());
-    QSqlQuery result = m_db.exec(checkForUserExistingQuery);
-    if (!result.first()) {
+    if (!m_users.contains(username.toLower())) {
         qCWarning(dcUserManager) << "Username does not exist.";
         return UserErrorInvalidUserId;
     }
@@ -200,13 +187,14 @@ UserManager::UserError UserManager::changePassword(const QString &username, cons
     // Update the password
     QByteArray salt = QUuid::createUuid().toString().remove(QRegExp("[{}]")).toUtf8();
     QByteArray hashedPassword = QCryptographicHash::hash(QString(newPassword + salt).toUtf8(), QCryptographicHash::Sha512).toBase64();
-    QString queryString = QString("UPDATE users SET password = \"%1\", salt = \"%2\" WHERE lower(username) = \"%3\";")
-            .arg(QString::fromUtf8(hashedPassword))
-            .arg(QString::fromUtf8(salt))
-            .arg(username.toLower());
-    m_db.exec(queryString);
-    if (m_db.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcUserManager) << "Error updating password for user:" << m_db.lastError().databaseText() << m_db.lastError().driverText();
+    QSqlQuery query(m_db);
+    query.prepare("UPDATE users SET password = ?, salt = ? WHERE lower(username) = ?;");
+    query.addBindValue(QString::fromUtf8(hashedPassword));
+    query.addBindValue(QString::fromUtf8(salt));
+    query.addBindValue(username.toLower());
+    query.exec();
+    if (query.lastError().type() != QSqlError::NoError) {
+        qCWarning(dcUserManager) << "Error updating password for user:" << query.lastError().databaseText() << query.lastError().driverText();
         return UserErrorBackendError;
     }
     qCDebug(dcUserManager()) << "Password updated for user" << username;
@@ -216,15 +204,26 @@ UserManager::UserError UserManager::changePassword(const QString &username, cons
 UserManager::UserError UserManager::removeUser(const QString &username)
 {
     if (!username.isEmpty()) {
-        QString dropUserQuery = QString("DELETE FROM users WHERE lower(username) =\"%1\";").arg(username.toLower());
-        QSqlQuery result = m_db.exec(dropUserQuery);
-        if (result.numRowsAffected() == 0) {
+        QSqlQuery query(m_db);
+        query.prepare("DELETE FROM users WHERE lower(username) = ?;");
+        query.addBindValue(username.toLower());
+        query.exec();
+        if (query.numRowsAffected() == 0) {
             return UserErrorInvalidUserId;
         }
+        m_users.removeAll(username.toLower());
     }
 
-    QString dropTokensQuery = QString("DELETE FROM tokens WHERE lower(username) = \"%1\";").arg(username.toLower());
-    m_db.exec(dropTokensQuery);
+    QSqlQuery query(m_db);
+    query.prepare("DELETE FROM tokens WHERE lower(username) = ?;");
+    query.addBindValue(username.toLower());
+    query.exec();
+
+    foreach (const TokenInfo &tokenInfo, m_tokens) {
+        if (tokenInfo.username().toLower() == username.toLower()) {
+            uncacheToken(tokenInfo.id());
+        }
+    }
 
     return UserErrorNoError;
 }
@@ -245,34 +244,23 @@ QByteArray UserManager::authenticate(const QString &username, const QString &pas
         return QByteArray();
     }
 
-    QString passwordQuery = QString("SELECT password, salt FROM users WHERE lower(username) = \"%1\";").arg(username.toLower());
-    QSqlQuery result = m_db.exec(passwordQuery);
-    if (!result.first()) {
+    QSqlQuery passwordQuery(m_db);
+    passwordQuery.prepare("SELECT password, salt FROM users WHERE lower(username) = ?;");
+    passwordQuery.addBindValue(username.toLower());
+    passwordQuery.exec();
+    if (!passwordQuery.first()) {
         qCWarning(dcUserManager) << "No such username" << username;
         return QByteArray();
     }
-    QByteArray salt = result.value("salt").toByteArray();
-    QByteArray hashedPassword = result.value("password").toByteArray();
+    QByteArray salt = passwordQuery.value("salt").toByteArray();
+    QByteArray hashedPassword = passwordQuery.value("password").toByteArray();
 
     if (hashedPassword != QCryptographicHash::hash(QString(password + salt).toUtf8(), QCryptographicHash::Sha512).toBase64()) {
         qCWarning(dcUserManager) << "Authentication error for user:" << username;
         return QByteArray();
     }
 
-    QByteArray token = QCryptographicHash::hash(QUuid::createUuid().toByteArray(), QCryptographicHash::Sha256).toBase64();
-    QString storeTokenQuery = QString("INSERT INTO tokens(id, username, token, creationdate, devicename) VALUES(\"%1\", \"%2\", \"%3\", \"%4\", \"%5\");")
-            .arg(QUuid::createUuid().toString())
-            .arg(username.toLower())
-            .arg(QString::fromUtf8(token))
-            .arg(NymeaCore::instance()->timeManager()->currentDateTime().toString("yyyy-MM-dd hh:mm:ss"))
-            .arg(deviceName);
-
-    m_db.exec(storeTokenQuery);
-    if (m_db.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcUserManager) << "Error storing token in DB:" << m_db.lastError().databaseText() << m_db.lastError().driverText();
-        return QByteArray();
-    }
-    return token;
+    return storeToken(username.toLower(), deviceName);
 }
 
 /*! Start the push button authentication for the device with the given \a deviceName. Returns the transaction id as refference to the request. */
@@ -320,18 +308,10 @@ UserInfo UserManager::userInfo(const QByteArray &token) const
 
     // OK, this seems pointless, but data structures are prepared to have more details about users than just the username
     // i.e. permissions etc will be in here at some point
-    QString getUserQuery = QString("SELECT username FROM users WHERE lower(username) = \"%1\";")
-            .arg(tokenInfo.username().toLower());
-    QSqlQuery result = m_db.exec(getUserQuery);
-    if (m_db.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcUserManager) << "Query for token failed:" << m_db.lastError().databaseText() << m_db.lastError().driverText() << getUserQuery;
+    if (!m_users.contains(tokenInfo.username().toLower())) {
         return UserInfo();
     }
-
-    if (!result.first()) {
-        return UserInfo();
-    }
-    return UserInfo(result.value("username").toString());
+    return UserInfo(tokenInfo.username().toLower());
 
 }
 
@@ -343,16 +323,17 @@ QList<TokenInfo> UserManager::tokens(const QString &username) const
         qCWarning(dcUserManager) << "Username did not pass validation:" << username;
         return ret;
     }
-    QString getTokensQuery = QString("SELECT id, username, creationdate, deviceName FROM tokens WHERE lower(username) = \"%1\";")
-            .arg(username.toLower());
-    QSqlQuery result = m_db.exec(getTokensQuery);
-    if (m_db.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcUserManager) << "Query for tokens failed:" << m_db.lastError().databaseText() << m_db.lastError().driverText() << getTokensQuery;
+    QSqlQuery query(m_db);
+    query.prepare("SELECT id, username, creationdate, deviceName FROM tokens WHERE lower(username) = ?;");
+    query.addBindValue(username.toLower());
+    query.exec();
+    if (query.lastError().type() != QSqlError::NoError) {
+        qCWarning(dcUserManager) << "Query for tokens failed:" << query.lastError().databaseText() << query.lastError().driverText() << query.lastQuery();
         return ret;
     }
 
-    while (result.next()) {
-        ret << TokenInfo(result.value("id").toUuid(), result.value("username").toString(), result.value("creationdate").toDateTime(), result.value("devicename").toString());
+    while (query.next()) {
+        ret << TokenInfo(query.value("id").toUuid(), query.value("username").toString(), query.value("creationdate").toDateTime(), query.value("devicename").toString());
     }
     return ret;
 }
@@ -364,51 +345,30 @@ TokenInfo UserManager::tokenInfo(const QByteArray &token) const
         return TokenInfo();
     }
 
-    QString getTokenQuery = QString("SELECT id, username, creationdate, deviceName FROM tokens WHERE token = \"%1\";")
-            .arg(QString::fromUtf8(token));
-    QSqlQuery result = m_db.exec(getTokenQuery);
-    if (m_db.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcUserManager) << "Query for token failed:" << m_db.lastError().databaseText() << m_db.lastError().driverText() << getTokenQuery;
-        return TokenInfo();
-    }
-
-    if (!result.first()) {
-        return TokenInfo();
-    }
-    return TokenInfo(result.value("id").toUuid(), result.value("username").toString(), result.value("creationdate").toDateTime(), result.value("devicename").toString());
+    return m_tokens.value(hashToken(token));
 }
 
 TokenInfo UserManager::tokenInfo(const QUuid &tokenId) const
 {
-
-    QString getTokenQuery = QString("SELECT id, username, creationdate, deviceName FROM tokens WHERE id = \"%1\";")
-            .arg(tokenId.toString());
-    QSqlQuery result = m_db.exec(getTokenQuery);
-    if (m_db.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcUserManager) << "Query for token failed:" << m_db.lastError().databaseText() << m_db.lastError().driverText() << getTokenQuery;
-        return TokenInfo();
-    }
-
-    if (!result.first()) {
-        return TokenInfo();
-    }
-    return TokenInfo(result.value("id").toUuid(), result.value("username").toString(), result.value("creationdate").toDateTime(), result.value("devicename").toString());
+    return m_tokens.value(m_tokenHashes.value(tokenId));
 }
 
 /*! Removes the token with the given \a tokenId. Returns \l{UserError} to inform about the result. */
 UserManager::UserError UserManager::removeToken(const QUuid &tokenId)
 {
-    QString removeTokenQuery = QString("DELETE FROM tokens WHERE id = \"%1\";")
-            .arg(tokenId.toString());
-    QSqlQuery result = m_db.exec(removeTokenQuery);
-    if (m_db.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcUserManager) << "Removing token failed:" << m_db.lastError().databaseText() << m_db.lastError().driverText() << removeTokenQuery;
+    QSqlQuery query(m_db);
+    query.prepare("DELETE FROM tokens WHERE id = ?;");
+    query.addBindValue(tokenId.toString());
+    query.exec();
+    if (query.lastError().type() != QSqlError::NoError) {
+        qCWarning(dcUserManager) << "Removing token failed:" << query.lastError().databaseText() << query.lastError().driverText() << query.lastQuery();
         return UserErrorBackendError;
     }
-    if (result.numRowsAffected() != 1) {
+    if (query.numRowsAffected() != 1) {
         qCWarning(dcUserManager) << "Token not found in DB";
         return UserErrorTokenNotFound;
     }
+    uncacheToken(tokenId);
 
     qCDebug(dcUserManager) << "Token" << tokenId << "removed from DB";
     return UserErrorNoError;
@@ -421,18 +381,10 @@ bool UserManager::verifyToken(const QByteArray &token)
         qCWarning(dcUserManager) << "Token failed character validation" << token;
         return false;
     }
-    QString getTokenQuery = QString("SELECT * FROM tokens WHERE token = \"%1\";")
-            .arg(QString::fromUtf8(token));
-    QSqlQuery result = m_db.exec(getTokenQuery);
-    if (m_db.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcUserManager) << "Query for token failed:" << m_db.lastError().databaseText() << m_db.lastError().driverText() << getTokenQuery;
-        return false;
-    }
-    if (!result.first()) {
+    if (!m_tokens.contains(hashToken(token))) {
         qCDebug(dcUserManager) << "Authorization failed for token" << token;
         return false;
     }
-    //qCDebug(dcUserManager) << "Token authorized for user" << result.value("username").toString();
     return true;
 }
 
@@ -469,6 +421,75 @@ bool UserManager::initDB()
     return true;
 }
 
+bool UserManager::loadCache()
+{
+    m_users.clear();
+    m_tokens.clear();
+    m_tokenHashes.clear();
+
+    QSqlQuery usersQuery = m_db.exec("SELECT username FROM users;");
+    if (m_db.lastError().type() != QSqlError::NoError) {
+        qCWarning(dcUserManager) << "Query for users failed:" << m_db.lastError().databaseText() << m_db.lastError().driverText();
+        return false;
+    }
+    while (usersQuery.next()) {
+        m_users.append(usersQuery.value("username").toString());
+    }
+
+    QSqlQuery tokensQuery = m_db.exec("SELECT id, username, token, creationdate, devicename FROM tokens;");
+    if (m_db.lastError().type() != QSqlError::NoError) {
+        qCWarning(dcUserManager) << "Query for tokens failed:" << m_db.lastError().databaseText() << m_db.lastError().driverText();
+        return false;
+    }
+    while (tokensQuery.next()) {
+        cacheToken(tokensQuery.value("token").toByteArray(), TokenInfo(tokensQuery.value("id").toUuid(), tokensQuery.value("username").toString(), tokensQuery.value("creationdate").toDateTime(), tokensQuery.value("devicename").toString()));
+    }
+
+    qCDebug(dcUserManager()) << "Loaded" << m_users.count() << "users and" << m_tokens.count() << "tokens.";
+    return true;
+}
+
+QByteArray UserManager::storeToken(const QString &username, const QString &deviceName)
+{
+    QByteArray token = QCryptographicHash::hash(QUuid::createUuid().toByteArray(), QCryptographicHash::Sha256).toBase64();
+    QUuid tokenId = QUuid::createUuid();
+    QString creationDate = NymeaCore::instance()->timeManager()->currentDateTime().toString("yyyy-MM-dd hh:mm:ss");
+
+    QSqlQuery query(m_db);
+    query.prepare("INSERT INTO tokens(id, username, token, creationdate, devicename) VALUES(?, ?, ?, ?, ?);");
+    query.addBindValue(tokenId.toString());
+    query.addBindValue(username);
+    query.addBindValue(QString::fromUtf8(token));
+    query.addBindValue(creationDate);
+    query.addBindValue(deviceName);
+    query.exec();
+    if (query.lastError().type() != QSqlError::NoError) {
+        qCWarning(dcUserManager) << "Error storing token in DB:" << query.lastError().databaseText() << query.lastError().driverText();
+        return QByteArray();
+    }
+
+    // Convert the creation date the same way as when loading it from the DB
+    cacheToken(token, TokenInfo(tokenId, username, QVariant(creationDate).toDateTime(), deviceName));
+    return token;
+}
+
+void UserManager::cacheToken(const QByteArray &token, const TokenInfo &tokenInfo)
+{
+    QByteArray tokenHash = hashToken(token);
+    m_tokens.insert(tokenHash, tokenInfo);
+    m_tokenHashes.insert(tokenInfo.id(), tokenHash);
+}
+
+void UserManager::uncacheToken(const QUuid &tokenId)
+{
+    m_tokens.remove(m_tokenHashes.take(tokenId));
+}
+
+QByteArray UserManager::hashToken(const QByteArray &token)
+{
+    return QCryptographicHash::hash(token, QCryptographicHash::Sha256);
+}
+
 void UserManager::rotate(const QString &dbName)
 {
     int index = 1;
@@ -520,17 +541,8 @@ void UserManager::onPushButtonPressed()
         return;
     }
 
-    QByteArray token = QCryptographicHash::hash(QUuid::createUuid().toByteArray(), QCryptographicHash::Sha256).toBase64();
-    QString storeTokenQuery = QString("INSERT INTO tokens(id, username, token, creationdate, devicename) VALUES(\"%1\", \"%2\", \"%3\", \"%4\", \"%5\");")
-            .arg(QUuid::createUuid().toString())
-            .arg("")
-            .arg(QString::fromUtf8(token))
-            .arg(NymeaCore::instance()->timeManager()->currentDateTime().toString("yyyy-MM-dd hh:mm:ss"))
-            .arg(m_pushButtonTransaction.second);
-
-    m_db.exec(storeTokenQuery);
-    if (m_db.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcUserManager()) << "Error storing token in DB:" << m_db.lastError().databaseText() << m_db.lastError().driverText();
+    QByteArray token = storeToken(QString(""), m_pushButtonTransaction.second);
+    if (token.isEmpty()) {
         qCWarning(dcUserManager()) << "PushButton Auth failed.";
         emit pushButtonAuthFinished(m_pushButtonTransaction.first, false, QByteArray());
     } else {
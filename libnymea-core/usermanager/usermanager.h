@@ -35,6 +35,7 @@
 #include "userinfo.h"
 
 #include <QObject>
+#include <QHash>
 #include <QSqlDatabase>
 
 namespace nymeaserver {
@@ -86,6 +87,11 @@ signals:
 
 private:
     bool initDB();
+    bool loadCache();
+    QByteArray storeToken(const QString &username, const QString &deviceName);
+    void cacheToken(const QByteArray &token, const TokenInfo &tokenInfo);
+    void uncacheToken(const QUuid &tokenId);
+    static QByteArray hashToken(const QByteArray &token);
     void rotate(const QString &dbName);
     bool validateUsername(const QString &username) const;
     bool validatePassword(const QString &password) const;
@@ -100,6 +106,12 @@ private:
     int m_pushButtonTransactionIdCounter = 0;
     QPair<int, QString> m_pushButtonTransaction;
 
+    // In memory copy of the users and tokens tables. Tokens are keyed by their SHA-256 hash.
+    bool m_cacheValid = false;
+    QStringList m_users;
+    QHash<QByteArray, TokenInfo> m_tokens;
+    QHash<QUuid, QByteArray> m_tokenHashes;
+
 };
 }
 Q_DECLARE_METATYPE(nymeaserver::UserManager::UserError)
@@ -86,12 +86,26 @@
 
 Q_LOGGING_CATEGORY(dcCoap, "Coap")
 
+// Payload size used for blockwise transfers unless the server asks for smaller blocks. Together with
+// the header and options a 1024 byte block still fits into an IPv6 minimum MTU datagram.
+static const int s_preferredBlockSize = 1024;
+
+// The SZX value of a block option for the given block size in bytes
+static int blockSizeExponent(int blockSize)
+{
+    int exponent = 0;
+    while (exponent < 6 && (16 << exponent) < blockSize)
+        exponent++;
+
+    return exponent;
+}
+
 /*! Constructs a Coap access manager with the given \a parent and \a port. */
 Coap::Coap(QObject *parent, const quint16 &port) :
-    QObject(parent),
-    m_reply(nullptr)
+    QObject(parent)
 {
     m_socket = new QUdpSocket(this);
+    m_nextMessageId = static_cast<quint16>(qrand() % 65536);
 
     if (!m_socket->bind(QHostAddress::Any, port, QAbstractSocket::ShareAddress))
         qCWarning(dcCoap) << "Could not bind to port" << port << m_socket->errorString();
@@ -115,13 +129,7 @@ CoapReply *Coap::ping(const CoapRequest &request)
         return reply;
     }
 
-    // check if there is a request running
-    if (m_reply == 0) {
-        m_reply = reply;
-        lookupHost();
-    } else {
-        m_replyQueue.enqueue(reply);
-    }
+    enqueueReply(reply);
 
     return reply;
 }
@@ -142,13 +150,7 @@ CoapReply *Coap::get(const CoapRequest &request)
         return reply;
     }
 
-    // check if there is a request running
-    if (m_reply == 0) {
-        m_reply = reply;
-        lookupHost();
-    } else {
-        m_replyQueue.enqueue(reply);
-    }
+    enqueueReply(reply);
     return reply;
 }
 
@@ -169,13 +171,7 @@ CoapReply *Coap::put(const CoapRequest &request, const QByteArray &data)
         return reply;
     }
 
-    // check if there is a request running
-    if (m_reply == 0) {
-        m_reply = reply;
-        lookupHost();
-    } else {
-        m_replyQueue.enqueue(reply);
-    }
+    enqueueReply(reply);
 
     return reply;
 }
@@ -197,13 +193,7 @@ CoapReply *Coap::post(const CoapRequest &request, const QByteArray &data)
         return reply;
     }
 
-    // check if there is a request running
-    if (m_reply == 0) {
-        m_reply = reply;
-        lookupHost();
-    } else {
-        m_replyQueue.enqueue(reply);
-    }
+    enqueueReply(reply);
 
     return reply;
 }
@@ -224,13 +214,7 @@ CoapReply *Coap::deleteResource(const CoapRequest &request)
         return reply;
     }
 
-    // check if there is a request running
-    if (m_reply.isNull()) {
-        m_reply = reply;
-        lookupHost();
-    } else {
-        m_replyQueue.enqueue(reply);
-    }
+    enqueueReply(reply);
 
     return reply;
 }
@@ -254,13 +238,7 @@ CoapReply *Coap::enableResourceNotifications(const CoapRequest &request)
         return reply;
     }
 
-    // check if there is a request running
-    if (m_reply.isNull()) {
-        m_reply = reply;
-        lookupHost();
-    } else {
-        m_replyQueue.enqueue(reply);
-    }
+    enqueueReply(reply);
 
     return reply;
 }
@@ -285,21 +263,112 @@ CoapReply *Coap::disableNotifications(const CoapRequest &request)
         return reply;
     }
 
-    // check if there is a request running
-    if (m_reply == 0) {
-        m_reply = reply;
-        lookupHost();
-    } else {
-        m_replyQueue.enqueue(reply);
-    }
+    enqueueReply(reply);
 
     return reply;
 }
 
-void Coap::lookupHost()
+/*! Returns the maximum number of requests running at the same time for one host. Requests exceeding this
+    limit are queued until a running request to the same host finishes. Requests to different hosts are
+    always sent concurrently. The default is 1, as recommended by \l{https://tools.ietf.org/html/rfc7252#section-4.7}{RFC7252}.
+*/
+int Coap::maximumRequestsPerHost() const
+{
+    return m_maximumRequestsPerHost;
+}
+
+/*! Sets the \a maximum number of requests running at the same time for one host. */
+void Coap::setMaximumRequestsPerHost(int maximum)
+{
+    m_maximumRequestsPerHost = qMax(1, maximum);
+    startQueuedReplies();
+}
+
+void Coap::enqueueReply(CoapReply *reply)
+{
+    connect(reply, &QObject::destroyed, this, &Coap::onReplyDestroyed);
+    m_replyQueue.enqueue(reply);
+    startQueuedReplies();
+}
+
+void Coap::startQueuedReplies()
+{
+    // Keep the order of the queue for each host, but don't let a busy host block requests to others
+    QQueue<CoapReply *>::iterator it = m_replyQueue.begin();
+    while (it != m_replyQueue.end()) {
+        CoapReply *reply = *it;
+        QString host = hostKey(reply);
+        if (m_runningHostReplies.value(host) >= m_maximumRequestsPerHost) {
+            ++it;
+            continue;
+        }
+        it = m_replyQueue.erase(it);
+        m_runningHostReplies[host]++;
+        m_runningReplies.insert(reply, host);
+        lookupHost(reply);
+    }
+}
+
+void Coap::releaseReply(CoapReply *reply)
 {
-    int lookupId = QHostInfo::lookupHost(m_reply->request().url().host(), this, SLOT(hostLookupFinished(QHostInfo)));
-    m_runningHostLookups.insert(lookupId, m_reply);
+    if (!m_runningReplies.contains(reply)) {
+        m_replyQueue.removeAll(reply);
+        return;
+    }
+
+    QString host = m_runningReplies.take(reply);
+    if (--m_runningHostReplies[host] <= 0) {
+        m_runningHostReplies.remove(host);
+    }
+
+    // Don't dereference the reply here, it might be in destruction already
+    for (QHash<quint16, CoapReply *>::iterator it = m_messageIdReplies.begin(); it != m_messageIdReplies.end();) {
+        it = it.value() == reply ? m_messageIdReplies.erase(it) : it + 1;
+    }
+    for (QHash<QByteArray, CoapReply *>::iterator it = m_tokenReplies.begin(); it != m_tokenReplies.end();) {
+        it = it.value() == reply ? m_tokenReplies.erase(it) : it + 1;
+    }
+    for (QHash<int, CoapReply *>::iterator it = m_runningHostLookups.begin(); it != m_runningHostLookups.end();) {
+        it = it.value() == reply ? m_runningHostLookups.erase(it) : it + 1;
+    }
+}
+
+QString Coap::hostKey(CoapReply *reply) const
+{
+    return reply->request().url().host() + ':' + QString::number(reply->request().url().port(5683));
+}
+
+quint16 Coap::createMessageId()
+{
+    // Message IDs are sequential from a random start, skipping the ones still in use by running requests
+    while (m_messageIdReplies.contains(m_nextMessageId)) {
+        m_nextMessageId++;
+    }
+    return m_nextMessageId++;
+}
+
+QByteArray Coap::createToken() const
+{
+    CoapPdu pdu;
+    do {
+        pdu.createToken();
+    } while (m_tokenReplies.contains(pdu.token()) || m_observeResources.contains(pdu.token()));
+    return pdu.token();
+}
+
+void Coap::setReplyMessageId(CoapReply *reply, quint16 messageId)
+{
+    if (m_messageIdReplies.value(static_cast<quint16>(reply->messageId())) == reply) {
+        m_messageIdReplies.remove(static_cast<quint16>(reply->messageId()));
+    }
+    reply->setMessageId(messageId);
+    m_messageIdReplies.insert(messageId, reply);
+}
+
+void Coap::lookupHost(CoapReply *reply)
+{
+    int lookupId = QHostInfo::lookupHost(reply->request().url().host(), this, SLOT(hostLookupFinished(QHostInfo)));
+    m_runningHostLookups.insert(lookupId, reply);
 }
 
 void Coap::sendRequest(CoapReply *reply, const bool &lookedUp)
@@ -307,8 +376,8 @@ void Coap::sendRequest(CoapReply *reply, const bool &lookedUp)
     CoapPdu pdu;
     pdu.setMessageType(reply->request().messageType());
     pdu.setStatusCode(reply->requestMethod());
-    pdu.createMessageId();
-    pdu.createToken();
+    pdu.setMessageId(createMessageId());
+    pdu.setToken(createToken());
 
     // Add the options in correct order
     // Option number 3
@@ -350,9 +419,11 @@ void Coap::sendRequest(CoapReply *reply, const bool &lookedUp)
         pdu.addOption(CoapOption::ContentFormat, QByteArray(1, ((quint8)reply->request().contentType())));
 
         // check if we have to block the payload
-        if (reply->requestPayload().size() > 64) {
-            pdu.addOption(CoapOption::Block1, CoapPduBlock::createBlock(0, 2, true));
-            pdu.setPayload(reply->requestPayload().mid(0, 64));
+        if (reply->requestPayload().size() > s_preferredBlockSize) {
+            pdu.addOption(CoapOption::Block1, CoapPduBlock::createBlock(0, blockSizeExponent(s_preferredBlockSize), true));
+            pdu.setPayload(reply->requestPayload().mid(0, s_preferredBlockSize));
+            reply->m_block1Size = s_preferredBlockSize;
+            reply->m_block1Offset = s_preferredBlockSize;
         } else {
             pdu.setPayload(reply->requestPayload());
         }
@@ -364,12 +435,13 @@ void Coap::sendRequest(CoapReply *reply, const bool &lookedUp)
 
     // Option number 23
     if (reply->requestMethod() == CoapPdu::Get)
-        pdu.addOption(CoapOption::Block2, CoapPduBlock::createBlock(0));
+        pdu.addOption(CoapOption::Block2, CoapPduBlock::createBlock(0, blockSizeExponent(s_preferredBlockSize)));
 
     QByteArray pduData = pdu.pack();
     reply->setRequestData(pduData);
-    reply->setMessageId(pdu.messageId());
+    setReplyMessageId(reply, pdu.messageId());
     reply->setMessageToken(pdu.token());
+    m_tokenReplies.insert(pdu.token(), reply);
     reply->m_lockedUp = lookedUp;
     reply->m_timer->start();
 
@@ -396,30 +468,38 @@ void Coap::sendCoapPdu(const QHostAddress &hostAddress, const quint16 &port, con
 
 void Coap::processResponse(const CoapPdu &pdu, const QHostAddress &address, const quint16 &port)
 {
-    // if we are waiting for a reply response
-    if (m_reply) {
-        qCDebug(dcCoap) << "<---" << QString("%1:%2").arg(address.toString()).arg(QString::number(port)) << pdu;
-        if (!pdu.isValid()) {
-            qCWarning(dcCoap) << "Got invalid PDU";
-            m_reply->setError(CoapReply::InvalidPduError);
-            m_reply->setFinished();
-            return;
-        }
+    qCDebug(dcCoap) << "<---" << QString("%1:%2").arg(address.toString()).arg(QString::number(port)) << pdu;
+    if (!pdu.isValid()) {
+        // We can't tell which request this belongs to, the request will be resent on timeout
+        qCWarning(dcCoap) << "Got invalid PDU from" << address.toString();
+        return;
+    }
 
-        // check if the message is a response to a reply (message id based check)
-        if (m_reply->messageId() == pdu.messageId()) {
-            processIdBasedResponse(m_reply, pdu);
+    // check if the message is a response to a reply (message id based check)
+    CoapReply *reply = nullptr;
+    if (pdu.messageType() == CoapPdu::Acknowledgement || pdu.messageType() == CoapPdu::Reset)
+        reply = m_messageIdReplies.value(pdu.messageId());
+
+    if (reply) {
+        if (!isReplySender(reply, address, port)) {
+            qCWarning(dcCoap) << "Ignoring response from" << QString("%1:%2").arg(address.toString()).arg(port) << "for a request to" << QString("%1:%2").arg(reply->hostAddress().toString()).arg(reply->port());
             return;
         }
+        processIdBasedResponse(reply, pdu);
+        return;
+    }
 
-        // check if we know the message by token (message token based check)
-        if (m_reply->messageToken() == pdu.token()) {
-            processTokenBasedResponse(m_reply, pdu);
+    // check if we know the message by token (message token based check)
+    reply = m_tokenReplies.value(pdu.token());
+    if (reply) {
+        if (!isReplySender(reply, address, port)) {
+            qCWarning(dcCoap) << "Ignoring response from" << QString("%1:%2").arg(address.toString()).arg(port) << "for a request to" << QString("%1:%2").arg(reply->hostAddress().toString()).arg(reply->port());
             return;
         }
+        processTokenBasedResponse(reply, pdu);
+        return;
     }
 
-
     if (m_observerReply) {
         processBlock2Notification(m_observerReply, pdu);
         return;
@@ -439,6 +519,12 @@ void Coap::processResponse(const CoapPdu &pdu, const QHostAddress &address, cons
     sendCoapPdu(address, port, responsePdu);
 }
 
+// Message ids and tokens are only unique per endpoint, a response must come from the host the request was sent to
+bool Coap::isReplySender(CoapReply *reply, const QHostAddress &address, const quint16 &port) const
+{
+    return reply->port() == port && reply->hostAddress().isEqual(address, QHostAddress::TolerantConversion);
+}
+
 void Coap::processIdBasedResponse(CoapReply *reply, const CoapPdu &pdu)
 {
     // check if this is an empty ACK response (which indicates a separated response)
@@ -528,11 +614,13 @@ void Coap::processNotification(const CoapPdu &pdu, const QHostAddress &address,
             connect(m_observerReply.data(), &CoapReply::timeout, this, &Coap::onReplyTimeout);
             connect(m_observerReply.data(), &CoapReply::finished, this, &Coap::onReplyFinished);
 
+            int blockSize = pdu.block().blockSize();
+
             CoapPdu pdu;
             pdu.setMessageType(m_observerReply->request().messageType());
             pdu.setStatusCode(m_observerReply->requestMethod());
-            pdu.createMessageId();
-            pdu.createToken();
+            pdu.setMessageId(createMessageId());
+            pdu.setToken(createToken());
 
             // Add the options in correct order
             // Option number 3
@@ -550,7 +638,7 @@ void Coap::processNotification(const CoapPdu &pdu, const QHostAddress &address,
                 pdu.addOption(CoapOption::UriQuery, m_observerReply->request().url().query().toUtf8());
 
             // Option number 23
-            pdu.addOption(CoapOption::Block2, CoapPduBlock::createBlock(1, 2, true));
+            pdu.addOption(CoapOption::Block2, CoapPduBlock::createBlock(1, blockSizeExponent(blockSize), true));
 
             QByteArray pduData = pdu.pack();
             m_observerReply->setRequestData(pduData);
@@ -589,10 +677,10 @@ void Coap::processBlock1Response(CoapReply *reply, const CoapPdu &pdu)
 {
     qCDebug(dcCoap) << "Sent successfully block #" << pdu.block().blockNumber();
 
-    // create next block
-    int index = (pdu.block().blockNumber() * 64) + 64;
-    QByteArray newBlockData = reply->requestPayload().mid(index, 64);
-    bool moreFlag = true;
+    // The server may ask for smaller blocks in its ACK, continue with that size from the data sent so far
+    int blockSize = qMin(reply->m_block1Size, pdu.block().blockSize());
+    int index = reply->m_block1Offset;
+    QByteArray newBlockData = reply->requestPayload().mid(index, blockSize);
 
     // check if this was the last block
     if (newBlockData.isEmpty()) {
@@ -602,15 +690,16 @@ void Coap::processBlock1Response(CoapReply *reply, const CoapPdu &pdu)
         return;
     }
 
-    // check if this is the last block or there will be no next block
-    if (newBlockData.size() < 64 || (index + 64) == reply->requestPayload().size())
-        moreFlag = false;
+    // check if there will be a next block
+    bool moreFlag = (index + newBlockData.size()) < reply->requestPayload().size();
+    reply->m_block1Size = blockSize;
+    reply->m_block1Offset = index + newBlockData.size();
 
     CoapPdu nextBlockRequest;
     nextBlockRequest.setContentType(reply->request().contentType());
     nextBlockRequest.setMessageType(reply->request().messageType());
     nextBlockRequest.setStatusCode(reply->requestMethod());
-    nextBlockRequest.setMessageId(pdu.messageId() + 1);
+    nextBlockRequest.setMessageId(createMessageId());
     nextBlockRequest.setToken(pdu.token());
 
     // Add the options in correct order
@@ -634,7 +723,7 @@ void Coap::processBlock1Response(CoapReply *reply, const CoapPdu &pdu)
         nextBlockRequest.addOption(CoapOption::UriQuery, reply->request().url().query().toUtf8());
 
     // Option number 27
-    nextBlockRequest.addOption(CoapOption::Block1, CoapPduBlock::createBlock(pdu.block().blockNumber() + 1, 2, moreFlag));
+    nextBlockRequest.addOption(CoapOption::Block1, CoapPduBlock::createBlock(index / blockSize, blockSizeExponent(blockSize), moreFlag));
 
     nextBlockRequest.setPayload(newBlockData);
 
@@ -643,7 +732,7 @@ void Coap::processBlock1Response(CoapReply *reply, const CoapPdu &pdu)
     reply->m_timer->start();
     reply->m_retransmissions = 1;
 
-    reply->setMessageId(nextBlockRequest.messageId());
+    setReplyMessageId(reply, nextBlockRequest.messageId());
 
     qCDebug(dcCoap) << "--->" << nextBlockRequest;
     sendData(reply->hostAddress(), reply->port(), pduData);
@@ -665,7 +754,7 @@ void Coap::processBlock2Response(CoapReply *reply, const CoapPdu &pdu)
     nextBlockRequest.setContentType(reply->request().contentType());
     nextBlockRequest.setMessageType(reply->request().messageType());
     nextBlockRequest.setStatusCode(reply->requestMethod());
-    nextBlockRequest.setMessageId(pdu.messageId() + 1);
+    nextBlockRequest.setMessageId(createMessageId());
     nextBlockRequest.setToken(pdu.token());
 
     // Add the options in correct order
@@ -689,13 +778,13 @@ void Coap::processBlock2Response(CoapReply *reply, const CoapPdu &pdu)
         nextBlockRequest.addOption(CoapOption::UriQuery, reply->request().url().query().toUtf8());
 
     // Option number 23
-    nextBlockRequest.addOption(CoapOption::Block2, CoapPduBlock::createBlock(pdu.block().blockNumber() + 1, 2, false));
+    nextBlockRequest.addOption(CoapOption::Block2, CoapPduBlock::createBlock(pdu.block().blockNumber() + 1, blockSizeExponent(pdu.block().blockSize()), false));
 
     QByteArray pduData = nextBlockRequest.pack();
     reply->setRequestData(pduData);
     reply->m_timer->start();
 
-    reply->setMessageId(nextBlockRequest.messageId());
+    setReplyMessageId(reply, nextBlockRequest.messageId());
 
     qCDebug(dcCoap) << "--->" << nextBlockRequest;
     sendData(reply->hostAddress(), reply->port(), pduData);
@@ -738,7 +827,7 @@ void Coap::processBlock2Notification(CoapReply *reply, const CoapPdu &pdu)
     nextBlockRequest.setContentType(reply->request().contentType());
     nextBlockRequest.setMessageType(reply->request().messageType());
     nextBlockRequest.setStatusCode(reply->requestMethod());
-    nextBlockRequest.setMessageId(pdu.messageId() + 1);
+    nextBlockRequest.setMessageId(createMessageId());
     nextBlockRequest.setToken(pdu.token());
 
     // Add the options in correct order
@@ -762,7 +851,7 @@ void Coap::processBlock2Notification(CoapReply *reply, const CoapPdu &pdu)
         nextBlockRequest.addOption(CoapOption::UriQuery, reply->request().url().query().toUtf8());
 
     // Option number 23
-    nextBlockRequest.addOption(CoapOption::Block2, CoapPduBlock::createBlock(pdu.block().blockNumber() + 1, 2, false));
+    nextBlockRequest.addOption(CoapOption::Block2, CoapPduBlock::createBlock(pdu.block().blockNumber() + 1, blockSizeExponent(pdu.block().blockSize()), false));
 
     QByteArray pduData = nextBlockRequest.pack();
     reply->setRequestData(pduData);
@@ -776,7 +865,12 @@ void Coap::processBlock2Notification(CoapReply *reply, const CoapPdu &pdu)
 
 void Coap::hostLookupFinished(const QHostInfo &hostInfo)
 {
-    CoapReply *reply = m_runningHostLookups.take(hostInfo.lookupId());;
+    CoapReply *reply = m_runningHostLookups.take(hostInfo.lookupId());
+    if (!reply) {
+        // The reply has been deleted in the meantime
+        return;
+    }
+
     reply->setPort(reply->request().url().port(5683));
 
     if (hostInfo.error() != QHostInfo::NoError) {
@@ -800,17 +894,17 @@ void Coap::hostLookupFinished(const QHostInfo &hostInfo)
 
 void Coap::onReadyRead()
 {
-    QHostAddress hostAddress;
-    QByteArray data;
-    quint16 port;
-
     while (m_socket->hasPendingDatagrams()) {
-        data.resize(m_socket->pendingDatagramSize());
-        m_socket->readDatagram(data.data(), data.size(), &hostAddress, &port);
-    }
+        QHostAddress hostAddress;
+        quint16 port = 0;
+        QByteArray data;
+        data.resize(static_cast<int>(qMax(m_socket->pendingDatagramSize(), static_cast<qint64>(0))));
+        if (m_socket->readDatagram(data.data(), data.size(), &hostAddress, &port) < 0)
+            continue;
 
-    CoapPdu pdu(data);
-    processResponse(pdu, hostAddress, port);
+        CoapPdu pdu(data);
+        processResponse(pdu, hostAddress, port);
+    }
 }
 
 void Coap::onReplyTimeout()
@@ -820,6 +914,9 @@ void Coap::onReplyTimeout()
         qCDebug(dcCoap) << QString("Reply timeout: resending message %1/4").arg(reply->m_retransmissions);
     }
     reply->resend();
+    if (reply->isFinished())
+        return;
+
     m_socket->writeDatagram(reply->requestData(), reply->hostAddress(), reply->port());
 }
 
@@ -835,16 +932,19 @@ void Coap::onReplyFinished()
         return;
     }
 
-    if (reply != m_reply)
+    if (!m_runningReplies.contains(reply))
         qCWarning(dcCoap) << "This should never happen!! Please report a bug if you get this message!";
 
+    releaseReply(reply);
     emit replyFinished(reply);
-    m_reply.clear();
 
-    // check if there is a request in the queue
-    if (!m_replyQueue.isEmpty()) {
-        m_reply = m_replyQueue.dequeue();
-        if (m_reply)
-            lookupHost();
-    }
+    // check if there is a request in the queue which can be started now
+    startQueuedReplies();
+}
+
+void Coap::onReplyDestroyed(QObject *object)
+{
+    CoapReply *reply = static_cast<CoapReply *>(object);
+    releaseReply(reply);
+    startQueuedReplies();
 }
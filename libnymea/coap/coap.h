@@ -70,12 +70,21 @@ public:
     CoapReply *enableResourceNotifications(const CoapRequest &request);
     CoapReply *disableNotifications(const CoapRequest &request);
 
+    int maximumRequestsPerHost() const;
+    void setMaximumRequestsPerHost(int maximum);
 
 private:
     QUdpSocket *m_socket;
 
-    QPointer<CoapReply> m_reply;
     QQueue<CoapReply *> m_replyQueue;
+    int m_maximumRequestsPerHost = 1;
+
+    // Requests on the wire, matched with responses by message id or token
+    QHash<CoapReply *, QString> m_runningReplies;                       // reply | host
+    QHash<QString, int> m_runningHostReplies;                           // host | running requests
+    QHash<quint16, CoapReply *> m_messageIdReplies;
+    QHash<QByteArray, CoapReply *> m_tokenReplies;
+    quint16 m_nextMessageId = 0;
 
     QHash<int, CoapReply *> m_runningHostLookups;
 
@@ -86,12 +95,22 @@ private:
     QHash<CoapReply *, CoapObserveResource> m_observeReplyResource;     // observe reply | resource
     QHash<CoapReply *, int> m_observeBlockwise;                         // observe reply | observe nr.
 
-    void lookupHost();
+    void enqueueReply(CoapReply *reply);
+    void startQueuedReplies();
+    void releaseReply(CoapReply *reply);
+    QString hostKey(CoapReply *reply) const;
+
+    quint16 createMessageId();
+    QByteArray createToken() const;
+    void setReplyMessageId(CoapReply *reply, quint16 messageId);
+
+    void lookupHost(CoapReply *reply);
     void sendRequest(CoapReply *reply, const bool &lookedUp = false);
     void sendData(const QHostAddress &hostAddress, const quint16 &port, const QByteArray &data);
     void sendCoapPdu(const QHostAddress &address, const quint16 &port, const CoapPdu &pdu);
 
     void processResponse(const CoapPdu &pdu, const QHostAddress &address, const quint16 &port);
+    bool isReplySender(CoapReply *reply, const QHostAddress &address, const quint16 &port) const;
     void processIdBasedResponse(CoapReply *reply, const CoapPdu &pdu);
     void processTokenBasedResponse(CoapReply *reply, const CoapPdu &pdu);
 
@@ -111,6 +130,7 @@ private slots:
     void onReadyRead();
     void onReplyTimeout();
     void onReplyFinished();
+    void onReplyDestroyed(QObject *object);
 
 };
 
@@ -32,42 +32,46 @@
 
 #include "coappdublock.h"
 
-CoapPduBlock::CoapPduBlock()
+CoapPduBlock::CoapPduBlock() :
+    m_blockNumber(0),
+    m_blockSize(0),
+    m_moreFlag(false)
 {
 }
 
-CoapPduBlock::CoapPduBlock(const QByteArray &blockData)
+CoapPduBlock::CoapPduBlock(const QByteArray &blockData) :
+    CoapPduBlock()
 {
-    if (blockData.size() == 1) {
-        quint8 block = (quint8)blockData.at(0);
-        m_blockNumber = (block & 0xf0) >> 4;
-        m_blockSize = (quint8) pow(2, (block & 0x07) + 4);
-        m_moreFlag = (bool)((block & 0x8) >> 3);
-    } else if (blockData.size() == 2) {
-        quint16 block = (quint16)blockData.toHex().toUInt(0, 16);
-        m_blockNumber = (int)(block & 0xff0) >> 4;
-        m_blockSize = (int) pow(2, (block & 0x07) + 4);
-        m_moreFlag = (bool)((block & 0x08) >> 3);
-    }
+    if (blockData.isEmpty() || blockData.size() > 3)
+        return;
+
+    // NUM (4, 12 or 20 bits) | M (1 bit) | SZX (3 bits)
+    quint32 block = 0;
+    foreach (char byte, blockData)
+        block = (block << 8) | static_cast<quint8>(byte);
+
+    m_blockNumber = static_cast<int>(block >> 4);
+    m_blockSize = (quint16) pow(2, (block & 0x07) + 4);
+    m_moreFlag = (bool)((block & 0x08) >> 3);
 }
 
 QByteArray CoapPduBlock::createBlock(const int &blockNumber, const int &blockSize, const bool &moreFlag)
 {
-    QByteArray blockData;
-    if (blockNumber < 16) {
-        quint8 block = (quint8)blockSize;
-        block |= (quint8)moreFlag << 3;
-        block |= (quint8)blockNumber << 4;
-        blockData = QByteArray(1, (char)block);
-    } else {
-        quint16 block = (quint16)blockSize;
-        block |= (quint16)moreFlag << 3;
-        block |= (quint8)blockNumber << 4;
-        blockData.resize(2);
-        blockData.fill(0);
-        blockData[0] = (quint8)(block >> 8);
-        blockData[1] = (quint8)(block & 0xff);
+    quint32 block = (quint32)blockSize & 0x07;
+    block |= (quint32)moreFlag << 3;
+    block |= (quint32)blockNumber << 4;
+
+    int length = 1;
+    if (blockNumber >= 4096) {
+        length = 3;
+    } else if (blockNumber >= 16) {
+        length = 2;
     }
+
+    QByteArray blockData;
+    for (int i = length - 1; i >= 0; i--)
+        blockData.append((char)((block >> (8 * i)) & 0xff));
+
     return blockData;
 }
 
@@ -129,6 +129,8 @@ private:
     QByteArray m_requestPayload;
     QByteArray m_requestData;
     bool m_lockedUp;
+    int m_block1Size = 0;
+    int m_block1Offset = 0;
     int m_messageId;
     QByteArray m_messageToken;
 
@@ -35,6 +35,12 @@
 #include <QFileInfo>
 #include <QJsonParseError>
 #include <QMetaEnum>
+#include <QMutex>
+
+// Interfaces resolved so far. Plugin metadata is parsed on multiple threads, so access is guarded.
+static QMutex s_interfaceCacheMutex;
+static QHash<QString, Interface> s_interfaceCache;
+static QHash<QString, QStringList> s_interfaceParentsCache;
 
 ThingUtils::ThingUtils()
 {
@@ -164,6 +170,22 @@ Interfaces ThingUtils::allInterfaces()
 }
 
 Interface ThingUtils::loadInterface(const QString &name)
+{
+    QMutexLocker locker(&s_interfaceCacheMutex);
+    if (s_interfaceCache.contains(name)) {
+        return s_interfaceCache.value(name);
+    }
+    locker.unlock();
+
+    // Not holding the lock while parsing as extended interfaces are loaded recursively
+    Interface iface = parseInterface(name);
+
+    locker.relock();
+    s_interfaceCache.insert(name, iface);
+    return iface;
+}
+
+Interface ThingUtils::parseInterface(const QString &name)
 {
     Interface iface;
     QFile f(QString(":/interfaces/%1.json").arg(name));
@@ -310,6 +332,21 @@ Interface ThingUtils::mergeInterfaces(const Interface &iface1, const Interface &
 }
 
 QStringList ThingUtils::generateInterfaceParentList(const QString &interface)
+{
+    QMutexLocker locker(&s_interfaceCacheMutex);
+    if (s_interfaceParentsCache.contains(interface)) {
+        return s_interfaceParentsCache.value(interface);
+    }
+    locker.unlock();
+
+    QStringList parents = parseInterfaceParentList(interface);
+
+    locker.relock();
+    s_interfaceParentsCache.insert(interface, parents);
+    return parents;
+}
+
+QStringList ThingUtils::parseInterfaceParentList(const QString &interface)
 {
     QFile f(QString(":/interfaces/%1.json").arg(interface));
     if (!f.open(QFile::ReadOnly)) {
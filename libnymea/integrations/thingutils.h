@@ -51,6 +51,9 @@ public:
     static Interface mergeInterfaces(const Interface &iface1, const Interface &iface2);
     static QStringList generateInterfaceParentList(const QString &interface);
 
+private:
+    static Interface parseInterface(const QString &name);
+    static QStringList parseInterfaceParentList(const QString &interface);
 };
 
 #endif // THINGUTILS_H
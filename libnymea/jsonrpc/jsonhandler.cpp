@@ -41,6 +41,11 @@ JsonHandler::JsonHandler(QObject *parent) : QObject(parent)
     registerEnum<BasicType>();
 }
 
+JsonHandler::~JsonHandler()
+{
+    qDeleteAll(m_packers);
+}
+
 QHash<QString, QString> JsonHandler::cacheHashes() const
 {
     return QHash<QString, QString>();
@@ -228,6 +233,7 @@ void JsonHandler::registerObject(const QMetaObject &metaObject)
     }
     m_objects.insert(className, description);
     m_metaObjects.insert(className, metaObject);
+    clearPackers();
 }
 
 void JsonHandler::registerObject(const QMetaObject &metaObject, const QMetaObject &listMetaObject)
@@ -245,6 +251,238 @@ void JsonHandler::registerObject(const QMetaObject &metaObject, const QMetaObjec
 }
 
 QVariant JsonHandler::pack(const QMetaObject &metaObject, const void *value) const
+{
+    return pack(packer(metaObject), value);
+}
+
+const JsonHandler::Packer *JsonHandler::packer(const QMetaObject &metaObject) const
+{
+    Packer *packer = m_packers.value(metaObject.className());
+    if (packer) {
+        return packer;
+    }
+
+    // Insert before resolving the properties, types may contain lists of themselves
+    packer = new Packer();
+    packer->metaObject = metaObject;
+    packer->className = QString(metaObject.className()).split("::").last();
+    m_packers.insert(metaObject.className(), packer);
+
+    if (m_listMetaObjects.contains(packer->className)) {
+        packer->registered = true;
+        packer->isList = true;
+        packer->entryPacker = this->packer(m_metaObjects.value(m_listEntryTypes.value(packer->className)));
+        packer->accessor = m_listAccessors.value(packer->className);
+        packer->countProperty = metaObject.property(metaObject.indexOfProperty("count"));
+        packer->getMethod = metaObject.method(metaObject.indexOfMethod("get(int)"));
+        return packer;
+    }
+
+    if (!m_metaObjects.contains(packer->className)) {
+        return packer;
+    }
+    packer->registered = true;
+
+    for (int i = 0; i < metaObject.propertyCount(); i++) {
+        QMetaProperty metaProperty = metaObject.property(i);
+
+        // Skip QObject's objectName property
+        if (metaProperty.name() == QStringLiteral("objectName")) {
+            continue;
+        }
+
+        PackerProperty property;
+        property.metaProperty = metaProperty;
+        property.name = metaProperty.name();
+        property.optional = metaProperty.isUser();
+
+        if (metaProperty.isFlagType()) {
+            QString flagName = QString(metaProperty.typeName()).split("::").last();
+            Q_ASSERT_X(m_metaFlags.contains(flagName), this->metaObject()->className(), QString("Cannot pack %1. %2 is not registered in this handler.").arg(packer->className).arg(flagName).toUtf8());
+            property.kind = PackerProperty::KindFlags;
+            property.metaEnum = m_metaFlags.value(flagName);
+        } else if (metaProperty.isEnumType()) {
+            QString enumName = QString(metaProperty.typeName()).split("::").last();
+            Q_ASSERT_X(m_metaEnums.contains(enumName), this->metaObject()->className(), QString("Cannot pack %1. %2 is not registered in this handler.").arg(packer->className).arg(metaProperty.typeName()).toUtf8());
+            property.kind = PackerProperty::KindEnum;
+            property.metaEnum = m_metaEnums.value(enumName);
+        } else if (metaProperty.typeName() == QStringLiteral("QVariant::Type")) {
+            property.kind = PackerProperty::KindBasicType;
+        } else if (metaProperty.type() == QVariant::UserType) {
+            QString propertyTypeName = QString(metaProperty.typeName()).split("::").last();
+            if (m_listMetaObjects.contains(propertyTypeName)) {
+                property.kind = PackerProperty::KindList;
+                property.packer = this->packer(m_listMetaObjects.value(propertyTypeName));
+            } else if (m_metaObjects.contains(propertyTypeName)) {
+                QMetaObject propertyMetaObject = m_metaObjects.value(propertyTypeName);
+                property.kind = PackerProperty::KindObject;
+                property.packer = this->packer(propertyMetaObject);
+                int isValidIndex = propertyMetaObject.indexOfMethod("isValid()");
+                if (isValidIndex >= 0) {
+                    property.isValidMethod = propertyMetaObject.method(isValidIndex);
+                }
+            } else if (propertyTypeName == "QList<int>") {
+                property.kind = PackerProperty::KindIntList;
+            } else if (propertyTypeName == "QList<QUuid>") {
+                property.kind = PackerProperty::KindUuidList;
+            } else if (propertyTypeName == "QList<EventTypeId>") {
+                property.kind = PackerProperty::KindEventTypeIdList;
+            } else if (propertyTypeName == "QList<StateTypeId>") {
+                property.kind = PackerProperty::KindStateTypeIdList;
+            } else if (propertyTypeName == "QList<ActionTypeId>") {
+                property.kind = PackerProperty::KindActionTypeIdList;
+            } else if (propertyTypeName == "QList<QDateTime>") {
+                property.kind = PackerProperty::KindDateTimeList;
+            } else {
+                Q_ASSERT_X(false, this->metaObject()->className(), QString("Unregistered property type: %1").arg(propertyTypeName).toUtf8());
+                property.kind = PackerProperty::KindUnhandled;
+            }
+        } else if (metaProperty.type() == QVariant::DateTime) {
+            property.kind = PackerProperty::KindDateTime;
+        } else if (metaProperty.type() == QVariant::Time) {
+            property.kind = PackerProperty::KindTime;
+        }
+        packer->properties.append(property);
+    }
+    return packer;
+}
+
+void JsonHandler::clearPackers()
+{
+    qDeleteAll(m_packers);
+    m_packers.clear();
+}
+
+QVariant JsonHandler::pack(const Packer *packer, const void *value) const
+{
+    if (packer->isList) {
+        QVariantList ret;
+        if (packer->accessor.count) {
+            int count = packer->accessor.count(value);
+            ret.reserve(count);
+            for (int i = 0; i < count; i++) {
+                ret.append(pack(packer->entryPacker, packer->accessor.entry(value, i)));
+            }
+        } else {
+            int count = packer->countProperty.readOnGadget(value).toInt();
+            for (int i = 0; i < count; i++) {
+                QVariant entry;
+                packer->getMethod.invokeOnGadget(const_cast<void*>(value), Q_RETURN_ARG(QVariant, entry), Q_ARG(int, i));
+                ret.append(pack(packer->entryPacker, entry.data()));
+            }
+        }
+        return ret;
+    }
+
+    if (!packer->registered) {
+        Q_ASSERT_X(false, this->metaObject()->className(), QString("Unregistered object type: %1").arg(packer->className).toUtf8());
+        qCWarning(dcJsonRpc()) << "Cannot pack object of unregistered type" << packer->className;
+        return QVariant();
+    }
+
+    QVariantMap ret;
+    foreach (const PackerProperty &property, packer->properties) {
+        QVariant propertyValue = property.metaProperty.readOnGadget(value);
+        // If it's optional and empty, we may skip it
+        if (property.optional && (!propertyValue.isValid() || propertyValue.isNull())) {
+            continue;
+        }
+
+        switch (property.kind) {
+        case PackerProperty::KindValue:
+            ret.insert(property.name, propertyValue);
+            break;
+        case PackerProperty::KindDateTime: {
+            QDateTime dateTime = propertyValue.toDateTime();
+            if (property.optional && dateTime.toTime_t() == 0) {
+                break;
+            }
+            ret.insert(property.name, dateTime.toTime_t());
+            break;
+        }
+        case PackerProperty::KindTime:
+            ret.insert(property.name, propertyValue.toTime().toString("hh:mm"));
+            break;
+        case PackerProperty::KindFlags: {
+            int flagValue = propertyValue.toInt();
+            QStringList flags;
+            for (int i = 0; i < property.metaEnum.keyCount(); i++) {
+                if ((property.metaEnum.value(i) & flagValue) > 0) {
+                    flags.append(property.metaEnum.key(i));
+                }
+            }
+            ret.insert(property.name, flags);
+            break;
+        }
+        case PackerProperty::KindEnum:
+            ret.insert(property.name, property.metaEnum.key(propertyValue.toInt()));
+            break;
+        case PackerProperty::KindBasicType:
+            ret.insert(property.name, QMetaEnum::fromType<BasicType>().key(variantTypeToBasicType(propertyValue.value<QVariant::Type>())));
+            break;
+        case PackerProperty::KindObject: {
+            bool isValid = true;
+            if (property.isValidMethod.isValid()) {
+                property.isValidMethod.invokeOnGadget(propertyValue.data(), Q_RETURN_ARG(bool, isValid));
+            }
+            if (isValid || !property.optional) {
+                ret.insert(property.name, pack(property.packer, propertyValue.data()));
+            }
+            break;
+        }
+        case PackerProperty::KindList: {
+            QVariant packed = pack(property.packer, propertyValue.data());
+            if (!property.optional || packed.toList().count() > 0) {
+                ret.insert(property.name, packed);
+            }
+            break;
+        }
+        case PackerProperty::KindIntList:
+        case PackerProperty::KindUuidList:
+        case PackerProperty::KindEventTypeIdList:
+        case PackerProperty::KindStateTypeIdList:
+        case PackerProperty::KindActionTypeIdList:
+        case PackerProperty::KindDateTimeList: {
+            QVariantList list;
+            if (property.kind == PackerProperty::KindIntList) {
+                foreach (int entry, propertyValue.value<QList<int>>()) {
+                    list << entry;
+                }
+            } else if (property.kind == PackerProperty::KindUuidList) {
+                foreach (const QUuid &entry, propertyValue.value<QList<QUuid>>()) {
+                    list << entry;
+                }
+            } else if (property.kind == PackerProperty::KindEventTypeIdList) {
+                foreach (const EventTypeId &entry, propertyValue.value<QList<EventTypeId>>()) {
+                    list << entry;
+                }
+            } else if (property.kind == PackerProperty::KindStateTypeIdList) {
+                foreach (const StateTypeId &entry, propertyValue.value<QList<StateTypeId>>()) {
+                    list << entry;
+                }
+            } else if (property.kind == PackerProperty::KindActionTypeIdList) {
+                foreach (const ActionTypeId &entry, propertyValue.value<QList<ActionTypeId>>()) {
+                    list << entry;
+                }
+            } else {
+                foreach (const QDateTime &timestamp, propertyValue.value<QList<QDateTime>>()) {
+                    list << timestamp.toMSecsSinceEpoch() / 1000;
+                }
+            }
+            if (!list.isEmpty() || !property.optional) {
+                ret.insert(property.name, list);
+            }
+            break;
+        }
+        case PackerProperty::KindUnhandled:
+            qCWarning(dcJsonRpc()) << "Cannot pack property of unregistered object type" << property.metaProperty.typeName();
+            break;
+        }
+    }
+    return ret;
+}
+
+QVariant JsonHandler::packReflective(const QMetaObject &metaObject, const void *value) const
 {
     QString className = QString(metaObject.className()).split("::").last();
     if (m_listMetaObjects.contains(className)) {
@@ -256,7 +494,7 @@ QVariant JsonHandler::pack(const QMetaObject &metaObject, const void *value) con
         for (int i = 0; i < count; i++) {
             QVariant entry;
             getMethod.invokeOnGadget(const_cast<void*>(value), Q_RETURN_ARG(QVariant, entry), Q_ARG(int, i));
-            ret.append(pack(entryMetaObject, entry.data()));
+            ret.append(packReflective(entryMetaObject, entry.data()));
         }
         return ret;
     }
@@ -314,7 +552,7 @@ QVariant JsonHandler::pack(const QMetaObject &metaObject, const void *value) con
                 QString propertyTypeName = QString(metaProperty.typeName()).split("::").last();
                 if (m_listMetaObjects.contains(propertyTypeName)) {
                     QMetaObject entryMetaObject = m_listMetaObjects.value(propertyTypeName);
-                    QVariant packed = pack(entryMetaObject, propertyValue.data());
+                    QVariant packed = packReflective(entryMetaObject, propertyValue.data());
                     if (!metaProperty.isUser() || packed.toList().count() > 0) {
                         ret.insert(metaProperty.name(), packed);
                     }
@@ -323,7 +561,7 @@ QVariant JsonHandler::pack(const QMetaObject &metaObject, const void *value) con
 
                 if (m_metaObjects.contains(propertyTypeName)) {
                     QMetaObject entryMetaObject = m_metaObjects.value(propertyTypeName);
-                    QVariant packed = pack(entryMetaObject, propertyValue.data());
+                    QVariant packed = packReflective(entryMetaObject, propertyValue.data());
                     int isValidIndex = entryMetaObject.indexOfMethod("isValid()");
                     bool isValid = true;
                     if (isValidIndex >= 0) {
@@ -37,6 +37,9 @@
 #include <QDebug>
 #include <QVariant>
 #include <QDateTime>
+#include <QVector>
+
+#include <type_traits>
 
 #include "jsonreply.h"
 #include "jsoncontext.h"
@@ -61,7 +64,7 @@ public:
     Q_ENUM(BasicType)
 
     explicit JsonHandler(QObject *parent = nullptr);
-    virtual ~JsonHandler() = default;
+    virtual ~JsonHandler();
 
     virtual QString name() const = 0;
     virtual QHash<QString, QString> cacheHashes() const;
@@ -89,6 +92,10 @@ public:
     template<typename T> QVariant pack(T *value) const;
     template <typename T> T unpack(const QVariant &value) const;
 
+    // Packs by walking the meta object on every call. Only meant to verify and benchmark the cached packers used by pack().
+    template<typename T> QVariant packReflective(const T &value) const;
+    template<typename T> QVariant packReflective(T *value) const;
+
 protected:
     template <typename Enum> void registerEnum();
     template <typename Enum, typename Flags> void registerEnum();
@@ -112,10 +119,73 @@ protected:
     JsonReply *createAsyncReply(const QString &method) const;
 
 private:
+    typedef int (*ListCountFunction)(const void *list);
+    typedef const void *(*ListEntryFunction)(const void *list, int index);
+    struct ListAccessor {
+        ListCountFunction count = nullptr;
+        ListEntryFunction entry = nullptr;
+    };
+
+    // Packing instructions for a registered type, resolved from its meta object on first use. Packing still reads
+    // the properties through the meta system and builds QVariants, this only saves the lookups on every call.
+    struct Packer;
+    struct PackerProperty {
+        enum Kind {
+            KindValue,
+            KindDateTime,
+            KindTime,
+            KindFlags,
+            KindEnum,
+            KindBasicType,
+            KindObject,
+            KindList,
+            KindIntList,
+            KindUuidList,
+            KindEventTypeIdList,
+            KindStateTypeIdList,
+            KindActionTypeIdList,
+            KindDateTimeList,
+            KindUnhandled
+        };
+        Kind kind = KindValue;
+        QMetaProperty metaProperty;
+        QString name;
+        bool optional = false;
+        QMetaEnum metaEnum;
+        const Packer *packer = nullptr;
+        QMetaMethod isValidMethod;
+    };
+    struct Packer {
+        QMetaObject metaObject;
+        QString className;
+        bool registered = false;
+        bool isList = false;
+        QVector<PackerProperty> properties;
+        // Lists
+        const Packer *entryPacker = nullptr;
+        ListAccessor accessor;
+        QMetaProperty countProperty;
+        QMetaMethod getMethod;
+    };
+
     void registerObject(const QMetaObject &metaObject);
     void registerObject(const QMetaObject &metaObject, const QMetaObject &listMetaObject);
 
+    // Lists deriving from QList<ObjectType> are read directly instead of through their get(int) method
+    template <typename ObjectType, typename ListType> void registerListAccessor(const QMetaObject &listMetaObject);
+    template <typename ListType> void registerListAccessor(const QMetaObject &listMetaObject, std::true_type);
+    template <typename ListType> void registerListAccessor(const QMetaObject &listMetaObject, std::false_type);
+    template <typename ListType> static int listCount(const void *list);
+    template <typename ListType> static const void *listEntry(const void *list, int index);
+    template <typename T> static const void *entryAddress(const T &entry);
+    template <typename T> static const void *entryAddress(T *entry);
+
+    const Packer *packer(const QMetaObject &metaObject) const;
+    void clearPackers();
+
     QVariant pack(const QMetaObject &metaObject, const void *gadget) const;
+    QVariant pack(const Packer *packer, const void *gadget) const;
+    QVariant packReflective(const QMetaObject &metaObject, const void *gadget) const;
     QVariant unpack(const QMetaObject &metaObject, const QVariant &value) const;
 
 private:
@@ -128,6 +198,9 @@ private:
     QHash<QString, QMetaObject> m_metaObjects;
     QHash<QString, QMetaObject> m_listMetaObjects;
     QHash<QString, QString> m_listEntryTypes;
+    QHash<QString, ListAccessor> m_listAccessors;
+    // By the class name pointer, which is shared by all copies of a static meta object
+    mutable QHash<const char *, Packer*> m_packers;
     QVariantMap m_methods;
     QVariantMap m_notifications;
 };
@@ -172,6 +245,7 @@ void JsonHandler::registerObject()
     QMetaObject metaObject = ObjectType::staticMetaObject;
     QMetaObject listMetaObject = ListType::staticMetaObject;
     registerObject(metaObject, listMetaObject);
+    registerListAccessor<ObjectType, ListType>(listMetaObject);
 }
 
 template<typename ObjectType>
@@ -187,6 +261,52 @@ void JsonHandler::registerUncreatableObject()
     QMetaObject metaObject = ObjectType::staticMetaObject;
     QMetaObject listMetaObject = ListType::staticMetaObject;
     registerObject(metaObject, listMetaObject);
+    registerListAccessor<ObjectType, ListType>(listMetaObject);
+}
+
+template<typename ObjectType, typename ListType>
+void JsonHandler::registerListAccessor(const QMetaObject &listMetaObject)
+{
+    registerListAccessor<ListType>(listMetaObject, std::integral_constant<bool, std::is_base_of<QList<ObjectType>, ListType>::value || std::is_base_of<QList<ObjectType*>, ListType>::value>());
+}
+
+template<typename ListType>
+void JsonHandler::registerListAccessor(const QMetaObject &listMetaObject, std::true_type)
+{
+    ListAccessor accessor;
+    accessor.count = &listCount<ListType>;
+    accessor.entry = &listEntry<ListType>;
+    m_listAccessors.insert(QString(listMetaObject.className()).split("::").last(), accessor);
+}
+
+template<typename ListType>
+void JsonHandler::registerListAccessor(const QMetaObject &listMetaObject, std::false_type)
+{
+    Q_UNUSED(listMetaObject)
+}
+
+template<typename ListType>
+int JsonHandler::listCount(const void *list)
+{
+    return static_cast<const ListType*>(list)->count();
+}
+
+template<typename ListType>
+const void *JsonHandler::listEntry(const void *list, int index)
+{
+    return entryAddress(static_cast<const ListType*>(list)->at(index));
+}
+
+template<typename T>
+const void *JsonHandler::entryAddress(const T &entry)
+{
+    return &entry;
+}
+
+template<typename T>
+const void *JsonHandler::entryAddress(T *entry)
+{
+    return entry;
 }
 
 template<typename ListType, typename BasicTypeName>
@@ -243,6 +363,20 @@ QVariant JsonHandler::pack(T *value) const
     return pack(metaObject, static_cast<const void*>(value));
 }
 
+template<typename T>
+QVariant JsonHandler::packReflective(const T &value) const
+{
+    QMetaObject metaObject = T::staticMetaObject;
+    return packReflective(metaObject, static_cast<const void*>(&value));
+}
+
+template<typename T>
+QVariant JsonHandler::packReflective(T *value) const
+{
+    QMetaObject metaObject = T::staticMetaObject;
+    return packReflective(metaObject, static_cast<const void*>(value));
+}
+
 template<typename T>
 T JsonHandler::unpack(const QVariant &value) const
 {
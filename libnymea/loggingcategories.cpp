@@ -33,6 +33,12 @@
 #include <QDir>
 #include <QDateTime>
 #include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+
+#include <atomic>
+#include <memory>
 
 QStringList& nymeaLoggingCategories() {
     static QStringList _nymeaLoggingCategories;
@@ -89,6 +95,247 @@ static const char *const normal = "\033[0m";
 static const char *const warning = "\033[33m";
 static const char *const error = "\033[31m";
 
+struct LogEntry {
+    QtMsgType type = QtDebugMsg;
+    qint64 timestamp = 0;
+    QByteArray category;
+    QString message;
+};
+
+static void formatLogEntry(const LogEntry &entry, QByteArray *console, QByteArray *file)
+{
+    QByteArray category = entry.category;
+    QByteArray message = entry.message.toUtf8();
+    QByteArray timeString = QDateTime::fromMSecsSinceEpoch(entry.timestamp).toString("yyyy.MM.dd hh:mm:ss.zzz").toUtf8();
+    switch (entry.type) {
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 5, 0))
+    case QtInfoMsg:
+#endif
+    case QtDebugMsg:
+        file->append(" I " + timeString + " | " + category + ": " + message + "\n");
+        console->append(" I | " + category + ": " + message + "\n");
+        break;
+    case QtWarningMsg:
+        file->append(" W " + timeString + " | " + category + ": " + message + "\n");
+        console->append(QByteArray(s_useColors ? warning : "") + " W | " + category + ": " + message + (s_useColors ? normal : "") + "\n");
+        break;
+    case QtCriticalMsg:
+        file->append(" C " + timeString + " | " + category + ": " + message + "\n");
+        console->append(QByteArray(s_useColors ? error : "") + " C | " + category + ": " + message + (s_useColors ? error : "") + "\n");
+        break;
+    case QtFatalMsg:
+        file->append(" F " + timeString + " | " + category + ": " + message + "\n");
+        console->append(QByteArray(s_useColors ? error : "") + " F | " + category + ": " + message + (s_useColors ? error : "") + "\n");
+        break;
+    }
+}
+
+static void writeLogOutput(const QByteArray &console, const QByteArray &file)
+{
+    fwrite(console.constData(), 1, static_cast<size_t>(console.size()), stdout);
+    fflush(stdout);
+
+    QMutexLocker locker(&s_loggerMutex);
+    if (s_logFile.isOpen()) {
+        s_logFile.write(file);
+        s_logFile.flush();
+    }
+}
+
+// Writes log messages on a dedicated thread so logging never blocks the calling thread on stdout or the log file.
+// Messages are passed through a bounded multi producer, single consumer ring buffer. If the writer can't keep up,
+// new messages are dropped and the number of dropped messages is logged once there is room again.
+class LogWriter: public QThread
+{
+public:
+    explicit LogWriter(int capacity):
+        m_capacity(static_cast<quint64>(capacity)),
+        m_slots(new Slot[static_cast<size_t>(capacity)])
+    {
+        Q_ASSERT_X((capacity & (capacity - 1)) == 0, "LogWriter", "The capacity must be a power of 2");
+        for (quint64 i = 0; i < m_capacity; i++) {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~LogWriter() override
+    {
+        stop();
+    }
+
+    bool active() const
+    {
+        return m_active.load(std::memory_order_acquire);
+    }
+
+    void begin()
+    {
+        m_active.store(true);
+        start();
+    }
+
+    // Disables the writer and writes out the queued messages. Messages logged afterwards are written synchronously.
+    void stop()
+    {
+        if (!m_active.exchange(false)) {
+            return;
+        }
+        wakeUp();
+        drain();
+    }
+
+    // Writes out messages which have been queued by producers that still saw the writer active while it was
+    // stopped. Waits for the writer thread to finish first, as only one thread may consume the ring at a time.
+    void drain()
+    {
+        wait();
+        QMutexLocker locker(&m_drainMutex);
+        while (writeQueued() > 0) { }
+    }
+
+    bool enqueue(QtMsgType type, const char *category, const QString &message)
+    {
+        quint64 position = m_enqueuePosition.load(std::memory_order_relaxed);
+        Slot *slot = nullptr;
+        forever {
+            slot = &m_slots[position & (m_capacity - 1)];
+            quint64 sequence = slot->sequence.load(std::memory_order_acquire);
+            qint64 diff = static_cast<qint64>(sequence - position);
+            if (diff == 0) {
+                if (m_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                m_droppedMessages.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                position = m_enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->entry.type = type;
+        slot->entry.timestamp = QDateTime::currentMSecsSinceEpoch();
+        slot->entry.category = category;
+        slot->entry.message = message;
+        slot->sequence.store(position + 1);
+
+        if (m_sleeping.load()) {
+            wakeUp();
+        }
+        return true;
+    }
+
+    // Blocks until everything queued so far has been written, used before aborting on fatal messages
+    void flush()
+    {
+        quint64 position = m_enqueuePosition.load();
+        QElapsedTimer timer;
+        timer.start();
+        while (m_writtenPosition.load() < position && !timer.hasExpired(1000)) {
+            wakeUp();
+            QThread::yieldCurrentThread();
+        }
+    }
+
+protected:
+    void run() override
+    {
+        forever {
+            if (writeQueued() > 0) {
+                continue;
+            }
+
+            if (!m_active.load()) {
+                // Drained, and no one is adding new messages any more
+                return;
+            }
+
+            QMutexLocker locker(&m_mutex);
+            m_sleeping.store(true);
+            if (!pending() && m_active.load()) {
+                m_wakeUp.wait(&m_mutex, 100);
+            }
+            m_sleeping.store(false);
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<quint64> sequence;
+        LogEntry entry;
+    };
+
+    // Writes a batch of queued messages along with the number of dropped ones. Returns the number of messages written.
+    int writeQueued()
+    {
+        static const int maxBatchSize = 256;
+
+        QByteArray console;
+        QByteArray file;
+        int count = 0;
+        LogEntry entry;
+        while (count < maxBatchSize && dequeue(&entry)) {
+            formatLogEntry(entry, &console, &file);
+            count++;
+        }
+
+        quint64 dropped = m_droppedMessages.exchange(0);
+        if (dropped > 0) {
+            LogEntry droppedEntry;
+            droppedEntry.type = QtWarningMsg;
+            droppedEntry.timestamp = QDateTime::currentMSecsSinceEpoch();
+            droppedEntry.category = "Logging";
+            droppedEntry.message = QString("Log buffer full. Dropped %1 messages.").arg(dropped);
+            formatLogEntry(droppedEntry, &console, &file);
+        }
+
+        if (!console.isEmpty()) {
+            writeLogOutput(console, file);
+            m_writtenPosition.store(m_dequeuePosition);
+        }
+        return count;
+    }
+
+    bool pending() const
+    {
+        const Slot &slot = m_slots[m_dequeuePosition & (m_capacity - 1)];
+        return slot.sequence.load() == m_dequeuePosition + 1;
+    }
+
+    bool dequeue(LogEntry *entry)
+    {
+        if (!pending()) {
+            return false;
+        }
+        Slot &slot = m_slots[m_dequeuePosition & (m_capacity - 1)];
+        *entry = slot.entry;
+        slot.entry = LogEntry();
+        slot.sequence.store(m_dequeuePosition + m_capacity, std::memory_order_release);
+        m_dequeuePosition++;
+        return true;
+    }
+
+    void wakeUp()
+    {
+        QMutexLocker locker(&m_mutex);
+        m_wakeUp.wakeOne();
+    }
+
+    const quint64 m_capacity;
+    std::unique_ptr<Slot[]> m_slots;
+    std::atomic<quint64> m_enqueuePosition{0};
+    quint64 m_dequeuePosition = 0;
+    std::atomic<quint64> m_writtenPosition{0};
+    std::atomic<quint64> m_droppedMessages{0};
+    std::atomic<bool> m_active{false};
+    std::atomic<bool> m_sleeping{false};
+    QMutex m_mutex;
+    QMutex m_drainMutex;
+    QWaitCondition m_wakeUp;
+};
+
+static LogWriter s_logWriter(8192);
+
 void nymeaInstallMessageHandler(QtMessageHandler handler)
 {
     s_handlers.append(handler);
@@ -106,39 +353,28 @@ void nymeaLogMessageHandler(QtMsgType type, const QMessageLogContext &context, c
         handler(type, context, message);
     }
 
-    QString messageString;
-    QString timeString = QDateTime::currentDateTime().toString("yyyy.MM.dd hh:mm:ss.zzz");
-    switch (type) {
-#if (QT_VERSION >= QT_VERSION_CHECK(5, 5, 0))
-    case QtInfoMsg:
-        messageString = QString(" I %1 | %2: %3").arg(timeString).arg(context.category).arg(message);
-        fprintf(stdout, " I | %s: %s\n", context.category, message.toUtf8().data());
-        break;
-#endif
-    case QtDebugMsg:
-        messageString = QString(" I %1 | %2: %3").arg(timeString).arg(context.category).arg(message);
-        fprintf(stdout, " I | %s: %s\n", context.category, message.toUtf8().data());
-        break;
-    case QtWarningMsg:
-        messageString = QString(" W %1 | %2: %3").arg(timeString).arg(context.category).arg(message);
-        fprintf(stdout, "%s W | %s: %s%s\n", s_useColors ? warning : "", context.category, message.toUtf8().data(), s_useColors ? normal : "");
-        break;
-    case QtCriticalMsg:
-        messageString = QString(" C %1 | %2: %3").arg(timeString).arg(context.category).arg(message);
-        fprintf(stdout, "%s C | %s: %s%s\n", s_useColors ? error : "", context.category, message.toUtf8().data(), s_useColors ? error : "");
-        break;
-    case QtFatalMsg:
-        messageString = QString(" F %1 | %2: %3").arg(timeString).arg(context.category).arg(message);
-        fprintf(stdout, "%s F | %s: %s%s\n", s_useColors ? error : "", context.category, message.toUtf8().data(), s_useColors ? error: "");
-        break;
+    if (s_logWriter.active() && type != QtFatalMsg) {
+        s_logWriter.enqueue(type, context.category, message);
+        // The writer might have been stopped meanwhile and its thread might not pick up this message any more
+        if (!s_logWriter.active()) {
+            s_logWriter.drain();
+        }
+        return;
     }
-    fflush(stdout);
 
-    QMutexLocker locker(&s_loggerMutex);
-    if (s_logFile.isOpen()) {
-        QTextStream textStream(&s_logFile);
-        textStream << messageString << endl;
+    // Fatal messages are written right away, the application is about to abort
+    if (s_logWriter.active()) {
+        s_logWriter.flush();
     }
+    LogEntry entry;
+    entry.type = type;
+    entry.timestamp = QDateTime::currentMSecsSinceEpoch();
+    entry.category = context.category;
+    entry.message = message;
+    QByteArray console;
+    QByteArray file;
+    formatLogEntry(entry, &console, &file);
+    writeLogOutput(console, file);
 }
 
 bool initLogging(const QString &fileName, bool useColors)
@@ -160,11 +396,16 @@ bool initLogging(const QString &fileName, bool useColors)
             return false;
         }
     }
+
+    s_logWriter.begin();
     return true;
 }
 
 void closeLogFile()
 {
+    s_logWriter.stop();
+
+    QMutexLocker locker(&s_loggerMutex);
     if (s_logFile.isOpen()) {
         s_logFile.close();
     }
@@ -34,6 +34,7 @@
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QFileInfo>
+#include <QUuid>
 #include <QTimer>
 #include <QSqlDatabase>
 #include <QStandardPaths>
@@ -66,8 +67,7 @@ MacAddressDatabase::MacAddressDatabase(QObject *parent) : QObject(parent)
 
     m_available = initDatabase();
     if (m_available) {
-        m_futureWatcher = new QFutureWatcher<QString>(this);
-        connect(m_futureWatcher, &QFutureWatcher<QString>::finished, this, &MacAddressDatabase::onLookupFinished);
+        loadOuiTable();
     }
 }
 
@@ -77,13 +77,16 @@ MacAddressDatabase::MacAddressDatabase(const QString &databaseName, QObject *par
 {
     m_available = initDatabase();
     if (m_available) {
-        m_futureWatcher = new QFutureWatcher<QString>(this);
-        connect(m_futureWatcher, &QFutureWatcher<QString>::finished, this, &MacAddressDatabase::onLookupFinished);
+        loadOuiTable();
     }
 }
 
 MacAddressDatabase::~MacAddressDatabase()
 {
+    if (m_futureWatcher) {
+        m_futureWatcher->waitForFinished();
+    }
+
     m_db.close();
     m_db = QSqlDatabase();
     QSqlDatabase::removeDatabase(m_connectionName);
@@ -105,11 +108,56 @@ MacAddressDatabaseReply *MacAddressDatabase::lookupMacAddress(const QString &mac
         return reply;
     }
 
+    // Answer in the next event loop to give the user time to do the reply connects
     m_pendingReplies.enqueue(reply);
-    runNextLookup();
+    if (m_ouiTableLoaded) {
+        QTimer::singleShot(0, this, &MacAddressDatabase::onOuiTableLoaded);
+    }
     return reply;
 }
 
+QString MacAddressDatabase::lookupManufacturer(const QString &macAddress)
+{
+    if (!m_available)
+        return QString();
+
+    waitForOuiTable();
+
+    // Accept any of the usual notations, the OUI table holds the plain upper case hex digits
+    QString hexString = QString(macAddress).toUpper().remove(':').remove('-').remove('.');
+    int digits = hexString.length();
+    if (digits < 6 || digits > 12)
+        return QString();
+
+    bool ok = false;
+    quint64 address = hexString.leftJustified(12, '0').toULongLong(&ok, 16);
+    if (!ok)
+        return QString();
+
+    // The longest registered prefix wins, only consider prefixes covered by the given digits
+    int companyIndex = -1;
+    if (digits >= 9)
+        companyIndex = m_ouiTable.prefixes36.value(address >> 12, -1);
+
+    if (companyIndex < 0 && digits >= 7)
+        companyIndex = m_ouiTable.prefixes28.value(static_cast<quint32>(address >> 20), -1);
+
+    if (companyIndex < 0)
+        companyIndex = m_ouiTable.prefixes24.value(static_cast<quint32>(address >> 24), -1);
+
+    return m_ouiTable.companyNames.value(companyIndex);
+}
+
+QStringList MacAddressDatabase::lookupManufacturers(const QStringList &macAddresses)
+{
+    QStringList manufacturers;
+    manufacturers.reserve(macAddresses.count());
+    foreach (const QString &macAddress, macAddresses) {
+        manufacturers.append(lookupManufacturer(macAddress));
+    }
+    return manufacturers;
+}
+
 bool MacAddressDatabase::initDatabase()
 {
     qCDebug(dcMacAddressDatabase()) << "Starting to initialize the mac address database:" << m_databaseName;
@@ -143,81 +191,93 @@ bool MacAddressDatabase::initDatabase()
     return true;
 }
 
-void MacAddressDatabase::runNextLookup()
+void MacAddressDatabase::loadOuiTable()
 {
-    if (m_pendingReplies.isEmpty())
-        return;
-
-    if (m_futureWatcher->isRunning() || m_currentReply)
-        return;
+    // The database connection is only used for validating, the worker opens its own one
+    m_db.close();
 
-    m_currentReply = m_pendingReplies.dequeue();
-    m_currentReply->m_startTimestamp = QDateTime::currentMSecsSinceEpoch();
-    QFuture<QString> future = QtConcurrent::run(this, &MacAddressDatabase::lookupMacAddressVendorInternal, m_currentReply->macAddress());
-    m_futureWatcher->setFuture(future);
+    m_futureWatcher = new QFutureWatcher<OuiTable>(this);
+    connect(m_futureWatcher, &QFutureWatcher<OuiTable>::finished, this, &MacAddressDatabase::onOuiTableLoaded);
+    m_futureWatcher->setFuture(QtConcurrent::run(&MacAddressDatabase::readOuiTable, m_databaseName));
 }
 
-void MacAddressDatabase::onLookupFinished()
+void MacAddressDatabase::waitForOuiTable()
 {
-    if (m_currentReply) {
-        QString manufacturer = m_futureWatcher->future().result();
-        qCDebug(dcMacAddressDatabase()) << "Manufacturer lookup for" << m_currentReply->macAddress() << "finished:" << manufacturer << QDateTime::currentMSecsSinceEpoch() - m_currentReply->m_startTimestamp << "ms";
-        m_currentReply->m_manufacturer = manufacturer;
-        emit m_currentReply->finished();
-        m_currentReply = nullptr;
-    }
+    if (m_ouiTableLoaded)
+        return;
 
-    runNextLookup();
+    m_futureWatcher->waitForFinished();
+    onOuiTableLoaded();
 }
 
-QString MacAddressDatabase::lookupMacAddressVendorInternal(const QString &macAddress)
+MacAddressDatabase::OuiTable MacAddressDatabase::readOuiTable(const QString &databaseName)
 {
-    qCDebug(dcMacAddressDatabase()) << "Start looking up vendor for" << macAddress;
-    // Convert the mac address string to upper like in the database and remove : since they have been removed for size reasons
-    QString fullMacAddressString = QString(macAddress).toUpper().remove(":");
-
-    QString manufacturer;
-    int length = 6;
-    while (true) {
-        QString searchString = fullMacAddressString.left(length);
-        QString queryString = QString("SELECT COUNT(oui) FROM oui WHERE oui LIKE \'%1%\';").arg(searchString);
-        qCDebug(dcMacAddressDatabase()) << "Query:" << queryString;
-        QSqlQuery countQuery = m_db.exec(queryString);
-        if (countQuery.lastError().isValid()) {
-            qCWarning(dcMacAddressDatabase()) << "Query finished with error" << countQuery.lastError().text();
-            break;
+    qint64 startTimestamp = QDateTime::currentMSecsSinceEpoch();
+    OuiTable table;
+
+    // Several instances may load the table at the same time, each worker needs its own connection
+    QString connectionName = QFileInfo(databaseName).baseName() + "-loader-" + QUuid::createUuid().toString();
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), connectionName);
+        db.setDatabaseName(databaseName);
+        if (!db.open()) {
+            qCWarning(dcMacAddressDatabase()) << "Could not open database" << databaseName << "for loading the OUI table:" << db.lastError().text();
+        } else {
+            QHash<qint64, int> companyIndices;
+            QSqlQuery companyQuery(QStringLiteral("SELECT rowid, companyName FROM companyNames;"), db);
+            while (companyQuery.next()) {
+                companyIndices.insert(companyQuery.value(0).toLongLong(), table.companyNames.count());
+                table.companyNames.append(companyQuery.value(1).toString());
+            }
+
+            QSqlQuery ouiQuery(QStringLiteral("SELECT oui, companyNameIndex FROM oui;"), db);
+            while (ouiQuery.next()) {
+                QString oui = ouiQuery.value(0).toString();
+                int companyIndex = companyIndices.value(ouiQuery.value(1).toLongLong(), -1);
+                bool ok = false;
+                quint64 prefix = oui.toULongLong(&ok, 16);
+                if (!ok || companyIndex < 0) {
+                    qCDebug(dcMacAddressDatabase()) << "Skipping invalid OUI entry" << oui;
+                    continue;
+                }
+
+                switch (oui.length()) {
+                case 6:
+                    table.prefixes24.insert(static_cast<quint32>(prefix), companyIndex);
+                    break;
+                case 7:
+                    table.prefixes28.insert(static_cast<quint32>(prefix), companyIndex);
+                    break;
+                case 9:
+                    table.prefixes36.insert(prefix, companyIndex);
+                    break;
+                default:
+                    qCDebug(dcMacAddressDatabase()) << "Skipping OUI entry with unsupported prefix length" << oui;
+                    break;
+                }
+            }
         }
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(connectionName);
 
-        if (!countQuery.next())
-            break;
-
-        int rowCount = countQuery.value(0).toInt();
-        qCDebug(dcMacAddressDatabase()) << "Found" << rowCount << "with" << searchString;
-        // If we have found the one...
-        if (rowCount == 1) {
-            // Query the name
-            queryString = QString("SELECT companyName from companyNames WHERE rowid IS (SELECT companyNameIndex FROM oui WHERE oui=\'%1\');").arg(searchString);
-            qCDebug(dcMacAddressDatabase()) << "Query:" << queryString;
-            countQuery = m_db.exec(queryString);
-            if (!countQuery.next())
-                break;
-
-            manufacturer = countQuery.value(0).toString();
-            break;
-        }
-
-        // If nothing found
-        if (rowCount == 0)
-            break;
-
-        // Found to many results, lets add a value until we find the matching vendor
-        length += 1;
-        if (length > fullMacAddressString.length())
-            break;
+    qCDebug(dcMacAddressDatabase()) << "Loaded" << table.prefixes24.count() + table.prefixes28.count() + table.prefixes36.count()
+                                    << "OUI prefixes of" << table.companyNames.count() << "companies in"
+                                    << QDateTime::currentMSecsSinceEpoch() - startTimestamp << "ms";
+    return table;
+}
 
-        // Search with one addition digit
+void MacAddressDatabase::onOuiTableLoaded()
+{
+    if (!m_ouiTableLoaded) {
+        m_ouiTable = m_futureWatcher->result();
+        m_ouiTableLoaded = true;
     }
 
-    return manufacturer;
+    while (!m_pendingReplies.isEmpty()) {
+        MacAddressDatabaseReply *reply = m_pendingReplies.dequeue();
+        reply->m_manufacturer = lookupManufacturer(reply->macAddress());
+        qCDebug(dcMacAddressDatabase()) << "Manufacturer lookup for" << reply->macAddress() << "finished:" << reply->m_manufacturer;
+        emit reply->finished();
+    }
 }
-
@@ -31,10 +31,12 @@
 #ifndef MACADDRESSDATABASE_H
 #define MACADDRESSDATABASE_H
 
+#include <QHash>
 #include <QQueue>
 #include <QObject>
 #include <QSqlDatabase>
 #include <QFutureWatcher>
+#include <QStringList>
 
 #include "libnymea.h"
 
@@ -71,22 +73,36 @@ public:
 
     MacAddressDatabaseReply *lookupMacAddress(const QString &macAddress);
 
+    QString lookupManufacturer(const QString &macAddress);
+    QStringList lookupManufacturers(const QStringList &macAddresses);
+
 private:
+    // The OUI registry in memory. MA-L, MA-M and MA-S assignments map their 24, 28 and 36 bit
+    // prefix to an index in companyNames.
+    struct OuiTable {
+        QHash<quint32, int> prefixes24;
+        QHash<quint32, int> prefixes28;
+        QHash<quint64, int> prefixes36;
+        QStringList companyNames;
+    };
+
     QSqlDatabase m_db;
     bool m_available = false;
     QString m_connectionName;
     QString m_databaseName = "/usr/share/nymea/mac-addresses.db";
 
-    MacAddressDatabaseReply *m_currentReply = nullptr;
-    QFutureWatcher<QString> *m_futureWatcher = nullptr;
+    OuiTable m_ouiTable;
+    bool m_ouiTableLoaded = false;
+    QFutureWatcher<OuiTable> *m_futureWatcher = nullptr;
     QQueue<MacAddressDatabaseReply *> m_pendingReplies;
 
     bool initDatabase();
-    void runNextLookup();
+    void loadOuiTable();
+    void waitForOuiTable();
+    static OuiTable readOuiTable(const QString &databaseName);
 
 private slots:
-    void onLookupFinished();
-    QString lookupMacAddressVendorInternal(const QString &macAddress);
+    void onOuiTableLoaded();
 
 };
 
@@ -62,7 +62,7 @@ NetworkDeviceDiscovery::NetworkDeviceDiscovery(QObject *parent) :
     m_discoveryTimer->setInterval(20000);
     m_discoveryTimer->setSingleShot(true);
     connect(m_discoveryTimer, &QTimer::timeout, this, [=](){
-        if (m_runningPingRepies.isEmpty() && m_currentReply) {
+        if (m_runningPingRepies.isEmpty() && m_pendingPingAddresses.isEmpty() && m_currentReply) {
             finishDiscovery();
         }
     });
@@ -146,48 +146,63 @@ void NetworkDeviceDiscovery::pingAllNetworkDevices()
             quint32 addressRangeStop = entry.broadcast().toIPv4Address() | addressRangeStart;
             quint32 range = addressRangeStop - addressRangeStart;
 
-            // Let's scan only 255.255.255.0 networks for now
-            if (range > 255)
+            // Scan networks up to 255.255.0.0, anything bigger would take too long
+            if (range > 65535) {
+                qCDebug(dcNetworkDeviceDiscovery()) << "    Skipping network" << entry.ip().toString() << "with netmask" << entry.netmask().toString() << "because it is too large.";
                 continue;
+            }
 
             qCDebug(dcNetworkDeviceDiscovery()) << "    Address range" << range << " | from" << QHostAddress(addressRangeStart).toString() << "-->" << QHostAddress(addressRangeStop).toString();
-            // Send ping request to each address within the range
+            // Queue a ping request for each address within the range
             for (quint32 i = 1; i < range; i++) {
-                quint32 address = addressRangeStart + i;
-                QHostAddress targetAddress(address);
+                QHostAddress targetAddress(addressRangeStart + i);
 
                 // Skip our self
                 if (targetAddress == entry.ip())
                     continue;
 
-                PingReply *reply = m_ping->ping(targetAddress);
-                m_runningPingRepies.append(reply);
-                connect(reply, &PingReply::finished, this, [=](){
-                    m_runningPingRepies.removeAll(reply);
-                    if (reply->error() == PingReply::ErrorNoError) {
-                        qCDebug(dcNetworkDeviceDiscovery()) << "Ping response from" << targetAddress.toString() << reply->hostName() << reply->duration() << "ms";
-                        int index = m_currentReply->networkDeviceInfos().indexFromHostAddress(targetAddress);
-                        if (index < 0) {
-                            // Add the network device
-                            NetworkDeviceInfo networkDeviceInfo;
-                            networkDeviceInfo.setAddress(targetAddress);
-                            networkDeviceInfo.setHostName(reply->hostName());
-                            m_currentReply->networkDeviceInfos().append(networkDeviceInfo);
-                        } else {
-                            m_currentReply->networkDeviceInfos()[index].setAddress(targetAddress);
-                            m_currentReply->networkDeviceInfos()[index].setHostName(reply->hostName());
-                            if (!m_currentReply->networkDeviceInfos()[index].networkInterface().isValid()) {
-                                m_currentReply->networkDeviceInfos()[index].setNetworkInterface(NetworkUtils::getInterfaceForHostaddress(targetAddress));
-                            }
-                        }
-                    }
+                m_pendingPingAddresses.enqueue(targetAddress);
+            }
+        }
+    }
+
+    sendPendingPings();
+}
 
-                    if (m_runningPingRepies.isEmpty() && m_currentReply && !m_discoveryTimer->isActive()) {
-                        finishDiscovery();
+void NetworkDeviceDiscovery::sendPendingPings()
+{
+    // The ping tool keeps all of them in flight concurrently. Only create the replies for a window of addresses
+    // at a time so large networks don't allocate a reply for each address upfront.
+    while (!m_pendingPingAddresses.isEmpty() && m_runningPingRepies.count() < 1024) {
+        QHostAddress targetAddress = m_pendingPingAddresses.dequeue();
+        PingReply *reply = m_ping->ping(targetAddress, 3);
+        m_runningPingRepies.append(reply);
+        connect(reply, &PingReply::finished, this, [=](){
+            m_runningPingRepies.removeAll(reply);
+            if (reply->error() == PingReply::ErrorNoError && m_currentReply) {
+                qCDebug(dcNetworkDeviceDiscovery()) << "Ping response from" << targetAddress.toString() << reply->hostName() << reply->duration() << "ms";
+                int index = m_currentReply->networkDeviceInfos().indexFromHostAddress(targetAddress);
+                if (index < 0) {
+                    // Add the network device
+                    NetworkDeviceInfo networkDeviceInfo;
+                    networkDeviceInfo.setAddress(targetAddress);
+                    networkDeviceInfo.setHostName(reply->hostName());
+                    m_currentReply->networkDeviceInfos().append(networkDeviceInfo);
+                } else {
+                    m_currentReply->networkDeviceInfos()[index].setAddress(targetAddress);
+                    m_currentReply->networkDeviceInfos()[index].setHostName(reply->hostName());
+                    if (!m_currentReply->networkDeviceInfos()[index].networkInterface().isValid()) {
+                        m_currentReply->networkDeviceInfos()[index].setNetworkInterface(NetworkUtils::getInterfaceForHostaddress(targetAddress));
                     }
-                });
+                }
             }
-        }
+
+            sendPendingPings();
+
+            if (m_runningPingRepies.isEmpty() && m_pendingPingAddresses.isEmpty() && m_currentReply && !m_discoveryTimer->isActive()) {
+                finishDiscovery();
+            }
+        });
     }
 }
 
@@ -197,6 +212,22 @@ void NetworkDeviceDiscovery::finishDiscovery()
     m_running = false;
     emit runningChanged(m_running);
 
+    // Look up the manufacturers of all discovered MAC addresses in one go
+    if (m_macAddressDatabase->available()) {
+        NetworkDeviceInfos &networkDeviceInfos = m_currentReply->networkDeviceInfos();
+        QStringList macAddresses;
+        foreach (const NetworkDeviceInfo &networkDeviceInfo, networkDeviceInfos) {
+            macAddresses.append(networkDeviceInfo.macAddress());
+        }
+
+        QStringList manufacturers = m_macAddressDatabase->lookupManufacturers(macAddresses);
+        for (int i = 0; i < networkDeviceInfos.count(); i++) {
+            if (!manufacturers.at(i).isEmpty()) {
+                networkDeviceInfos[i].setMacAddressManufacturer(manufacturers.at(i));
+            }
+        }
+    }
+
     // Sort by host address
     m_currentReply->networkDeviceInfos().sortNetworkDevices();
 
@@ -254,14 +285,6 @@ void NetworkDeviceDiscovery::onArpResponseRceived(const QNetworkInterface &inter
     }
 
     qCDebug(dcNetworkDeviceDiscovery()) << "ARP reply received" << address.toString() << macAddress << interface.name();
-    // Lookup the mac address vendor if possible
-    if (m_macAddressDatabase->available()) {
-        MacAddressDatabaseReply *reply = m_macAddressDatabase->lookupMacAddress(macAddress);
-        connect(reply, &MacAddressDatabaseReply::finished, this, [=](){
-            qCDebug(dcNetworkDeviceDiscovery()) << "MAC manufacturer lookup finished for" << macAddress << ":" << reply->manufacturer();
-            updateOrAddNetworkDeviceArp(interface, address, macAddress, reply->manufacturer());
-        });
-    } else {
-        updateOrAddNetworkDeviceArp(interface, address, macAddress);
-    }
+    // The manufacturers get looked up for all devices at once when the discovery finishes
+    updateOrAddNetworkDeviceArp(interface, address, macAddress);
 }
@@ -71,8 +71,10 @@ private:
     QTimer *m_discoveryTimer = nullptr;
     NetworkDeviceDiscoveryReply *m_currentReply = nullptr;
     QList<PingReply *> m_runningPingRepies;
+    QQueue<QHostAddress> m_pendingPingAddresses;
 
     void pingAllNetworkDevices();
+    void sendPendingPings();
     void finishDiscovery();
 
     void updateOrAddNetworkDeviceArp(const QNetworkInterface &interface, const QHostAddress &address, const QString &macAddress, const QString &manufacturer = QString());
@@ -47,6 +47,10 @@
 NYMEA_LOGGING_CATEGORY(dcPing, "Ping")
 NYMEA_LOGGING_CATEGORY(dcPingTraffic, "PingTraffic")
 
+// Echo requests on the wire at the same time, and sent per event loop iteration
+static const int s_maxPendingReplies = 1024;
+static const int s_maxRepliesPerPass = 64;
+
 Ping::Ping(QObject *parent) : QObject(parent)
 {
     // Build socket descriptor
@@ -79,11 +83,9 @@ Ping::Ping(QObject *parent) : QObject(parent)
     connect(m_socketNotifier, &QSocketNotifier::activated, this, &Ping::onSocketReadyRead);
 
     m_queueTimer = new QTimer(this);
-    m_queueTimer->setInterval(20);
+    m_queueTimer->setInterval(0);
     m_queueTimer->setSingleShot(true);
-    connect(m_queueTimer, &QTimer::timeout, this, [=](){
-        sendNextReply();
-    });
+    connect(m_queueTimer, &QTimer::timeout, this, &Ping::sendQueuedReplies);
 
     m_socketNotifier->setEnabled(true);
     m_available = true;
@@ -111,50 +113,70 @@ PingReply::Error Ping::error() const
     return m_error;
 }
 
-PingReply *Ping::ping(const QHostAddress &hostAddress)
+PingReply *Ping::ping(const QHostAddress &hostAddress, uint timeout)
 {
     PingReply *reply = new PingReply(this);
     reply->m_targetHostAddress = hostAddress;
     reply->m_networkInterface = NetworkUtils::getInterfaceForHostaddress(hostAddress);
+    reply->m_timeout = timeout;
+    connect(reply, &PingReply::timeout, this, [=](){
+        finishReply(reply, PingReply::ErrorTimeout);
+    });
 
     // Perform the reply in the next event loop to give the user time to do the reply connects
+    if (!m_available) {
+        QTimer::singleShot(0, reply, [=]() { performPing(reply); });
+        return reply;
+    }
+
     m_replyQueue.enqueue(reply);
-    sendNextReply();
+    if (!m_queueTimer->isActive())
+        m_queueTimer->start();
 
     return reply;
 }
 
-void Ping::sendNextReply()
+void Ping::sendQueuedReplies()
 {
-    if (m_queueTimer->isActive())
-        return;
-
-    if (m_replyQueue.isEmpty())
-        return;
+    // Keep many requests in flight, but send them in small batches so the event loop stays responsive
+    // and the socket buffer does not overflow on large networks. Restore the regular interval in case
+    // the previous pass had to back off.
+    m_queueTimer->setInterval(0);
+    int sent = 0;
+    while (!m_replyQueue.isEmpty() && m_pendingReplies.count() < s_maxPendingReplies && sent < s_maxRepliesPerPass) {
+        if (!performPing(m_replyQueue.dequeue())) {
+            // The socket buffer is full, the queue timer has been started with a back-off
+            return;
+        }
+        sent++;
+    }
 
-    PingReply *reply = m_replyQueue.dequeue();
-    //qCDebug(dcPing()) << "Send next reply," << m_replyQueue.count() << "left in queue";
-    m_queueTimer->start();
-    QTimer::singleShot(0, this, [=]() { performPing(reply); });
+    // If the window is full, finishing replies will continue the queue
+    if (!m_replyQueue.isEmpty() && m_pendingReplies.count() < s_maxPendingReplies && !m_queueTimer->isActive()) {
+        m_queueTimer->start();
+    }
 }
 
-void Ping::performPing(PingReply *reply)
+bool Ping::performPing(PingReply *reply)
 {
     if (!m_available) {
         qCDebug(dcPing()) << "Cannot send ping request" << m_error;
         finishReply(reply, m_error);
-        return;
+        return true;
     }
 
-    // Get host ip address
-    struct hostent *hostname = gethostbyname(reply->targetHostAddress().toString().toLocal8Bit().constData());
+    if (reply->targetHostAddress().protocol() != QAbstractSocket::IPv4Protocol) {
+        qCWarning(dcPing()) << "Cannot send ping request to" << reply->targetHostAddress().toString() << "Only IPv4 addresses are supported.";
+        finishReply(reply, PingReply::ErrorHostUnreachable);
+        return true;
+    }
+
+    // The target is an address already, no need to resolve anything
     struct sockaddr_in pingAddress;
     memset(&pingAddress, 0, sizeof(pingAddress));
-    pingAddress.sin_family = hostname->h_addrtype;
+    pingAddress.sin_family = AF_INET;
     pingAddress.sin_port = 0;
-    pingAddress.sin_addr.s_addr = *(long*)hostname->h_addr;
-
-    QHostAddress targetHostAddress = QHostAddress(qFromBigEndian(pingAddress.sin_addr.s_addr));
+    pingAddress.sin_addr.s_addr = qToBigEndian(reply->targetHostAddress().toIPv4Address());
 
     // Build the ICMP echo request packet
     struct icmpPacket requestPacket;
@@ -165,7 +187,7 @@ void Ping::performPing(PingReply *reply)
     } else {
         requestPacket.icmpHeadr.un.echo.id = reply->requestId();
     }
-    requestPacket.icmpHeadr.un.echo.sequence = htons(reply->m_sequenceNumber++);
+    requestPacket.icmpHeadr.un.echo.sequence = htons(m_sequenceNumber++);
 
     // Write the ICMP payload
     memset(&requestPacket.icmpPayload, ' ', sizeof(requestPacket.icmpPayload));
@@ -181,7 +203,6 @@ void Ping::performPing(PingReply *reply)
     }
 
     reply->m_requestId = requestPacket.icmpHeadr.un.echo.id;
-    reply->m_targetHostAddress = targetHostAddress;
     reply->m_sequenceNumber = requestPacket.icmpHeadr.un.echo.sequence;
 
     qCDebug(dcPingTraffic()) << "Send ICMP echo request" << reply->targetHostAddress().toString() << ICMP_PACKET_SIZE << "[Bytes]"
@@ -191,18 +212,23 @@ void Ping::performPing(PingReply *reply)
     // Send packet to the target ip
     int bytesSent = sendto(m_socketDescriptor, &requestPacket, sizeof(requestPacket), 0, (struct sockaddr *)&pingAddress, sizeof(pingAddress));
     if (bytesSent < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+            // The socket buffer is full, try again once the pending requests made some room
+            qCDebug(dcPingTraffic()) << "ICMP socket buffer full, delaying request to" << reply->targetHostAddress().toString();
+            m_replyQueue.prepend(reply);
+            m_queueTimer->start(10);
+            return false;
+        }
         verifyErrno(errno);
         qCWarning(dcPing()) << "Failed to send data to" << reply->targetHostAddress().toString() << strerror(errno);
         finishReply(reply, m_error);
-        return;
+        return true;
     }
 
     // Start reply timer and handle timeout
-    m_pendingReplies.insert(reply->requestId(), reply);
-    reply->m_timer->start(8000);
-    connect(reply, &PingReply::timeout, this, [=](){
-        finishReply(reply, PingReply::ErrorTimeout);
-    });
+    m_pendingReplies.insert(pendingReplyKey(reply->requestId(), reply->sequenceNumber()), reply);
+    reply->m_timer->start(static_cast<int>(reply->m_timeout) * 1000);
+    return true;
 }
 
 void Ping::verifyErrno(int error)
@@ -272,20 +298,33 @@ void Ping::timeValueSubtract(timeval *start, timeval *stop)
 
 quint16 Ping::calculateRequestId()
 {
+    // The sequence number makes the key unique, the id only needs to be non zero
     quint16 requestId = 0;
-    while (requestId == 0 || m_pendingReplies.contains(requestId)) {
+    while (requestId == 0) {
         requestId = rand();
     }
 
     return requestId;
 }
 
+quint32 Ping::pendingReplyKey(quint16 requestId, quint16 sequenceNumber) const
+{
+    return (static_cast<quint32>(requestId) << 16) | sequenceNumber;
+}
+
 void Ping::finishReply(PingReply *reply, PingReply::Error error)
 {
     reply->m_error = error;
-    m_pendingReplies.remove(reply->requestId());
+    m_replyQueue.removeAll(reply);
+    if (m_pendingReplies.value(pendingReplyKey(reply->requestId(), reply->sequenceNumber())) == reply)
+        m_pendingReplies.remove(pendingReplyKey(reply->requestId(), reply->sequenceNumber()));
+
     emit reply->finished();
     reply->deleteLater();
+
+    // There is room for the next requests now
+    if (m_queueTimer && !m_replyQueue.isEmpty() && !m_queueTimer->isActive())
+        m_queueTimer->start();
 }
 
 void Ping::onSocketReadyRead(int socketDescriptor)
@@ -295,7 +334,7 @@ void Ping::onSocketReadyRead(int socketDescriptor)
         // Read the socket data and give some extra space for nested pakets...
         int receiveBufferSize = 2 * ICMP_PACKET_SIZE + sizeof(struct iphdr);
         char receiveBuffer[receiveBufferSize];
-        memset(&receiveBuffer, 0, sizeof(receiveBufferSize));
+        memset(&receiveBuffer, 0, sizeof(receiveBuffer));
 
         int bytesReceived = recv(socketDescriptor, &receiveBuffer, receiveBufferSize, 0);
         if (bytesReceived < 0) {
@@ -323,24 +362,18 @@ void Ping::onSocketReadyRead(int socketDescriptor)
                           << "Sequence:" << responsePacket->icmp_seq;
 
         if (responsePacket->icmp_type == ICMP_ECHOREPLY) {
-            PingReply *reply = m_pendingReplies.take(responsePacket->icmp_id);
+            PingReply *reply = m_pendingReplies.take(pendingReplyKey(responsePacket->icmp_id, responsePacket->icmp_seq));
             if (!reply) {
+                // Might be a late response or the echo of some other ping on this host
                 qCDebug(dcPing()) << "No pending reply for ping echo response with id" << QString("0x%1").arg(responsePacket->icmp_id, 4, 16, QChar('0')) << "Sequence:" << htons(responsePacket->icmp_seq) << "from" << senderAddress.toString();
-                return;
+                continue;
             }
 
             // Make sure the sender matches the target
             if (reply->targetHostAddress() != senderAddress) {
                 qCWarning(dcPing()) << "Received id for different target reply" << reply->targetHostAddress().toString() << "!=" << senderAddress.toString();
                 finishReply(reply, PingReply::ErrorHostUnreachable);
-                return;
-            }
-
-            // Verify sequence number
-            if (responsePacket->icmp_seq != reply->sequenceNumber()) {
-                qCWarning(dcPing()) << "Received echo reply with different sequence number" << htons(responsePacket->icmp_seq);
-                finishReply(reply, PingReply::ErrorInvalidResponse);
-                return;
+                continue;
             }
 
             // Calculate ping duration 2 digits accuracy
@@ -349,6 +382,9 @@ void Ping::onSocketReadyRead(int socketDescriptor)
             timeValueSubtract(&receiveTimeValue, &reply->m_startTime);
             reply->m_duration = qRound((receiveTimeValue.tv_sec * 1000 + (double)receiveTimeValue.tv_usec / 1000) * 100) / 100.0;
 
+            // The reply is done on the wire, only the name is missing
+            reply->m_timer->stop();
+
             // Note: due to a Qt bug < 5.9 we need to use old SLOT style and cannot make use of lambda here
             int lookupId = QHostInfo::lookupHost(senderAddress.toString(), this, SLOT(onHostLookupFinished(QHostInfo)));
             m_pendingHostLookups.insert(lookupId, reply);
@@ -386,13 +422,13 @@ void Ping::onSocketReadyRead(int socketDescriptor)
                               << "ID:" << QString("0x%1").arg(nestedResponsePacket->icmp_id, 4, 16, QChar('0'))
                               << "Sequence:" << htons(nestedResponsePacket->icmp_seq);
 
-            PingReply *reply = m_pendingReplies.take(nestedResponsePacket->icmp_id);
+            PingReply *reply = m_pendingReplies.take(pendingReplyKey(nestedResponsePacket->icmp_id, nestedResponsePacket->icmp_seq));
             if (!reply) {
                 qCDebug(dcPingTraffic()) << "No pending reply for ping echo response unreachable with ID"
                                               << QString("0x%1").arg(nestedResponsePacket->icmp_id, 4, 16, QChar('0'))
                                               << "Sequence:" << htons(nestedResponsePacket->icmp_seq)
                                               << "from" << nestedSenderAddress.toString() << "to" << nestedDestinationAddress.toString();
-                return;
+                continue;
             }
 
             finishReply(reply, PingReply::ErrorHostUnreachable);
@@ -402,7 +438,7 @@ void Ping::onSocketReadyRead(int socketDescriptor)
 
 void Ping::onHostLookupFinished(const QHostInfo &info)
 {
-    PingReply *reply = m_pendingHostLookups.value(info.lookupId());
+    PingReply *reply = m_pendingHostLookups.take(info.lookupId());
     if (!reply) {
         qCWarning(dcPing()) << "Could not find reply after host lookup.";
         return;
@@ -62,7 +62,7 @@ public:
 
     PingReply::Error error() const;
 
-    PingReply *ping(const QHostAddress &hostAddress);
+    PingReply *ping(const QHostAddress &hostAddress, uint timeout = 8);
 
 signals:
     void availableChanged(bool available);
@@ -80,16 +80,18 @@ private:
     // Socket
     QSocketNotifier *m_socketNotifier = nullptr;
     int m_socketDescriptor = -1;
-    QHash<quint16, PingReply *> m_pendingReplies;
+    QHash<quint32, PingReply *> m_pendingReplies;       // request id << 16 | sequence number
     bool m_available = false;
+    quint16 m_sequenceNumber = 0;
 
     QQueue<PingReply *> m_replyQueue;
     QTimer *m_queueTimer = nullptr;
-    void sendNextReply();
+    void sendQueuedReplies();
     QHash<int, PingReply *> m_pendingHostLookups;
 
     //Error performPing(const QString &address);
-    void performPing(PingReply *reply);
+    // Returns false if the request has been queued again because the socket buffer is full
+    bool performPing(PingReply *reply);
     void verifyErrno(int error);
 
     // Helper
@@ -97,6 +99,7 @@ private:
     void cleanUpSocket();
     void timeValueSubtract(struct timeval *start, struct timeval *stop);
     quint16 calculateRequestId();
+    quint32 pendingReplyKey(quint16 requestId, quint16 sequenceNumber) const;
 
     void finishReply(PingReply *reply, PingReply::Error error);
 
@@ -11,7 +11,10 @@ SUBDIRS = \
         logging \
         loggingdirect \
         loggingloading \
+        loggingoutput \
+        macaddressdatabase \
         mqttbroker \
+        ping \
         plugins \
         pythonplugins \
         rules \
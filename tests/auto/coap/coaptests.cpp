@@ -523,6 +523,148 @@ void CoapTests::multipleCalls()
     qDeleteAll(replies);
 }
 
+void CoapTests::concurrentRequests()
+{
+    // A small fleet of local CoAP nodes, each answering only once all requests are on the wire
+    QList<QUdpSocket *> nodes;
+    for (int i = 0; i < 4; i++) {
+        QUdpSocket *node = new QUdpSocket(this);
+        QVERIFY(node->bind(QHostAddress::LocalHost, 0));
+        nodes.append(node);
+    }
+
+    QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
+
+    QHash<CoapReply *, int> replies;
+    for (int i = 0; i < nodes.count(); i++) {
+        QUrl url(QString("coap://127.0.0.1:%1/node").arg(nodes.at(i)->localPort()));
+        replies.insert(m_coap->get(CoapRequest(url)), i);
+    }
+
+    // Collect the requests, they must all be sent without waiting for a response
+    QList<QPair<QUdpSocket *, QNetworkDatagram> > requests;
+    foreach (QUdpSocket *node, nodes) {
+        QVERIFY(node->hasPendingDatagrams() || node->waitForReadyRead(2000));
+        requests.append(qMakePair(node, node->receiveDatagram()));
+    }
+
+    // Respond in reverse order
+    for (int i = requests.count() - 1; i >= 0; i--) {
+        CoapPdu request(requests.at(i).second.data());
+        QVERIFY(request.isValid());
+
+        CoapPdu response;
+        response.setMessageType(CoapPdu::Acknowledgement);
+        response.setStatusCode(CoapPdu::Content);
+        response.setMessageId(request.messageId());
+        response.setToken(request.token());
+        response.setPayload(QByteArray::number(i));
+        requests.at(i).first->writeDatagram(response.pack(), requests.at(i).second.senderAddress(), static_cast<quint16>(requests.at(i).second.senderPort()));
+    }
+
+    while (spy.count() < nodes.count()) {
+        QVERIFY2(spy.wait(), "Did not get all responses.");
+    }
+
+    foreach (CoapReply *reply, replies.keys()) {
+        QCOMPARE(reply->error(), CoapReply::NoError);
+        QCOMPARE(reply->statusCode(), CoapPdu::Content);
+        QCOMPARE(reply->payload(), QByteArray::number(replies.value(reply)));
+        reply->deleteLater();
+    }
+
+    qDeleteAll(nodes);
+}
+
+void CoapTests::blockSizeNegotiation()
+{
+    QUdpSocket node;
+    QVERIFY(node.bind(QHostAddress::LocalHost, 0));
+
+    QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
+    CoapReply *reply = m_coap->get(CoapRequest(QUrl(QString("coap://127.0.0.1:%1/large").arg(node.localPort()))));
+
+    // The first request proposes our preferred block size
+    QVERIFY(node.hasPendingDatagrams() || node.waitForReadyRead(2000));
+    QNetworkDatagram datagram = node.receiveDatagram();
+    CoapPdu request(datagram.data());
+    QVERIFY(request.isValid());
+    QCOMPARE(request.block().blockNumber(), 0);
+    QCOMPARE(request.block().blockSize(), 1024);
+
+    // The node only supports 256 byte blocks (SZX 4)
+    QByteArray firstBlock(256, 'a');
+    CoapPdu response;
+    response.setMessageType(CoapPdu::Acknowledgement);
+    response.setStatusCode(CoapPdu::Content);
+    response.setMessageId(request.messageId());
+    response.setToken(request.token());
+    response.addOption(CoapOption::Block2, CoapPduBlock::createBlock(0, 4, true));
+    response.setPayload(firstBlock);
+    node.writeDatagram(response.pack(), datagram.senderAddress(), static_cast<quint16>(datagram.senderPort()));
+
+    // The follow up request must continue with the block size of the node
+    QVERIFY(node.hasPendingDatagrams() || node.waitForReadyRead(2000));
+    datagram = node.receiveDatagram();
+    CoapPdu nextRequest(datagram.data());
+    QVERIFY(nextRequest.isValid());
+    QCOMPARE(nextRequest.block().blockNumber(), 1);
+    QCOMPARE(nextRequest.block().blockSize(), 256);
+
+    QByteArray lastBlock(100, 'b');
+    CoapPdu nextResponse;
+    nextResponse.setMessageType(CoapPdu::Acknowledgement);
+    nextResponse.setStatusCode(CoapPdu::Content);
+    nextResponse.setMessageId(nextRequest.messageId());
+    nextResponse.setToken(nextRequest.token());
+    nextResponse.addOption(CoapOption::Block2, CoapPduBlock::createBlock(1, 4, false));
+    nextResponse.setPayload(lastBlock);
+    node.writeDatagram(nextResponse.pack(), datagram.senderAddress(), static_cast<quint16>(datagram.senderPort()));
+
+    if (spy.isEmpty())
+        QVERIFY2(spy.wait(), "Did not get a response.");
+
+    QCOMPARE(reply->error(), CoapReply::NoError);
+    QCOMPARE(reply->statusCode(), CoapPdu::Content);
+    QCOMPARE(reply->payload(), firstBlock + lastBlock);
+    reply->deleteLater();
+}
+
+void CoapTests::unexpectedSender()
+{
+    QUdpSocket node;
+    QVERIFY(node.bind(QHostAddress::LocalHost, 0));
+    QUdpSocket spoofer;
+    QVERIFY(spoofer.bind(QHostAddress::LocalHost, 0));
+
+    QSignalSpy spy(m_coap, SIGNAL(replyFinished(CoapReply*)));
+    CoapReply *reply = m_coap->get(CoapRequest(QUrl(QString("coap://127.0.0.1:%1/node").arg(node.localPort()))));
+
+    QVERIFY(node.hasPendingDatagrams() || node.waitForReadyRead(2000));
+    QNetworkDatagram datagram = node.receiveDatagram();
+    CoapPdu request(datagram.data());
+    QVERIFY(request.isValid());
+
+    CoapPdu response;
+    response.setMessageType(CoapPdu::Acknowledgement);
+    response.setStatusCode(CoapPdu::Content);
+    response.setMessageId(request.messageId());
+    response.setToken(request.token());
+
+    // A matching response from another port must not finish the request
+    response.setPayload("spoofed");
+    spoofer.writeDatagram(response.pack(), datagram.senderAddress(), static_cast<quint16>(datagram.senderPort()));
+    QVERIFY(!spy.wait(500));
+
+    response.setPayload("node");
+    node.writeDatagram(response.pack(), datagram.senderAddress(), static_cast<quint16>(datagram.senderPort()));
+    QVERIFY2(spy.wait(), "Did not get a response.");
+
+    QCOMPARE(reply->error(), CoapReply::NoError);
+    QCOMPARE(reply->payload(), QByteArray("node"));
+    reply->deleteLater();
+}
+
 void CoapTests::coreLinkParser()
 {
     CoapRequest request(QUrl("coap://coap.me/.well-known/core"));
@@ -25,6 +25,8 @@
 #include <QObject>
 #include <QHostInfo>
 #include <QHostAddress>
+#include <QUdpSocket>
+#include <QNetworkDatagram>
 
 #include <QSignalSpy>
 #include <QtTest>
@@ -77,6 +79,9 @@ private slots:
     void largeUpdate();
 
     void multipleCalls();
+    void concurrentRequests();
+    void blockSizeNegotiation();
+    void unexpectedSender();
 
     void coreLinkParser();
 
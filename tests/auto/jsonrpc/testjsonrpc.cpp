@@ -34,8 +34,19 @@
 #include "version.h"
 #include "servers/mocktcpserver.h"
 #include "usermanager/usermanager.h"
+#include "jsonrpc/jsonvalidator.h"
+#include "jsonrpc/jsonframeparser.h"
+#include "jsonrpc/cborframeparser.h"
+#include "jsonrpc/jsonrpcserverimplementation.h"
+#include "jsonrpc/integrationshandler.h"
 #include "nymeadbusservice.h"
 
+#include <QElapsedTimer>
+#if QT_VERSION >= QT_VERSION_CHECK(5,12,0)
+#include <QCborValue>
+#include <QCborArray>
+#endif
+
 using namespace nymeaserver;
 
 class TestJSONRPC: public NymeaTestBase
@@ -76,6 +87,22 @@ private slots:
 
     void stateChangeEmitsNotifications();
 
+    void notificationsSerializedOncePerLocale();
+
+    void notificationFilters();
+
+    void batchRequests();
+
+    void batchRequestsConcurrencyLimit();
+
+    void batchRequestsUnauthorized();
+
+    void cborEncoding();
+
+    void cborFrameParser();
+
+    void cachedResponses();
+
     void pluginConfigChangeEmitsNotification();
 
     /*
@@ -113,11 +140,22 @@ private slots:
 
     void testInitialSetupWithPushButtonAuth();
 
+    void testRandomFragmentation();
+
     void testDataFragmentation_data();
     void testDataFragmentation();
 
     void testGarbageData();
 
+    void benchmarkValidateParams();
+
+    void benchmarkFrameParser();
+
+    void cachedPackers();
+
+    void benchmarkPack_data();
+    void benchmarkPack();
+
 private:
     QStringList extractRefs(const QVariant &variant);
 
@@ -970,6 +1008,413 @@ void TestJSONRPC::stateChangeEmitsNotifications()
     QCOMPARE(response.toMap().value("params").toMap().value("value").toInt(), newVal);
 }
 
+void TestJSONRPC::notificationsSerializedOncePerLocale()
+{
+    // Two more clients, one sharing the locale with the default test client
+    QUuid bobId = QUuid::createUuid();
+    QUuid carolId = QUuid::createUuid();
+    m_mockTcpServer->clientConnected(bobId);
+    m_mockTcpServer->clientConnected(carolId);
+
+    QVariantMap params;
+    params.insert("locale", "en_US");
+    injectAndWait("JSONRPC.Hello", params);
+    injectAndWait("JSONRPC.Hello", params, bobId);
+    params.insert("locale", "de_DE");
+    injectAndWait("JSONRPC.Hello", params, carolId);
+
+    params.clear();
+    params.insert("namespaces", QVariantList() << "Integrations");
+    injectAndWait("JSONRPC.SetNotificationStatus", params);
+    injectAndWait("JSONRPC.SetNotificationStatus", params, bobId);
+    injectAndWait("JSONRPC.SetNotificationStatus", params, carolId);
+
+    quint64 savedBefore = NymeaCore::instance()->jsonRPCServer()->savedNotificationSerializations();
+    QSignalSpy clientSpy(m_mockTcpServer, SIGNAL(outgoingData(QUuid,QByteArray)));
+
+    // trigger state change in mock device
+    QNetworkAccessManager nam;
+    QNetworkRequest request(QUrl(QString("http://localhost:%1/setstate?%2=%3").arg(m_mockThing1Port).arg(mockIntStateTypeId.toString()).arg(23)));
+    QNetworkReply *reply = nam.get(request);
+    connect(reply, SIGNAL(finished()), reply, SLOT(deleteLater()));
+    QSignalSpy replySpy(reply, SIGNAL(finished()));
+    if (replySpy.count() == 0) replySpy.wait();
+
+    QHash<QUuid, int> notificationIds;
+    do {
+        for (int i = 0; i < clientSpy.count(); i++) {
+            QVariantMap notification = QJsonDocument::fromJson(clientSpy.at(i).at(1).toByteArray()).toVariant().toMap();
+            if (notification.value("notification").toString() == "Integrations.StateChanged") {
+                notificationIds.insert(clientSpy.at(i).at(0).toUuid(), notification.value("id").toInt());
+            }
+        }
+    } while (notificationIds.count() < 3 && clientSpy.wait());
+
+    // All clients get the same notification
+    QCOMPARE(notificationIds.count(), 3);
+    QCOMPARE(notificationIds.value(bobId), notificationIds.value(m_clientId));
+    QCOMPARE(notificationIds.value(carolId), notificationIds.value(m_clientId));
+
+    // The default client and bob share the serialized data
+    QVERIFY(NymeaCore::instance()->jsonRPCServer()->savedNotificationSerializations() > savedBefore);
+
+    m_mockTcpServer->terminateClientConnection(bobId);
+    m_mockTcpServer->terminateClientConnection(carolId);
+    QCOMPARE(disableNotifications(), true);
+}
+
+void TestJSONRPC::notificationFilters()
+{
+    QNetworkAccessManager nam;
+    auto setIntState = [&](int value) {
+        QNetworkRequest request(QUrl(QString("http://localhost:%1/setstate?%2=%3").arg(m_mockThing1Port).arg(mockIntStateTypeId.toString()).arg(value)));
+        QNetworkReply *reply = nam.get(request);
+        QSignalSpy replySpy(reply, &QNetworkReply::finished);
+        if (replySpy.count() == 0) replySpy.wait();
+        reply->deleteLater();
+    };
+
+    // Only subscribe to another thing
+    QVariantMap params;
+    params.insert("namespaces", QVariantList() << "Integrations");
+    params.insert("thingIds", QVariantList() << QUuid::createUuid());
+    injectAndWait("JSONRPC.SetNotificationStatus", params);
+
+    QSignalSpy clientSpy(m_mockTcpServer, SIGNAL(outgoingData(QUuid,QByteArray)));
+    setIntState(51);
+    clientSpy.wait(500);
+    QVERIFY2(checkNotifications(clientSpy, "Integrations.StateChanged").isEmpty(), "Filtered thing should not emit notifications.");
+
+    // Subscribe to the mock thing, coalescing rapid changes
+    params.insert("thingIds", QVariantList() << m_mockThingId);
+    params.insert("stateTypeIds", QVariantList() << mockIntStateTypeId);
+    params.insert("coalescingInterval", 500);
+    injectAndWait("JSONRPC.SetNotificationStatus", params);
+
+    clientSpy.clear();
+    setIntState(52);
+    setIntState(53);
+    setIntState(54);
+
+    QVariantList stateChangedNotifications;
+    while (stateChangedNotifications.isEmpty() && clientSpy.wait()) {
+        stateChangedNotifications = checkNotifications(clientSpy, "Integrations.StateChanged");
+    }
+    QCOMPARE(stateChangedNotifications.count(), 1);
+    QCOMPARE(stateChangedNotifications.first().toMap().value("params").toMap().value("value").toInt(), 54);
+
+    QCOMPARE(disableNotifications(), true);
+}
+
+void TestJSONRPC::batchRequests()
+{
+    QVariantList batch;
+    QVariantMap versionCall;
+    versionCall.insert("id", 900);
+    versionCall.insert("method", "JSONRPC.Version");
+    versionCall.insert("token", m_apiToken);
+    batch.append(versionCall);
+
+    QVariantMap actionParams;
+    actionParams.insert("thingId", m_mockThingId);
+    actionParams.insert("actionTypeId", mockAsyncActionTypeId);
+    QVariantMap asyncCall;
+    asyncCall.insert("id", 901);
+    asyncCall.insert("method", "Integrations.ExecuteAction");
+    asyncCall.insert("params", actionParams);
+    asyncCall.insert("token", m_apiToken);
+    batch.append(asyncCall);
+
+    QVariantMap invalidCall;
+    invalidCall.insert("id", 902);
+    invalidCall.insert("method", "JSONRPC.DoesNotExist");
+    invalidCall.insert("token", m_apiToken);
+    batch.append(invalidCall);
+
+    QVariantMap thingsCall;
+    thingsCall.insert("id", 903);
+    thingsCall.insert("method", "Integrations.GetThings");
+    thingsCall.insert("token", m_apiToken);
+    batch.append(thingsCall);
+
+    QSignalSpy spy(m_mockTcpServer, SIGNAL(outgoingData(QUuid,QByteArray)));
+    m_mockTcpServer->injectData(m_clientId, QJsonDocument::fromVariant(batch).toJson(QJsonDocument::Compact) + "\n");
+
+    // All calls must be answered with one single array, even though one of them finishes asynchronously
+    while (spy.count() == 0 && spy.wait()) { }
+    spy.wait(500);
+    QCOMPARE(spy.count(), 1);
+
+    QJsonDocument jsonDoc = QJsonDocument::fromJson(spy.first().at(1).toByteArray());
+    QVERIFY(jsonDoc.isArray());
+    QVariantList responses = jsonDoc.toVariant().toList();
+    QCOMPARE(responses.count(), 4);
+    QCOMPARE(responses.at(0).toMap().value("id").toInt(), 900);
+    QCOMPARE(responses.at(0).toMap().value("status").toString(), QStringLiteral("success"));
+    QCOMPARE(responses.at(1).toMap().value("id").toInt(), 901);
+    QCOMPARE(responses.at(1).toMap().value("status").toString(), QStringLiteral("success"));
+    QCOMPARE(responses.at(1).toMap().value("params").toMap().value("thingError").toString(), enumValueName(Thing::ThingErrorNoError));
+    QCOMPARE(responses.at(2).toMap().value("id").toInt(), 902);
+    QCOMPARE(responses.at(2).toMap().value("status").toString(), QStringLiteral("error"));
+    QCOMPARE(responses.at(3).toMap().value("id").toInt(), 903);
+    QCOMPARE(responses.at(3).toMap().value("status").toString(), QStringLiteral("success"));
+
+    // An empty batch is an error
+    spy.clear();
+    m_mockTcpServer->injectData(m_clientId, "[]\n");
+    if (spy.count() == 0) spy.wait();
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(QJsonDocument::fromJson(spy.first().at(1).toByteArray()).toVariant().toMap().value("status").toString(), QStringLiteral("error"));
+}
+
+void TestJSONRPC::batchRequestsConcurrencyLimit()
+{
+    // Each async action takes a second. A client may only run 16 of them at the same time,
+    // so 20 calls need to complete in two rounds.
+    QVariantList batch;
+    for (int i = 0; i < 20; i++) {
+        QVariantMap actionParams;
+        actionParams.insert("thingId", m_mockThingId);
+        actionParams.insert("actionTypeId", mockAsyncActionTypeId);
+        QVariantMap call;
+        call.insert("id", 1000 + i);
+        call.insert("method", "Integrations.ExecuteAction");
+        call.insert("params", actionParams);
+        call.insert("token", m_apiToken);
+        batch.append(call);
+    }
+
+    QSignalSpy spy(m_mockTcpServer, SIGNAL(outgoingData(QUuid,QByteArray)));
+    QElapsedTimer timer;
+    timer.start();
+    m_mockTcpServer->injectData(m_clientId, QJsonDocument::fromVariant(batch).toJson(QJsonDocument::Compact) + "\n");
+
+    while (spy.count() == 0 && spy.wait()) { }
+    qint64 elapsed = timer.elapsed();
+    QCOMPARE(spy.count(), 1);
+
+    QVariantList responses = QJsonDocument::fromJson(spy.first().at(1).toByteArray()).toVariant().toList();
+    QCOMPARE(responses.count(), 20);
+    for (int i = 0; i < responses.count(); i++) {
+        QCOMPARE(responses.at(i).toMap().value("id").toInt(), 1000 + i);
+        QCOMPARE(responses.at(i).toMap().value("status").toString(), QStringLiteral("success"));
+    }
+
+    qCDebug(dcTests()) << "Batch of 20 async calls finished after" << elapsed << "ms";
+    QVERIFY2(elapsed >= 1900, "Calls exceeding the concurrency limit should have been queued");
+    QVERIFY2(elapsed < 5000, "Calls within the concurrency limit should run concurrently");
+}
+
+void TestJSONRPC::batchRequestsUnauthorized()
+{
+    QUuid daveId = QUuid::createUuid();
+    m_mockTcpServer->clientConnected(daveId);
+    injectAndWait("JSONRPC.Hello", QVariantMap(), daveId);
+
+    QVariantList batch;
+    QVariantMap versionCall;
+    versionCall.insert("id", 1100);
+    versionCall.insert("method", "JSONRPC.Version");
+    versionCall.insert("token", m_apiToken);
+    batch.append(versionCall);
+
+    QVariantMap unauthorizedCall;
+    unauthorizedCall.insert("id", 1101);
+    unauthorizedCall.insert("method", "JSONRPC.Version");
+    unauthorizedCall.insert("token", "invalid");
+    batch.append(unauthorizedCall);
+
+    QVariantMap thingsCall;
+    thingsCall.insert("id", 1102);
+    thingsCall.insert("method", "Integrations.GetThings");
+    thingsCall.insert("token", m_apiToken);
+    batch.append(thingsCall);
+
+    QSignalSpy spy(m_mockTcpServer, SIGNAL(outgoingData(QUuid,QByteArray)));
+    QSignalSpy disconnectedSpy(m_mockTcpServer, &MockTcpServer::clientDisconnected);
+    m_mockTcpServer->injectData(daveId, QJsonDocument::fromVariant(batch).toJson(QJsonDocument::Compact) + "\n");
+    if (spy.count() == 0) spy.wait();
+
+    // The client gets the responses collected so far, including the unauthorized one, before being dropped.
+    // Calls following the unauthorized one are not processed any more.
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.first().at(0).toUuid(), daveId);
+    QVariantList responses = QJsonDocument::fromJson(spy.first().at(1).toByteArray()).toVariant().toList();
+    QCOMPARE(responses.count(), 2);
+    QCOMPARE(responses.at(0).toMap().value("id").toInt(), 1100);
+    QCOMPARE(responses.at(0).toMap().value("status").toString(), QStringLiteral("success"));
+    QCOMPARE(responses.at(1).toMap().value("id").toInt(), 1101);
+    QCOMPARE(responses.at(1).toMap().value("status").toString(), QStringLiteral("unauthorized"));
+
+    if (disconnectedSpy.count() == 0) disconnectedSpy.wait();
+    QCOMPARE(disconnectedSpy.count(), 1);
+    QCOMPARE(disconnectedSpy.first().at(0).toUuid(), daveId);
+}
+
+void TestJSONRPC::cborEncoding()
+{
+#if QT_VERSION < QT_VERSION_CHECK(5,12,0)
+    QSKIP("CBOR encoding requires Qt 5.12");
+#else
+    QUuid daveId = QUuid::createUuid();
+    m_mockTcpServer->clientConnected(daveId);
+
+    // Negotiate CBOR. The Hello response itself is still JSON.
+    QVariantMap params;
+    params.insert("encodings", QVariantList() << "EncodingCbor" << "EncodingJson");
+    QVariantMap response = injectAndWait("JSONRPC.Hello", params, daveId).toMap();
+    QCOMPARE(response.value("status").toString(), QStringLiteral("success"));
+    QCOMPARE(response.value("params").toMap().value("encoding").toString(), enumValueName(JsonRPCServerImplementation::EncodingCbor));
+
+    // Send two pipelined CBOR requests, split in the middle of the first one
+    QVariantMap versionCall;
+    versionCall.insert("id", 700);
+    versionCall.insert("method", "JSONRPC.Version");
+    versionCall.insert("token", QString::fromUtf8(m_apiToken));
+    QByteArray data = QCborValue::fromVariant(versionCall).toCbor();
+    QVariantMap thingsCall;
+    thingsCall.insert("id", 701);
+    thingsCall.insert("method", "Integrations.GetThings");
+    thingsCall.insert("token", QString::fromUtf8(m_apiToken));
+    data.append(QCborValue::fromVariant(thingsCall).toCbor());
+
+    QSignalSpy spy(m_mockTcpServer, SIGNAL(outgoingData(QUuid,QByteArray)));
+    m_mockTcpServer->injectData(daveId, data.left(10));
+    m_mockTcpServer->injectData(daveId, data.mid(10));
+    while (spy.count() < 2 && spy.wait()) { }
+    QCOMPARE(spy.count(), 2);
+
+    QVariantMap versionResponse = QCborValue::fromCbor(spy.at(0).at(1).toByteArray()).toJsonValue().toVariant().toMap();
+    QCOMPARE(versionResponse.value("id").toInt(), 700);
+    QCOMPARE(versionResponse.value("status").toString(), QStringLiteral("success"));
+    QCOMPARE(versionResponse.value("params").toMap().value("version").toString(), QString(NYMEA_VERSION_STRING));
+
+    // Values are encoded the same way as with JSON, e.g. uuids as strings
+    QCborValue thingsResponse = QCborValue::fromCbor(spy.at(1).at(1).toByteArray());
+    QCOMPARE(thingsResponse["id"].toInteger(), 701);
+    QCborArray things = thingsResponse["params"]["things"].toArray();
+    QVERIFY(!things.isEmpty());
+    QVERIFY(things.first()["id"].isString());
+
+    m_mockTcpServer->clientDisconnected(daveId);
+#endif
+}
+
+void TestJSONRPC::cborFrameParser()
+{
+#if QT_VERSION < QT_VERSION_CHECK(5,12,0)
+    QSKIP("CBOR encoding requires Qt 5.12");
+#else
+    QList<QByteArray> messages;
+    QVariantMap params;
+    params.insert("thingId", m_mockThingId);
+    params.insert("values", QVariantList() << 1 << 1000 << 100000 << 1.5 << true << QVariant());
+    params.insert("text", QString(300, 'x'));
+    for (int i = 0; i < 20; i++) {
+        QVariantMap message;
+        message.insert("id", i);
+        message.insert("method", "Integrations.GetThings");
+        message.insert("params", params);
+        messages.append(QCborValue::fromVariant(message).toCbor());
+    }
+    // Strings and containers of indefinite length end with a break instead of a length
+    messages.append(QByteArray::fromHex("bf626964181e61619f7f61616162ff01ffff"));
+
+    QByteArray stream;
+    foreach (const QByteArray &message, messages) {
+        stream.append(message);
+    }
+
+    // However the stream is fragmented, the same messages come out
+    qsrand(4242);
+    for (int round = 0; round < 20; round++) {
+        CborFrameParser parser;
+        QList<QByteArray> frames;
+        int position = 0;
+        while (position < stream.size()) {
+            int length = 1 + qrand() % ((round + 1) * 10);
+            frames.append(parser.append(stream.mid(position, length)));
+            position += length;
+        }
+        QCOMPARE(frames, messages);
+        QCOMPARE(parser.pendingSize(), 0);
+    }
+    QCOMPARE(QCborValue::fromCbor(messages.last()).toMap().value("id").toInteger(), 30);
+
+    // Invalid data is passed on for the decoder to report
+    CborFrameParser parser;
+    QList<QByteArray> frames = parser.append(QByteArray::fromHex("ff01"));
+    QCOMPARE(frames.count(), 1);
+    QCborParserError error;
+    QCborValue::fromCbor(frames.first(), &error);
+    QVERIFY(error.error != QCborError::NoError);
+#endif
+}
+
+void TestJSONRPC::cachedResponses()
+{
+    JsonRPCServerImplementation *server = NymeaCore::instance()->jsonRPCServer();
+
+    // The first call fills the cache, following ones are sent from it with their own id
+    QVariantMap response = injectAndWait("Integrations.GetVendors").toMap();
+    QCOMPARE(response.value("status").toString(), QStringLiteral("success"));
+    quint64 cachedBefore = server->cachedResponsesSent();
+    QVariantMap cachedResponse = injectAndWait("Integrations.GetVendors").toMap();
+    QCOMPARE(server->cachedResponsesSent(), cachedBefore + 1);
+    QCOMPARE(cachedResponse.value("params"), response.value("params"));
+
+    // Calls in a batch are not cached and must produce the same reply
+    QVariantMap call;
+    call.insert("id", 950);
+    call.insert("method", "Integrations.GetVendors");
+    call.insert("token", m_apiToken);
+    QSignalSpy spy(m_mockTcpServer, SIGNAL(outgoingData(QUuid,QByteArray)));
+    m_mockTcpServer->injectData(m_clientId, QJsonDocument::fromVariant(QVariantList() << call).toJson(QJsonDocument::Compact) + "\n");
+    while (spy.count() == 0 && spy.wait()) { }
+    QCOMPARE(spy.count(), 1);
+    QVariantMap batchResponse = QJsonDocument::fromJson(spy.first().at(1).toByteArray()).toVariant().toList().first().toMap();
+    QCOMPARE(batchResponse.value("id").toInt(), 950);
+    QCOMPARE(batchResponse.value("params"), cachedResponse.value("params"));
+    QCOMPARE(server->cachedResponsesSent(), cachedBefore + 1);
+
+    // Filtered calls are not cached
+    QVariantMap params;
+    params.insert("vendorId", nymeaVendorId);
+    response = injectAndWait("Integrations.GetThingClasses", params).toMap();
+    QCOMPARE(response.value("status").toString(), QStringLiteral("success"));
+    QCOMPARE(server->cachedResponsesSent(), cachedBefore + 1);
+
+    // Each method has its own cache entry
+    injectAndWait("Devices.GetSupportedDevices");
+    cachedResponse = injectAndWait("Devices.GetSupportedDevices").toMap();
+    QCOMPARE(server->cachedResponsesSent(), cachedBefore + 2);
+    QVERIFY(!cachedResponse.value("params").toMap().value("deviceClasses").toList().isEmpty());
+
+    // Each locale has its own cache entry
+    QUuid daveId = QUuid::createUuid();
+    m_mockTcpServer->clientConnected(daveId);
+    params.clear();
+    params.insert("locale", "de_DE");
+    injectAndWait("JSONRPC.Hello", params, daveId);
+    injectAndWait("Integrations.GetVendors", QVariantMap(), daveId);
+    QCOMPARE(server->cachedResponsesSent(), cachedBefore + 2);
+    injectAndWait("Integrations.GetVendors", QVariantMap(), daveId);
+    QCOMPARE(server->cachedResponsesSent(), cachedBefore + 3);
+    m_mockTcpServer->clientDisconnected(daveId);
+
+    // Changing a plugin configuration invalidates the cache
+    params.clear();
+    params.insert("pluginId", mockPluginId);
+    QVariantMap param;
+    param.insert("paramTypeId", mockPluginConfigParamIntParamTypeId);
+    param.insert("value", 42);
+    params.insert("configuration", QVariantList() << param);
+    response = injectAndWait("Integrations.SetPluginConfiguration", params).toMap();
+    QCOMPARE(response.value("params").toMap().value("thingError").toString(), enumValueName(Thing::ThingErrorNoError));
+    injectAndWait("Integrations.GetVendors");
+    QCOMPARE(server->cachedResponsesSent(), cachedBefore + 3);
+}
+
 void TestJSONRPC::pluginConfigChangeEmitsNotification()
 {
     QSignalSpy clientSpy(m_mockTcpServer, SIGNAL(outgoingData(QUuid,QByteArray)));
@@ -1282,6 +1727,46 @@ void TestJSONRPC::testInitialSetupWithPushButtonAuth()
     if (spy.isEmpty()) spy.wait();
 }
 
+void TestJSONRPC::testRandomFragmentation()
+{
+    // Pipeline a bunch of requests, some of them pretty printed and some containing braces and escaped quotes in strings
+    QByteArray stream;
+    int requestCount = 50;
+    for (int i = 0; i < requestCount; i++) {
+        QVariantMap request;
+        request.insert("id", 1000 + i);
+        request.insert("method", "JSONRPC.Hello");
+        QVariantMap params;
+        params.insert("locale", "en_US");
+        request.insert("params", params);
+        request.insert("comment", QString("}\n{ \"[%1]\\").arg(i));
+        stream.append(QJsonDocument::fromVariant(request).toJson(i % 3 == 0 ? QJsonDocument::Indented : QJsonDocument::Compact));
+        if (i % 2 == 0) {
+            stream.append('\n');
+        }
+    }
+
+    qsrand(4242);
+    for (int round = 0; round < 5; round++) {
+        QSignalSpy spy(m_mockTcpServer, SIGNAL(outgoingData(QUuid,QByteArray)));
+
+        int position = 0;
+        while (position < stream.size()) {
+            int length = 1 + (qrand() % 64);
+            m_mockTcpServer->injectData(m_clientId, stream.mid(position, length));
+            position += length;
+        }
+        while (spy.count() < requestCount && spy.wait()) { }
+        QCOMPARE(spy.count(), requestCount);
+
+        for (int i = 0; i < requestCount; i++) {
+            QVariantMap response = QJsonDocument::fromJson(spy.at(i).at(1).toByteArray()).toVariant().toMap();
+            QCOMPARE(response.value("id").toInt(), 1000 + i);
+            QCOMPARE(response.value("status").toString(), QStringLiteral("success"));
+        }
+    }
+}
+
 void TestJSONRPC::testDataFragmentation_data()
 {
     QTest::addColumn<QList<QByteArray> >("packets");
@@ -1340,6 +1825,118 @@ void TestJSONRPC::testGarbageData()
     QCOMPARE(spy.count(), 1);
 }
 
+void TestJSONRPC::benchmarkValidateParams()
+{
+    QVariantMap api = injectAndWait("JSONRPC.Introspect").toMap().value("params").toMap();
+
+    JsonValidator validator;
+    validator.setApi(api);
+
+    QVariantList actionParams;
+    QVariantMap param1;
+    param1.insert("paramTypeId", mockWithParamsActionParam1ParamTypeId);
+    param1.insert("value", 5);
+    actionParams.append(param1);
+    QVariantMap param2;
+    param2.insert("paramTypeId", mockWithParamsActionParam2ParamTypeId);
+    param2.insert("value", true);
+    actionParams.append(param2);
+
+    QVariantMap params;
+    params.insert("actionTypeId", mockWithParamsActionTypeId);
+    params.insert("thingId", m_mockThingId);
+    params.insert("params", actionParams);
+
+    QVERIFY(validator.validateParams(params, "Integrations.ExecuteAction").success());
+
+    // Make sure the compiled validator still catches errors
+    QVariantMap invalidParams = params;
+    invalidParams.remove("thingId");
+    QVERIFY(!validator.validateParams(invalidParams, "Integrations.ExecuteAction").success());
+    invalidParams = params;
+    invalidParams.insert("foo", "bar");
+    QVERIFY(!validator.validateParams(invalidParams, "Integrations.ExecuteAction").success());
+
+    QBENCHMARK {
+        validator.validateParams(params, "Integrations.ExecuteAction");
+    }
+}
+
+void TestJSONRPC::benchmarkFrameParser()
+{
+    QByteArray stream;
+    for (int i = 0; i < 1000; i++) {
+        stream.append(QString("{\"id\": %1, \"method\": \"Integrations.GetThings\", \"params\": {\"thingId\": \"%2\"}}\n").arg(i).arg(m_mockThingId.toString()).toUtf8());
+    }
+
+    QList<QByteArray> chunks;
+    qsrand(4242);
+    int position = 0;
+    while (position < stream.size()) {
+        int length = 1 + (qrand() % 1500);
+        chunks.append(stream.mid(position, length));
+        position += length;
+    }
+
+    JsonFrameParser parser;
+    QBENCHMARK {
+        int frames = 0;
+        foreach (const QByteArray &chunk, chunks) {
+            frames += parser.append(chunk).count();
+        }
+        QCOMPARE(frames, 1000);
+        QCOMPARE(parser.pendingSize(), 0);
+    }
+}
+
+void TestJSONRPC::cachedPackers()
+{
+    IntegrationsHandler handler(NymeaCore::instance()->thingManager());
+
+    Things things = NymeaCore::instance()->thingManager()->configuredThings();
+    QVERIFY(!things.isEmpty());
+    foreach (Thing *thing, things) {
+        QCOMPARE(handler.pack(thing), handler.packReflective(thing));
+        QCOMPARE(handler.pack(thing->params()), handler.packReflective(thing->params()));
+    }
+
+    ThingClasses thingClasses = NymeaCore::instance()->thingManager()->supportedThings();
+    QVERIFY(!thingClasses.isEmpty());
+    QCOMPARE(handler.pack(thingClasses), handler.packReflective(thingClasses));
+
+    Vendors vendors = NymeaCore::instance()->thingManager()->supportedVendors();
+    QCOMPARE(handler.pack(vendors), handler.packReflective(vendors));
+}
+
+void TestJSONRPC::benchmarkPack_data()
+{
+    QTest::addColumn<bool>("cached");
+
+    QTest::newRow("reflective") << false;
+    QTest::newRow("cached") << true;
+}
+
+void TestJSONRPC::benchmarkPack()
+{
+    QFETCH(bool, cached);
+
+    IntegrationsHandler handler(NymeaCore::instance()->thingManager());
+
+    // Pack the configured things over and over, as GetThings would on a system with 1500 things
+    QList<Thing*> things;
+    while (things.count() < 1500) {
+        things.append(NymeaCore::instance()->thingManager()->configuredThings());
+    }
+
+    QBENCHMARK {
+        QVariantList packed;
+        foreach (Thing *thing, things) {
+            packed.append(cached ? handler.pack(thing) : handler.packReflective(thing));
+        }
+        QCOMPARE(packed.count(), things.count());
+    }
+}
+
 #include "testjsonrpc.moc"
 
 QTEST_MAIN(TestJSONRPC)
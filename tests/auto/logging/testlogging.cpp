@@ -31,10 +31,13 @@
 #include "nymeatestbase.h"
 #include "nymeacore.h"
 #include "nymeasettings.h"
+#include "logging/logengine.h"
+#include "logging/logfilter.h"
 #include "logging/logvaluetool.h"
 #include "servers/mocktcpserver.h"
 
 #include <qglobal.h>
+#include <QElapsedTimer>
 
 using namespace nymeaserver;
 
@@ -44,6 +47,8 @@ class TestLogging : public NymeaTestBase
 
 private:
 
+    QList<LogEntry> fetchSystemLogEntries(const QDateTime &startDate, const QDateTime &endDate);
+
     inline void verifyLoggingError(const QVariant &response, Logging::LoggingError error = Logging::LoggingErrorNoError) {
         verifyError(response, "loggingError", enumValueName(error));
     }
@@ -84,6 +89,16 @@ private slots:
 
     void testLimits();
 
+    void testCursorPagination();
+
+    void testFloodLogEntries();
+
+    void testSeries_data();
+    void testSeries();
+
+    void benchmarkLogEntries_data();
+    void benchmarkLogEntries();
+
     // this has to be the last test
     void removeThing();
 };
@@ -743,8 +758,246 @@ void TestLogging::testLimits()
     QCOMPARE(response.value("params").toMap().value("logEntries").toList().count(), 10);
 }
 
+void TestLogging::testCursorPagination()
+{
+    clearLoggingDatabase();
+
+    for (int i = 0; i < 50; i++) {
+        QVariantList actionParams;
+        QVariantMap param1;
+        param1.insert("paramTypeId", mockWithParamsActionParam1ParamTypeId);
+        param1.insert("value", i);
+        actionParams.append(param1);
+        QVariantMap param2;
+        param2.insert("paramTypeId", mockWithParamsActionParam2ParamTypeId);
+        param2.insert("value", true);
+        actionParams.append(param2);
+
+        QVariantMap params;
+        params.insert("actionTypeId", mockWithParamsActionTypeId);
+        params.insert("thingId", m_mockThingId);
+        params.insert("params", actionParams);
+
+        QVariant response = injectAndWait("Integrations.ExecuteAction", params);
+        verifyThingError(response);
+    }
+
+    waitForDBSync();
+
+    // Fetch the reference pages using offsets
+    QList<QVariantList> offsetPages;
+    for (int offset = 0; offset < 50; offset += 20) {
+        QVariantMap params;
+        params.insert("limit", 20);
+        params.insert("offset", offset);
+        QVariant response = injectAndWait("Logging.GetLogEntries", params);
+        verifyLoggingError(response);
+        offsetPages.append(response.toMap().value("params").toMap().value("logEntries").toList());
+    }
+
+    // First page
+    QVariantMap params;
+    params.insert("limit", 20);
+    QVariant response = injectAndWait("Logging.GetLogEntries", params);
+    verifyLoggingError(response);
+    QCOMPARE(response.toMap().value("params").toMap().value("logEntries").toList(), offsetPages.at(0));
+    QString cursor = response.toMap().value("params").toMap().value("nextCursor").toString();
+    QVERIFY2(!cursor.isEmpty(), "A full page should provide a cursor");
+
+    // Add new entries while paging, the following pages must not shift
+    QVariantMap actionParams;
+    actionParams.insert("actionTypeId", mockWithoutParamsActionTypeId);
+    actionParams.insert("thingId", m_mockThingId);
+    verifyThingError(injectAndWait("Integrations.ExecuteAction", actionParams));
+    waitForDBSync();
+
+    // Second page
+    params.insert("cursor", cursor);
+    response = injectAndWait("Logging.GetLogEntries", params);
+    verifyLoggingError(response);
+    QCOMPARE(response.toMap().value("params").toMap().value("logEntries").toList(), offsetPages.at(1));
+    cursor = response.toMap().value("params").toMap().value("nextCursor").toString();
+    QVERIFY2(!cursor.isEmpty(), "A full page should provide a cursor");
+
+    // Last page, only 10 entries left
+    params.insert("cursor", cursor);
+    response = injectAndWait("Logging.GetLogEntries", params);
+    verifyLoggingError(response);
+    QCOMPARE(response.toMap().value("params").toMap().value("count").toInt(), 10);
+    QCOMPARE(response.toMap().value("params").toMap().value("logEntries").toList(), offsetPages.at(2));
+    QVERIFY2(!response.toMap().value("params").toMap().contains("nextCursor"), "The last page should not provide a cursor");
+
+    // Invalid cursor
+    params.insert("cursor", "foobar");
+    response = injectAndWait("Logging.GetLogEntries", params);
+    verifyLoggingError(response, Logging::LoggingErrorInvalidFilterParameter);
+
+    // A cursor can't be combined with an offset
+    params.insert("cursor", cursor);
+    params.insert("offset", 10);
+    response = injectAndWait("Logging.GetLogEntries", params);
+    verifyLoggingError(response, Logging::LoggingErrorInvalidFilterParameter);
+}
+
+QList<LogEntry> TestLogging::fetchSystemLogEntries(const QDateTime &startDate, const QDateTime &endDate)
+{
+    LogFilter filter;
+    filter.addLoggingSource(Logging::LoggingSourceSystem);
+    filter.addTimeFilter(startDate, endDate);
+
+    QList<LogEntry> entries;
+    LogEntriesFetchJob *job = NymeaCore::instance()->logEngine()->fetchLogEntries(filter);
+    connect(job, &LogEntriesFetchJob::finished, this, [&entries, job](){
+        entries = job->results();
+    });
+    QSignalSpy finishedSpy(job, &LogEntriesFetchJob::finished);
+    finishedSpy.wait();
+    return entries;
+}
+
+void TestLogging::testFloodLogEntries()
+{
+    LogEngine *logEngine = NymeaCore::instance()->logEngine();
+    logEngine->setMaxLogEntries(50000, 100);
+    clearLoggingDatabase();
+    waitForDBSync();
+
+    // Use a time range no other entry can be in
+    QDateTime startDate = QDateTime::fromMSecsSinceEpoch(946684800000); // 2000-01-01
+    int entryCount = 20000;
+
+    QSignalSpy addedSpy(logEngine, &LogEngine::logEntryAdded);
+    for (int i = 0; i < entryCount; i++) {
+        logEngine->logSystemEvent(startDate.addMSecs(i), i % 2 == 0);
+    }
+    waitForDBSync();
+
+    QCOMPARE(addedSpy.count(), entryCount);
+
+    QList<LogEntry> entries = fetchSystemLogEntries(startDate, startDate.addMSecs(entryCount));
+    QCOMPARE(entries.count(), entryCount);
+    for (int i = 0; i < entries.count(); i++) {
+        // Sorted by timestamp, newest first
+        QCOMPARE(entries.at(i).timestamp(), startDate.addMSecs(entryCount - 1 - i));
+        QCOMPARE(entries.at(i).active(), (entryCount - 1 - i) % 2 == 0);
+    }
+
+    clearLoggingDatabase();
+    waitForDBSync();
+    logEngine->setMaxLogEntries(1000, 10);
+}
+
+void TestLogging::testSeries_data()
+{
+    QTest::addColumn<QString>("function");
+    QTest::addColumn<QVariant>("expectedValue");
+
+    QTest::newRow("average") << enumValueName(Logging::SeriesFunctionAverage) << QVariant(2.5);
+    QTest::newRow("minimum") << enumValueName(Logging::SeriesFunctionMinimum) << QVariant(1);
+    QTest::newRow("maximum") << enumValueName(Logging::SeriesFunctionMaximum) << QVariant(4);
+    QTest::newRow("last") << enumValueName(Logging::SeriesFunctionLast) << QVariant(4);
+}
+
+void TestLogging::testSeries()
+{
+    QFETCH(QString, function);
+    QFETCH(QVariant, expectedValue);
+
+    QList<Thing*> devices = NymeaCore::instance()->thingManager()->findConfiguredThings(mockThingClassId);
+    QVERIFY2(devices.count() > 0, "There needs to be at least one configured Mock Device for this test");
+    Thing *device = devices.first();
+    int port = device->paramValue(mockThingHttpportParamTypeId).toInt();
+
+    QNetworkAccessManager nam;
+    QDateTime startTime = QDateTime::currentDateTime();
+
+    // init state in mock device and log values 1 to 4
+    for (int i = 0; i <= 4; i++) {
+        QNetworkRequest request(QUrl(QString("http://localhost:%1/setstate?%2=%3").arg(port).arg(mockIntStateTypeId.toString()).arg(i)));
+        QNetworkReply *reply = nam.get(request);
+        QSignalSpy finishedSpy(reply, &QNetworkReply::finished);
+        finishedSpy.wait();
+        reply->deleteLater();
+        if (i == 0) {
+            waitForDBSync();
+            clearLoggingDatabase();
+        }
+    }
+    waitForDBSync();
+
+    QVariantMap params;
+    params.insert("thingId", device->id());
+    params.insert("typeId", mockIntStateTypeId);
+    params.insert("from", startTime.toTime_t() - 60);
+    params.insert("to", QDateTime::currentDateTime().toTime_t() + 60);
+    params.insert("bucketSize", 3600);
+    params.insert("function", function);
+    QVariant response = injectAndWait("Logging.GetSeries", params);
+    verifyLoggingError(response);
+
+    QVariantList series = response.toMap().value("params").toMap().value("series").toList();
+    QCOMPARE(series.count(), 1);
+    QCOMPARE(series.first().toMap().value("timestamp").toLongLong(), (startTime.toTime_t() - 60) * 1000ll);
+    QCOMPARE(series.first().toMap().value("value").toDouble(), expectedValue.toDouble());
+
+    // Buckets must have a size
+    params.insert("bucketSize", 0);
+    response = injectAndWait("Logging.GetSeries", params);
+    verifyLoggingError(response, Logging::LoggingErrorInvalidFilterParameter);
+}
+
+void TestLogging::benchmarkLogEntries_data()
+{
+    QTest::addColumn<int>("entryCount");
+
+    QTest::newRow("1000 entries") << 1000;
+    QTest::newRow("10000 entries") << 10000;
+    QTest::newRow("50000 entries") << 50000;
+}
+
+void TestLogging::benchmarkLogEntries()
+{
+    QFETCH(int, entryCount);
+
+    LogEngine *logEngine = NymeaCore::instance()->logEngine();
+    logEngine->setMaxLogEntries(entryCount * 2, 100);
+    clearLoggingDatabase();
+    waitForDBSync();
+
+    QDateTime startDate = QDateTime::fromMSecsSinceEpoch(946684800000); // 2000-01-01
+
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK_ONCE {
+        for (int i = 0; i < entryCount; i++) {
+            logEngine->logSystemEvent(startDate.addMSecs(i), true);
+        }
+        waitForDBSync();
+    }
+    qint64 elapsed = qMax(timer.elapsed(), 1ll);
+    qCDebug(dcTests()) << "Persisted" << entryCount << "log entries in" << elapsed << "ms (" << entryCount * 1000 / elapsed << "entries/s)";
+
+    // Nothing may be dropped on the way
+    QCOMPARE(fetchSystemLogEntries(startDate, startDate.addMSecs(entryCount)).count(), entryCount);
+
+    clearLoggingDatabase();
+    waitForDBSync();
+    logEngine->setMaxLogEntries(1000, 10);
+}
+
 void TestLogging::removeThing()
 {
+    // Earlier tests may have cleared the database, make sure there is a log entry for the thing
+    Thing *thing = NymeaCore::instance()->thingManager()->findConfiguredThing(m_mockThingId);
+    QVERIFY(thing);
+    int port = thing->paramValue(mockThingHttpportParamTypeId).toInt();
+    QNetworkAccessManager nam;
+    QNetworkReply *reply = nam.get(QNetworkRequest(QUrl(QString("http://localhost:%1/setstate?%2=%3").arg(port).arg(mockIntStateTypeId.toString()).arg(thing->stateValue(mockIntStateTypeId).toInt() + 1))));
+    QSignalSpy finishedSpy(reply, &QNetworkReply::finished);
+    finishedSpy.wait();
+    reply->deleteLater();
+    waitForDBSync();
+
     // enable notifications
     enableNotifications({"Logging"});
 
@@ -33,6 +33,10 @@
 #include "logging/logengine.h"
 #include "logging/logvaluetool.h"
 
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+
 using namespace nymeaserver;
 
 class TestLoggingLoading: public QObject
@@ -46,6 +50,10 @@ protected slots:
 
 private slots:
     void testLogfileRotation();
+    void testMigrationV4ToV5();
+
+private:
+    void waitForJobs(LogEngine *logEngine);
 };
 
 TestLoggingLoading::TestLoggingLoading(QObject *parent): QObject(parent)
@@ -89,5 +97,89 @@ void TestLoggingLoading::testLogfileRotation()
     QVERIFY(QFile(rotatedDbName).remove());
 }
 
+void TestLoggingLoading::waitForJobs(LogEngine *logEngine)
+{
+    while (logEngine->jobsRunning()) {
+        qApp->processEvents();
+    }
+}
+
+void TestLoggingLoading::testMigrationV4ToV5()
+{
+    QString temporaryDbName = "/tmp/nymea-test/nymead-v4.sqlite";
+    QVERIFY(QDir().mkpath("/tmp/nymea-test"));
+    if (QFile::exists(temporaryDbName))
+        QVERIFY(QFile(temporaryDbName).remove());
+
+    // Create a version 4 database without indexes
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "v4-setup");
+        db.setDatabaseName(temporaryDbName);
+        QVERIFY(db.open());
+        db.exec("CREATE TABLE metadata (`key` VARCHAR(10), data VARCHAR(40));");
+        db.exec("INSERT INTO metadata (`key`, data) VALUES('version', '4');");
+        db.exec("CREATE TABLE entries (timestamp BIGINT, loggingLevel INT, sourceType INT, typeId VARCHAR(38), thingId VARCHAR(38), value VARCHAR(100), loggingEventType INT, active BOOL, errorCode INT);");
+        QVERIFY(db.transaction());
+        QSqlQuery insertQuery(db);
+        insertQuery.prepare("INSERT INTO entries (timestamp, loggingLevel, sourceType, typeId, thingId, value, loggingEventType, active, errorCode) VALUES (?, 0, 0, '', '', '', 0, 1, 0);");
+        for (int i = 0; i < 100; i++) {
+            // Groups of 4 entries share the same timestamp
+            insertQuery.addBindValue(1000 + i / 4);
+            QVERIFY(insertQuery.exec());
+        }
+        // Leave a gap in the rowids, like removing the logs of a thing does
+        QVERIFY(db.exec("DELETE FROM entries WHERE rowid > 60 AND rowid <= 80;").lastError().type() == QSqlError::NoError);
+        QVERIFY(db.commit());
+        db.close();
+    }
+    QSqlDatabase::removeDatabase("v4-setup");
+
+    LogEngine *logEngine = new LogEngine("QSQLITE", temporaryDbName);
+    waitForJobs(logEngine);
+
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "v4-verify");
+    db.setDatabaseName(temporaryDbName);
+    QVERIFY(db.open());
+
+    QSqlQuery versionQuery = db.exec("SELECT data FROM metadata WHERE `key` = 'version';");
+    QVERIFY(versionQuery.next());
+    QCOMPARE(versionQuery.value(0).toInt(), 5);
+
+    QStringList indexes;
+    QSqlQuery indexQuery = db.exec("SELECT name FROM sqlite_master WHERE type = 'index' AND tbl_name = 'entries';");
+    while (indexQuery.next()) {
+        indexes.append(indexQuery.value(0).toString());
+    }
+    QVERIFY(indexes.contains("idx_entries_timestamp"));
+    QVERIFY(indexes.contains("idx_entries_thingId_typeId_timestamp"));
+    QVERIFY(indexes.contains("idx_entries_sourceType_timestamp"));
+
+    // Trim to exactly 40 entries, even though the cutoff falls within entries sharing a timestamp
+    // and the rowids have a gap
+    logEngine->setMaxLogEntries(50, 10);
+    waitForJobs(logEngine);
+
+    QSqlQuery countQuery = db.exec("SELECT COUNT(*), MIN(timestamp) FROM entries;");
+    QVERIFY(countQuery.next());
+    QCOMPARE(countQuery.value(0).toInt(), 40);
+    QCOMPARE(countQuery.value(1).toLongLong(), 1010ll);
+
+    // The entry count must follow the table, the next trim keeps exactly 40 entries again
+    for (int i = 0; i < 15; i++) {
+        logEngine->logSystemEvent(QDateTime::currentDateTime(), true);
+    }
+    waitForJobs(logEngine);
+    countQuery = db.exec("SELECT COUNT(*) FROM entries;");
+    QVERIFY(countQuery.next());
+    QCOMPARE(countQuery.value(0).toInt(), 40);
+
+    delete logEngine;
+    db.close();
+    db = QSqlDatabase();
+    QSqlDatabase::removeDatabase("v4-verify");
+
+    QVERIFY(QFile(temporaryDbName).remove());
+}
+
 #include "testloggingloading.moc"
 QTEST_MAIN(TestLoggingLoading)
@@ -0,0 +1,6 @@
+TARGET = testloggingoutput
+
+include(../../../nymea.pri)
+include(../autotests.pri)
+
+SOURCES += testloggingoutput.cpp
@@ -0,0 +1,134 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "loggingcategories.h"
+
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+Q_LOGGING_CATEGORY(dcLoggingOutputTest, "LoggingOutputTest")
+
+class LogFloodThread: public QThread
+{
+public:
+    LogFloodThread(int id, int count): m_id(id), m_count(count) { }
+
+protected:
+    void run() override
+    {
+        for (int i = 0; i < m_count; i++) {
+            qCDebug(dcLoggingOutputTest()) << "Flood message" << m_id << i;
+        }
+    }
+
+private:
+    int m_id = 0;
+    int m_count = 0;
+};
+
+class TestLoggingOutput: public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void floodFromThreads();
+};
+
+void TestLoggingOutput::floodFromThreads()
+{
+    static const int threadCount = 4;
+    static const int messagesPerThread = 20000;
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString fileName = dir.filePath("nymead.log");
+
+    // The console output of the flood is not of interest, keep it out of the test output
+    fflush(stdout);
+    int stdoutFd = dup(STDOUT_FILENO);
+    int nullFd = open("/dev/null", O_WRONLY);
+    dup2(nullFd, STDOUT_FILENO);
+    close(nullFd);
+
+    QtMessageHandler previousHandler = qInstallMessageHandler(nullptr);
+    QVERIFY(initLogging(fileName, false));
+
+    QList<LogFloodThread *> threads;
+    for (int i = 0; i < threadCount; i++) {
+        threads.append(new LogFloodThread(i, messagesPerThread));
+    }
+    foreach (LogFloodThread *thread, threads) {
+        thread->start();
+    }
+    foreach (LogFloodThread *thread, threads) {
+        thread->wait();
+        delete thread;
+    }
+
+    // Writes out everything still queued, including the final dropped messages count
+    closeLogFile();
+    qInstallMessageHandler(previousHandler);
+
+    fflush(stdout);
+    dup2(stdoutFd, STDOUT_FILENO);
+    close(stdoutFd);
+
+    QFile file(fileName);
+    QVERIFY(file.open(QFile::ReadOnly));
+    QRegularExpression droppedExpression("Log buffer full. Dropped (\\d+) messages.");
+    int written = 0;
+    int dropped = 0;
+    int droppedLines = 0;
+    while (!file.atEnd()) {
+        QString line = QString::fromUtf8(file.readLine());
+        if (line.contains("LoggingOutputTest: Flood message")) {
+            written++;
+            continue;
+        }
+        QRegularExpressionMatch match = droppedExpression.match(line);
+        if (match.hasMatch()) {
+            dropped += match.captured(1).toInt();
+            droppedLines++;
+        }
+    }
+
+    // Every message is either written or accounted for in a dropped messages line
+    QCOMPARE(written + dropped, threadCount * messagesPerThread);
+    if (droppedLines == 0) {
+        QWARN("The writer kept up with the flood, the dropped messages line has not been exercised.");
+    }
+}
+
+#include "testloggingoutput.moc"
+QTEST_MAIN(TestLoggingOutput)
@@ -0,0 +1,6 @@
+TARGET = testmacaddressdatabase
+
+include(../../../nymea.pri)
+include(../autotests.pri)
+
+SOURCES += testmacaddressdatabase.cpp
@@ -0,0 +1,123 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "network/macaddressdatabase.h"
+
+#include <QtTest>
+#include <QSignalSpy>
+#include <QSqlQuery>
+#include <QTemporaryDir>
+
+class TestMacAddressDatabase: public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void lookupManufacturer_data();
+    void lookupManufacturer();
+
+    void lookupManufacturers();
+    void lookupMacAddress();
+
+private:
+    QTemporaryDir m_dataDir;
+    QString m_databaseName;
+};
+
+void TestMacAddressDatabase::initTestCase()
+{
+    // A small registry with nested MA-L, MA-M and MA-S assignments like the IEEE ones
+    QVERIFY(m_dataDir.isValid());
+    m_databaseName = m_dataDir.filePath("mac-addresses.db");
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "setup");
+        db.setDatabaseName(m_databaseName);
+        QVERIFY(db.open());
+        QSqlQuery query(db);
+        QVERIFY(query.exec("CREATE TABLE companyNames (companyName TEXT);"));
+        QVERIFY(query.exec("CREATE TABLE oui (oui TEXT, companyNameIndex INTEGER);"));
+        QVERIFY(query.exec("INSERT INTO companyNames (rowid, companyName) VALUES (1, 'Large Vendor'), (2, 'IEEE Registration Authority'), (3, 'Medium Vendor'), (4, 'Small Vendor');"));
+        QVERIFY(query.exec("INSERT INTO oui (oui, companyNameIndex) VALUES ('001122', 1), ('70B3D5', 2), ('70B3D51', 3), ('70B3D5F2A', 4);"));
+        db.close();
+    }
+    QSqlDatabase::removeDatabase("setup");
+}
+
+void TestMacAddressDatabase::lookupManufacturer_data()
+{
+    QTest::addColumn<QString>("macAddress");
+    QTest::addColumn<QString>("manufacturer");
+
+    QTest::newRow("MA-L") << "00:11:22:33:44:55" << "Large Vendor";
+    QTest::newRow("MA-L lower case") << "00:11:22:aa:bb:cc" << "Large Vendor";
+    QTest::newRow("MA-L prefix only") << "00:11:22" << "Large Vendor";
+    QTest::newRow("MA-M") << "70:B3:D5:1A:BB:CC" << "Medium Vendor";
+    QTest::newRow("MA-S") << "70-B3-D5-F2-AB-CD" << "Small Vendor";
+    QTest::newRow("MA-S neighbour") << "70:B3:D5:F2:BB:CD" << "IEEE Registration Authority";
+    QTest::newRow("unknown") << "AA:BB:CC:DD:EE:FF" << "";
+    QTest::newRow("invalid") << "foo" << "";
+    QTest::newRow("empty") << "" << "";
+}
+
+void TestMacAddressDatabase::lookupManufacturer()
+{
+    QFETCH(QString, macAddress);
+    QFETCH(QString, manufacturer);
+
+    MacAddressDatabase database(m_databaseName);
+    QVERIFY(database.available());
+    QCOMPARE(database.lookupManufacturer(macAddress), manufacturer);
+}
+
+void TestMacAddressDatabase::lookupManufacturers()
+{
+    MacAddressDatabase database(m_databaseName);
+    QVERIFY(database.available());
+
+    QStringList macAddresses = { "70:B3:D5:1A:BB:CC", "", "00:11:22:33:44:55", "AA:BB:CC:DD:EE:FF" };
+    QStringList manufacturers = { "Medium Vendor", "", "Large Vendor", "" };
+    QCOMPARE(database.lookupManufacturers(macAddresses), manufacturers);
+}
+
+void TestMacAddressDatabase::lookupMacAddress()
+{
+    MacAddressDatabase database(m_databaseName);
+    QVERIFY(database.available());
+
+    MacAddressDatabaseReply *reply = database.lookupMacAddress("70:B3:D5:F2:AB:CD");
+    QSignalSpy finishedSpy(reply, &MacAddressDatabaseReply::finished);
+    QVERIFY(finishedSpy.wait());
+    QCOMPARE(reply->manufacturer(), QString("Small Vendor"));
+}
+
+#include "testmacaddressdatabase.moc"
+QTEST_MAIN(TestMacAddressDatabase)
@@ -32,6 +32,7 @@
 #include "nymeacore.h"
 #include "servers/mqttbroker.h"
 #include "servers/mocktcpserver.h"
+#include "servers/mqtttopictrie.h"
 
 #include <mqttclient.h>
 
@@ -57,6 +58,11 @@ private slots:
 
     void testSubscribePolicy_data();
     void testSubscribePolicy();
+
+    void testTopicTrie_data();
+    void testTopicTrie();
+
+    void benchmarkTopicTrie();
 };
 
 void TestMqttBroker::initTestCase()
@@ -447,7 +453,80 @@ void TestMqttBroker::testSubscribePolicy()
     clientSubscribedSpy.wait(400);
     QCOMPARE(clientSubscribedSpy.count(), (allowed ? 1 : 0));
 }
+void TestMqttBroker::testTopicTrie_data()
+{
+    QTest::addColumn<QStringList>("topicFilters");
+    QTest::addColumn<QString>("topic");
+    QTest::addColumn<bool>("matches");
+
+    QTest::newRow("none, a") << QStringList() << "a" << false;
+    QTest::newRow("#, /") << (QStringList() << "#") << "/" << true;
+    QTest::newRow("#, a/b/c") << (QStringList() << "#") << "a/b/c" << true;
+    QTest::newRow("a, a") << (QStringList() << "a") << "a" << true;
+    QTest::newRow("a, a/b") << (QStringList() << "a") << "a/b" << false;
+    QTest::newRow("a/b, a") << (QStringList() << "a/b") << "a" << false;
+    QTest::newRow("a b, b") << (QStringList() << "a" << "b") << "b" << true;
+    QTest::newRow("a/#, a") << (QStringList() << "a/#") << "a" << true;
+    QTest::newRow("a/+, a") << (QStringList() << "a/+") << "a" << false;
+    QTest::newRow("a/+, a/b") << (QStringList() << "a/+") << "a/b" << true;
+    QTest::newRow("a/+, a/b/c") << (QStringList() << "a/+") << "a/b/c" << false;
+    QTest::newRow("+/+, /") << (QStringList() << "+/+") << "/" << true;
+    QTest::newRow("/a/#, /a/b/c") << (QStringList() << "/a/#") << "/a/b/c" << true;
+    QTest::newRow("/a/#, /b/a/c") << (QStringList() << "/a/#") << "/b/a/c" << false;
+    QTest::newRow("/+/b/#, /a/b") << (QStringList() << "/+/b/#") << "/a/b" << true;
+    QTest::newRow("/+/b/#, /b") << (QStringList() << "/+/b/#") << "/b" << false;
+    QTest::newRow("a/b a/+/c, a/b/c") << (QStringList() << "a/b" << "a/+/c") << "a/b/c" << true;
+    QTest::newRow("a/b/d a/+/c, a/b/e") << (QStringList() << "a/b/d" << "a/+/c") << "a/b/e" << false;
+    QTest::newRow("a/+, a/+") << (QStringList() << "a/+") << "a/+" << true;
+    QTest::newRow("a/b, a/+") << (QStringList() << "a/b") << "a/+" << false;
+    QTest::newRow("a/+, a/#") << (QStringList() << "a/+") << "a/#" << false;
+    QTest::newRow("+, #") << (QStringList() << "+") << "#" << false;
+    QTest::newRow("a/+/#, a/b/#") << (QStringList() << "a/+/#") << "a/b/#" << true;
+    QTest::newRow("a/#, a/b/#") << (QStringList() << "a/#") << "a/b/#" << true;
+    QTest::newRow("#, #") << (QStringList() << "#") << "#" << true;
+    QTest::newRow("a/b/#, a/#") << (QStringList() << "a/b/#") << "a/#" << false;
+}
+
+void TestMqttBroker::testTopicTrie()
+{
+    QFETCH(QStringList, topicFilters);
+    QFETCH(QString, topic);
+    QFETCH(bool, matches);
+
+    MqttTopicTrie trie(topicFilters);
+    QCOMPARE(trie.matches(topic), matches);
+}
+
+void TestMqttBroker::benchmarkTopicTrie()
+{
+    // A client policy with a few hundred filters, checked against a stream of publishes
+    QStringList topicFilters;
+    for (int i = 0; i < 100; i++) {
+        topicFilters << QString("nymea/things/%1/+/state").arg(i);
+        topicFilters << QString("nymea/things/%1/actions/#").arg(i);
+        topicFilters << QString("sensors/%1/temperature").arg(i);
+    }
+    MqttTopicTrie trie(topicFilters);
+
+    QStringList topics;
+    for (int i = 0; i < 1000; i++) {
+        topics << QString("nymea/things/%1/power/state").arg(i % 200);
+        topics << QString("nymea/things/%1/actions/execute/%2").arg(i % 200).arg(i);
+        topics << QString("sensors/%1/humidity").arg(i % 100);
+    }
 
+    int matched = 0;
+    QBENCHMARK {
+        matched = 0;
+        foreach (const QString &topic, topics) {
+            if (trie.matches(topic)) {
+                matched++;
+            }
+        }
+    }
+    // Things 0-99 are covered by the state and actions filters, no humidity filter exists
+    QCOMPARE(matched, 1000);
+}
 
 #include "testmqttbroker.moc"
 QTEST_MAIN(TestMqttBroker)
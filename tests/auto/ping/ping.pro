@@ -0,0 +1,6 @@
+TARGET = testping
+
+include(../../../nymea.pri)
+include(../autotests.pri)
+
+SOURCES += testping.cpp
@@ -0,0 +1,102 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright 2013 - 2020, nymea GmbH
+* Contact: contact@nymea.io
+*
+* This file is part of nymea.
+* This project including source code and documentation is protected by
+* copyright law, and remains the property of nymea GmbH. All rights, including
+* reproduction, publication, editing and translation, are reserved. The use of
+* this project is subject to the terms of a license agreement to be concluded
+* with nymea GmbH in accordance with the terms of use of nymea GmbH, available
+* under https://nymea.io/license
+*
+* GNU General Public License Usage
+* Alternatively, this project may be redistributed and/or modified under the
+* terms of the GNU General Public License as published by the Free Software
+* Foundation, GNU version 3. This project is distributed in the hope that it
+* will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+* of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+* Public License for more details.
+*
+* You should have received a copy of the GNU General Public License along with
+* this project. If not, see <https://www.gnu.org/licenses/>.
+*
+* For any further details and any questions please contact us under
+* contact@nymea.io or see our FAQ/Licensing Information on
+* https://nymea.io/license/faq
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "network/ping.h"
+
+#include <QtTest>
+#include <QSignalSpy>
+
+class TestPing: public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void sweepLoopback();
+    void unavailableSocket();
+};
+
+void TestPing::sweepLoopback()
+{
+    Ping ping;
+    if (!ping.available())
+        QSKIP("Raw ICMP sockets are not permitted for this user.");
+
+    // The kernel answers echo requests for the whole 127.0.0.0/8 network, which makes it a local responder
+    // for a sweep larger than a /24 network.
+    const uint timeout = 5;
+    QHash<PingReply *, QHostAddress> replies;
+    QList<PingReply *> finishedReplies;
+    QElapsedTimer timer;
+    timer.start();
+    quint32 start = QHostAddress("127.0.0.1").toIPv4Address();
+    for (quint32 i = 0; i < 510; i++) {
+        QHostAddress address(start + i);
+        PingReply *reply = ping.ping(address, timeout);
+        replies.insert(reply, address);
+        connect(reply, &PingReply::finished, this, [=, &finishedReplies, &replies](){
+            finishedReplies.append(reply);
+            QCOMPARE(reply->error(), PingReply::ErrorNoError);
+            QCOMPARE(reply->targetHostAddress(), replies.value(reply));
+        });
+    }
+
+    QTRY_COMPARE_WITH_TIMEOUT(finishedReplies.count(), replies.count(), 30000);
+
+    // The whole sweep must take about one ping timeout at most, no matter how many hosts it covers
+    QVERIFY2(timer.elapsed() < 2 * timeout * 1000, "Echo requests have not been sent concurrently.");
+}
+
+void TestPing::unavailableSocket()
+{
+    Ping ping;
+    if (ping.available())
+        QSKIP("Raw ICMP sockets are permitted for this user.");
+
+    // Without a socket every reply must fail right away with the socket error, not wait for its timeout
+    const uint timeout = 5;
+    QList<PingReply *> finishedReplies;
+    QElapsedTimer timer;
+    timer.start();
+    quint32 start = QHostAddress("127.0.0.1").toIPv4Address();
+    for (quint32 i = 0; i < 510; i++) {
+        PingReply *reply = ping.ping(QHostAddress(start + i), timeout);
+        connect(reply, &PingReply::finished, this, [=, &finishedReplies, &ping](){
+            finishedReplies.append(reply);
+            QVERIFY(reply->error() != PingReply::ErrorNoError);
+            QCOMPARE(reply->error(), ping.error());
+        });
+    }
+
+    QTRY_COMPARE_WITH_TIMEOUT(finishedReplies.count(), 510, 30000);
+    QVERIFY2(timer.elapsed() < timeout * 1000, "Replies waited for their timeout instead of failing right away.");
+}
+
+#include "testping.moc"
+QTEST_MAIN(TestPing)
@@ -59,6 +59,8 @@ private:
 
     void generateEvent(const EventTypeId &eventTypeId);
 
+    void verifyIncrementalEvaluation(StateEvaluator &evaluator, const ThingId &thingId, const StateTypeId &stateTypeId, const QVariant &value);
+
     inline void verifyRuleError(const QVariant &response, RuleEngine::RuleError error = RuleEngine::RuleErrorNoError) {
         verifyError(response, "ruleError", enumValueName(error));
     }
@@ -105,6 +107,14 @@ private slots:
     void testChildEvaluator_data();
     void testChildEvaluator();
 
+    void testIncrementalStateEvaluator_data();
+    void testIncrementalStateEvaluator();
+
+    void testIncrementalInterfaceStateEvaluator();
+
+    void testIncrementalStateEvaluatorRecompile_data();
+    void testIncrementalStateEvaluatorRecompile();
+
     void testStateChange();
 
     void enableDisableRule();
@@ -138,6 +148,9 @@ private slots:
 
     void testHousekeeping_data();
     void testHousekeeping();
+
+    void benchmarkEvaluateEvent_data();
+    void benchmarkEvaluateEvent();
 };
 
 void TestRules::cleanupMockHistory() {
@@ -405,6 +418,18 @@ void TestRules::generateEvent(const EventTypeId &eventTypeId)
 
 }
 
+void TestRules::verifyIncrementalEvaluation(StateEvaluator &evaluator, const ThingId &thingId, const StateTypeId &stateTypeId, const QVariant &value)
+{
+    Thing *thing = NymeaCore::instance()->thingManager()->findConfiguredThing(thingId);
+    QVERIFY2(thing, "Thing for state change not found");
+    thing->setStateValue(stateTypeId, value);
+
+    Event stateChangeEvent(EventTypeId(stateTypeId.toString()), thingId, ParamList() << Param(ParamTypeId(stateTypeId.toString()), value), true);
+    bool incrementalResult = evaluator.evaluateStateChange(stateChangeEvent);
+    QCOMPARE(incrementalResult, evaluator.evaluate());
+    QCOMPARE(evaluator.result(), incrementalResult);
+}
+
 void TestRules::initTestCase()
 {
     NymeaTestBase::initTestCase();
@@ -2064,6 +2089,159 @@ void TestRules::testChildEvaluator()
     verifyRuleError(response);
 }
 
+void TestRules::testIncrementalStateEvaluator_data()
+{
+    QTest::addColumn<Types::StateOperator>("rootOperator");
+    QTest::addColumn<Types::StateOperator>("firstOperator");
+    QTest::addColumn<Types::StateOperator>("secondOperator");
+
+    QList<Types::StateOperator> operators = {Types::StateOperatorAnd, Types::StateOperatorOr};
+    foreach (Types::StateOperator rootOperator, operators) {
+        foreach (Types::StateOperator firstOperator, operators) {
+            foreach (Types::StateOperator secondOperator, operators) {
+                QString name = QString("%1 (%2, %3)").arg(enumValueName(rootOperator)).arg(enumValueName(firstOperator)).arg(enumValueName(secondOperator));
+                QTest::newRow(name.toUtf8()) << rootOperator << firstOperator << secondOperator;
+            }
+        }
+    }
+}
+
+void TestRules::testIncrementalStateEvaluator()
+{
+    QFETCH(Types::StateOperator, rootOperator);
+    QFETCH(Types::StateOperator, firstOperator);
+    QFETCH(Types::StateOperator, secondOperator);
+
+    Thing *thing = NymeaCore::instance()->thingManager()->findConfiguredThing(m_mockThingId);
+    QVERIFY(thing);
+    thing->setStateValue(mockIntStateTypeId, 10);
+    thing->setStateValue(mockBoolStateTypeId, false);
+    thing->setStateValue(mockDoubleStateTypeId, 2.7);
+    thing->setStateValue(mockBatteryCriticalStateTypeId, false);
+
+    // int > 20 <root> ((bool == true <first> double < 5) , (int <= 40 <second> batteryCritical == true))
+    StateEvaluator first(StateDescriptor(mockBoolStateTypeId, m_mockThingId, true, Types::ValueOperatorEquals));
+    first.appendEvaluator(StateEvaluator(StateDescriptor(mockDoubleStateTypeId, m_mockThingId, 5.0, Types::ValueOperatorLess)));
+    first.setOperatorType(firstOperator);
+
+    QList<StateEvaluator> secondChildren;
+    secondChildren.append(StateEvaluator(StateDescriptor(mockIntStateTypeId, m_mockThingId, 40, Types::ValueOperatorLessOrEqual)));
+    secondChildren.append(StateEvaluator(StateDescriptor(mockBatteryCriticalStateTypeId, m_mockThingId, true, Types::ValueOperatorEquals)));
+    StateEvaluator second(secondChildren, secondOperator);
+
+    StateEvaluator evaluator(StateDescriptor(mockIntStateTypeId, m_mockThingId, 20, Types::ValueOperatorGreater));
+    evaluator.setChildEvaluators(QList<StateEvaluator>() << first << second);
+    evaluator.setOperatorType(rootOperator);
+
+    evaluator.compile();
+    QCOMPARE(evaluator.result(), evaluator.evaluate());
+
+    verifyIncrementalEvaluation(evaluator, m_mockThingId, mockIntStateTypeId, 25);
+    verifyIncrementalEvaluation(evaluator, m_mockThingId, mockBoolStateTypeId, true);
+    verifyIncrementalEvaluation(evaluator, m_mockThingId, mockBatteryCriticalStateTypeId, true);
+    verifyIncrementalEvaluation(evaluator, m_mockThingId, mockDoubleStateTypeId, 7.5);
+    verifyIncrementalEvaluation(evaluator, m_mockThingId, mockIntStateTypeId, 50);
+    verifyIncrementalEvaluation(evaluator, m_mockThingId, mockBoolStateTypeId, false);
+    verifyIncrementalEvaluation(evaluator, m_mockThingId, mockDoubleStateTypeId, 1.5);
+    verifyIncrementalEvaluation(evaluator, m_mockThingId, mockIntStateTypeId, 30);
+    verifyIncrementalEvaluation(evaluator, m_mockThingId, mockBatteryCriticalStateTypeId, false);
+    verifyIncrementalEvaluation(evaluator, m_mockThingId, mockIntStateTypeId, 10);
+    verifyIncrementalEvaluation(evaluator, m_mockThingId, mockDoubleStateTypeId, 2.7);
+}
+
+void TestRules::testIncrementalInterfaceStateEvaluator()
+{
+    Thing *thing = NymeaCore::instance()->thingManager()->findConfiguredThing(m_mockThingId);
+    QVERIFY(thing);
+    thing->setStateValue(mockIntStateTypeId, 10);
+    thing->setStateValue(mockBatteryCriticalStateTypeId, false);
+
+    // batteryCritical == true on any battery || int > 100
+    StateEvaluator evaluator(StateDescriptor("battery", "batteryCritical", true, Types::ValueOperatorEquals));
+    evaluator.appendEvaluator(StateEvaluator(StateDescriptor(mockIntStateTypeId, m_mockThingId, 100, Types::ValueOperatorGreater)));
+    evaluator.setOperatorType(Types::StateOperatorOr);
+
+    evaluator.compile();
+    QCOMPARE(evaluator.result(), evaluator.evaluate());
+
+    verifyIncrementalEvaluation(evaluator, m_mockThingId, mockBatteryCriticalStateTypeId, true);
+    verifyIncrementalEvaluation(evaluator, m_mockThingId, mockBatteryCriticalStateTypeId, false);
+
+    // Add a thing implementing the interface after the evaluator has been compiled
+    QVariantMap params;
+    params.insert("thingClassId", mockThingClassId);
+    params.insert("name", "Incremental evaluator battery");
+    QVariantMap httpParam;
+    httpParam.insert("paramTypeId", mockThingHttpportParamTypeId);
+    httpParam.insert("value", 6668);
+    params.insert("thingParams", QVariantList() << httpParam);
+    QVariant response = injectAndWait("Integrations.AddThing", params);
+    ThingId thingId = ThingId(response.toMap().value("params").toMap().value("thingId").toUuid());
+    QVERIFY2(!thingId.isNull(), "Something went wrong creating the thing for testing.");
+
+    // The new thing is critical without the evaluator seeing the change of it
+    Thing *newThing = NymeaCore::instance()->thingManager()->findConfiguredThing(thingId);
+    QVERIFY(newThing);
+    newThing->setStateValue(mockBatteryCriticalStateTypeId, true);
+    verifyIncrementalEvaluation(evaluator, m_mockThingId, mockIntStateTypeId, 20);
+    QCOMPARE(evaluator.result(), true);
+
+    verifyIncrementalEvaluation(evaluator, thingId, mockBatteryCriticalStateTypeId, false);
+    verifyIncrementalEvaluation(evaluator, thingId, mockBatteryCriticalStateTypeId, true);
+
+    // Remove it again
+    params.clear();
+    params.insert("thingId", thingId);
+    response = injectAndWait("Integrations.RemoveThing", params);
+    verifyThingError(response);
+
+    verifyIncrementalEvaluation(evaluator, m_mockThingId, mockIntStateTypeId, 10);
+}
+
+void TestRules::testIncrementalStateEvaluatorRecompile_data()
+{
+    QTest::addColumn<QString>("modification");
+
+    QTest::newRow("operator") << "operator";
+    QTest::newRow("appended child") << "append";
+    QTest::newRow("state descriptor") << "descriptor";
+    QTest::newRow("child evaluators") << "children";
+}
+
+void TestRules::testIncrementalStateEvaluatorRecompile()
+{
+    QFETCH(QString, modification);
+
+    Thing *thing = NymeaCore::instance()->thingManager()->findConfiguredThing(m_mockThingId);
+    QVERIFY(thing);
+    thing->setStateValue(mockIntStateTypeId, 10);
+    thing->setStateValue(mockBoolStateTypeId, false);
+
+    // int == 10 && bool == true
+    StateEvaluator evaluator(StateDescriptor(mockIntStateTypeId, m_mockThingId, 10, Types::ValueOperatorEquals));
+    evaluator.appendEvaluator(StateEvaluator(StateDescriptor(mockBoolStateTypeId, m_mockThingId, true, Types::ValueOperatorEquals)));
+    evaluator.compile();
+    QCOMPARE(evaluator.result(), false);
+
+    // Modifications after compile() need to be picked up by the next state change
+    if (modification == "operator") {
+        evaluator.setOperatorType(Types::StateOperatorOr);
+    } else if (modification == "append") {
+        evaluator.setOperatorType(Types::StateOperatorOr);
+        evaluator.appendEvaluator(StateEvaluator(StateDescriptor(mockDoubleStateTypeId, m_mockThingId, 100.0, Types::ValueOperatorLess)));
+    } else if (modification == "descriptor") {
+        evaluator.setStateDescriptor(StateDescriptor(mockIntStateTypeId, m_mockThingId, 15, Types::ValueOperatorGreater));
+    } else if (modification == "children") {
+        evaluator.setChildEvaluators(QList<StateEvaluator>() << StateEvaluator(StateDescriptor(mockBoolStateTypeId, m_mockThingId, false, Types::ValueOperatorEquals)));
+    }
+
+    verifyIncrementalEvaluation(evaluator, m_mockThingId, mockDoubleStateTypeId, 2.7);
+    verifyIncrementalEvaluation(evaluator, m_mockThingId, mockIntStateTypeId, 20);
+    verifyIncrementalEvaluation(evaluator, m_mockThingId, mockBoolStateTypeId, true);
+    verifyIncrementalEvaluation(evaluator, m_mockThingId, mockIntStateTypeId, 10);
+    verifyIncrementalEvaluation(evaluator, m_mockThingId, mockBoolStateTypeId, false);
+}
+
 void TestRules::enableDisableRule()
 {
     // Add a rule
@@ -3369,5 +3547,48 @@ void TestRules::testHousekeeping()
     }
 }
 
+void TestRules::benchmarkEvaluateEvent_data()
+{
+    QTest::addColumn<int>("ruleCount");
+
+    QTest::newRow("10 rules") << 10;
+    QTest::newRow("100 rules") << 100;
+    QTest::newRow("500 rules") << 500;
+}
+
+void TestRules::benchmarkEvaluateEvent()
+{
+    QFETCH(int, ruleCount);
+
+    // Only the rules for the event are visited, so the cost should stay flat with a growing number of other rules
+    RuleEngine *ruleEngine = NymeaCore::instance()->ruleEngine();
+    for (int i = 0; i < ruleCount; i++) {
+        Rule rule;
+        rule.setId(RuleId::createRuleId());
+        rule.setName(QString("Benchmark rule %1").arg(i));
+        rule.setEventDescriptors(QList<EventDescriptor>() << EventDescriptor(mockEvent2EventTypeId, m_mockThingId));
+        rule.setActions(QList<RuleAction>() << RuleAction(mockWithoutParamsActionTypeId, m_mockThingId));
+        QCOMPARE(ruleEngine->addRule(rule), RuleEngine::RuleErrorNoError);
+    }
+
+    Rule matchingRule;
+    matchingRule.setId(RuleId::createRuleId());
+    matchingRule.setName("Matching rule");
+    matchingRule.setEventDescriptors(QList<EventDescriptor>() << EventDescriptor(mockEvent1EventTypeId, m_mockThingId));
+    matchingRule.setActions(QList<RuleAction>() << RuleAction(mockWithoutParamsActionTypeId, m_mockThingId));
+    QCOMPARE(ruleEngine->addRule(matchingRule), RuleEngine::RuleErrorNoError);
+
+    // The first event after adding rules visits all of them once
+    Event event(mockEvent1EventTypeId, m_mockThingId);
+    ruleEngine->evaluateEvent(event);
+
+    QList<Rule> rules;
+    QBENCHMARK {
+        rules = ruleEngine->evaluateEvent(event);
+    }
+    QCOMPARE(rules.count(), 1);
+    QCOMPARE(rules.first().id(), matchingRule.id());
+}
+
 #include "testrules.moc"
 QTEST_MAIN(TestRules)
@@ -108,6 +108,8 @@ private slots:
 
     void getUserInfo();
 
+    void tokenValidAfterRestart();
+
 private:
     // m_apiToken is in testBase
     QUuid m_tokenId;
@@ -508,6 +510,26 @@ void TestUsermanager::getUserInfo()
 
 }
 
+void TestUsermanager::tokenValidAfterRestart()
+{
+    authenticate();
+
+    // The token must be loaded from the database again
+    restartServer();
+
+    QVariant response = injectAndWait("Users.GetUserInfo");
+    QCOMPARE(response.toMap().value("status").toString(), QString("success"));
+    QCOMPARE(response.toMap().value("params").toMap().value("userInfo").toMap().value("username").toString(), QString("valid@user.test"));
+
+    // Removed tokens must not be accepted any more
+    UserManager *userManager = NymeaCore::instance()->userManager();
+    QUuid tokenId = userManager->tokenInfo(m_apiToken).id();
+    QVERIFY(!tokenId.isNull());
+    QCOMPARE(userManager->removeToken(tokenId), UserManager::UserErrorNoError);
+    QVERIFY(!userManager->verifyToken(m_apiToken));
+    QVERIFY(userManager->tokenInfo(tokenId).id().isNull());
+}
+
 void TestUsermanager::unauthenticatedCallAfterTokenRemove()
 {
     removeToken();
@@ -62,6 +62,9 @@ private slots:
     void getIcons_data();
     void getIcons();
 
+    void getCachedFiles();
+    void getCachedIcons();
+
     void getDebugServer_data();
     void getDebugServer();
 
@@ -430,6 +433,142 @@ void TestWebserver::getIcons()
     reply->deleteLater();
 }
 
+void TestWebserver::getCachedFiles()
+{
+    // The public folder of the test server is the application directory
+    QString fileName = QCoreApplication::applicationDirPath() + "/cachetest.html";
+    QFile file(fileName);
+    QVERIFY(file.open(QFile::WriteOnly | QFile::Truncate));
+    file.write("<html>nymea</html>");
+    file.close();
+
+    QNetworkAccessManager nam;
+    connect(&nam, &QNetworkAccessManager::sslErrors, [this, &nam](QNetworkReply* reply, const QList<QSslError> &) {
+        reply->ignoreSslErrors();
+    });
+    QSignalSpy clientSpy(&nam, SIGNAL(finished(QNetworkReply*)));
+
+    QNetworkRequest request;
+    request.setUrl(QUrl("https://localhost:3333/cachetest.html"));
+    QNetworkReply *reply = nam.get(request);
+    clientSpy.wait();
+    QCOMPARE(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(), 200);
+    QCOMPARE(reply->readAll(), QByteArray("<html>nymea</html>"));
+    QByteArray etag = reply->rawHeader("ETag");
+    QVERIFY(!etag.isEmpty());
+    QVERIFY(!reply->rawHeader("Last-Modified").isEmpty());
+    reply->deleteLater();
+
+    // Conditional request with the known entity tag
+    clientSpy.clear();
+    request.setRawHeader("If-None-Match", etag);
+    reply = nam.get(request);
+    clientSpy.wait();
+    QCOMPARE(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(), 304);
+    QVERIFY(reply->readAll().isEmpty());
+    reply->deleteLater();
+
+    // A changed file must not be answered from the cache
+    QVERIFY(file.open(QFile::WriteOnly | QFile::Truncate));
+    file.write("<html>nymea changed</html>");
+    file.close();
+
+    clientSpy.clear();
+    reply = nam.get(request);
+    clientSpy.wait();
+    QCOMPARE(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(), 200);
+    QCOMPARE(reply->readAll(), QByteArray("<html>nymea changed</html>"));
+    QVERIFY(reply->rawHeader("ETag") != etag);
+    reply->deleteLater();
+
+    // A change of the same size right after loading may keep the modification time on coarse file systems
+    QVERIFY(file.open(QFile::WriteOnly | QFile::Truncate));
+    file.write("<html>nymea CHANGED</html>");
+    file.close();
+
+    clientSpy.clear();
+    reply = nam.get(request);
+    clientSpy.wait();
+    QCOMPARE(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(), 200);
+    QCOMPARE(reply->readAll(), QByteArray("<html>nymea CHANGED</html>"));
+    reply->deleteLater();
+
+    // The pre-compressed variant is served only to clients accepting gzip
+    QFile gzipFile(fileName + ".gz");
+    QVERIFY(gzipFile.open(QFile::WriteOnly | QFile::Truncate));
+    gzipFile.write("gzip payload");
+    gzipFile.close();
+
+    clientSpy.clear();
+    QNetworkRequest gzipRequest(request.url());
+    gzipRequest.setRawHeader("Accept-Encoding", "deflate, gzip");
+    reply = nam.get(gzipRequest);
+    clientSpy.wait();
+    QCOMPARE(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(), 200);
+    QCOMPARE(reply->rawHeader("Content-Encoding"), QByteArray("gzip"));
+    QCOMPARE(reply->readAll(), QByteArray("gzip payload"));
+    reply->deleteLater();
+
+    clientSpy.clear();
+    gzipRequest.setRawHeader("Accept-Encoding", "gzip;q=0");
+    reply = nam.get(gzipRequest);
+    clientSpy.wait();
+    QVERIFY(reply->rawHeader("Content-Encoding").isEmpty());
+    QCOMPARE(reply->readAll(), QByteArray("<html>nymea CHANGED</html>"));
+    reply->deleteLater();
+
+    // A pre-compressed variant older than the file is outdated and must not be sent
+    QVERIFY(gzipFile.open(QFile::ReadWrite));
+    QVERIFY(gzipFile.setFileTime(QFileInfo(fileName).lastModified().addSecs(-60), QFileDevice::FileModificationTime));
+    gzipFile.close();
+
+    clientSpy.clear();
+    gzipRequest.setRawHeader("Accept-Encoding", "gzip");
+    reply = nam.get(gzipRequest);
+    clientSpy.wait();
+    QCOMPARE(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(), 200);
+    QVERIFY(reply->rawHeader("Content-Encoding").isEmpty());
+    QCOMPARE(reply->readAll(), QByteArray("<html>nymea CHANGED</html>"));
+    reply->deleteLater();
+
+    QVERIFY(file.remove());
+    QVERIFY(gzipFile.remove());
+}
+
+void TestWebserver::getCachedIcons()
+{
+    QNetworkAccessManager nam;
+    connect(&nam, &QNetworkAccessManager::sslErrors, [this, &nam](QNetworkReply* reply, const QList<QSslError> &) {
+        reply->ignoreSslErrors();
+    });
+    QSignalSpy clientSpy(&nam, SIGNAL(finished(QNetworkReply*)));
+
+    QNetworkRequest request;
+    request.setUrl(QUrl("https://localhost:3333/icons/nymea-logo-64x64.png"));
+    QNetworkReply *reply = nam.get(request);
+    clientSpy.wait();
+    QCOMPARE(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(), 200);
+    QByteArray iconData = reply->readAll();
+    QByteArray etag = reply->rawHeader("ETag");
+    QVERIFY(!etag.isEmpty());
+    reply->deleteLater();
+
+    // The cached icon has to be identical
+    clientSpy.clear();
+    reply = nam.get(request);
+    clientSpy.wait();
+    QCOMPARE(reply->readAll(), iconData);
+    QCOMPARE(reply->rawHeader("ETag"), etag);
+    reply->deleteLater();
+
+    clientSpy.clear();
+    request.setRawHeader("If-None-Match", "W/" + etag);
+    reply = nam.get(request);
+    clientSpy.wait();
+    QCOMPARE(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(), 304);
+    reply->deleteLater();
+}
+
 void TestWebserver::getDebugServer_data()
 {
     QTest::addColumn<QString>("method");
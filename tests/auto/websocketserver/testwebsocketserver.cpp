@@ -31,6 +31,7 @@
 #include "nymeatestbase.h"
 #include "nymeacore.h"
 #include "version.h"
+#include "servers/compressioncontext.h"
 
 #include <QWebSocket>
 
@@ -52,6 +53,12 @@ private slots:
 
     void introspect();
 
+    void compression();
+
+    void compressionSizeLimit();
+
+    void benchmarkStartupSequenceBytes();
+
 public slots:
     void sslErrors(const QList<QSslError> &) {
         QWebSocket *socket = static_cast<QWebSocket*>(sender());
@@ -63,6 +70,7 @@ private:
 
     QVariant injectSocketAndWait(const QString &method, const QVariantMap &params = QVariantMap());
     QVariant injectSocketData(const QByteArray &data);
+    qint64 startupSequenceBytes(bool compression);
 };
 
 
@@ -84,6 +92,7 @@ void TestWebSocketServer::initTestCase()
     config.port = 4444;
     config.sslEnabled = true;
     config.authenticationEnabled = true;
+    config.compressionEnabled = true;
     NymeaCore::instance()->configuration()->setWebSocketServerConfiguration(config);
 
 }
@@ -172,6 +181,163 @@ void TestWebSocketServer::introspect()
 
 }
 
+void TestWebSocketServer::compression()
+{
+    QWebSocket *socket = new QWebSocket("nymea tests", QWebSocketProtocol::Version13);
+    connect(socket, &QWebSocket::sslErrors, this, &TestWebSocketServer::sslErrors);
+    QSignalSpy connectedSpy(socket, &QWebSocket::connected);
+    socket->open(QUrl(QStringLiteral("wss://localhost:4444")));
+    connectedSpy.wait();
+    QVERIFY2(connectedSpy.count() > 0, "not connected");
+
+    // The handshake response is still uncompressed
+    QSignalSpy textSpy(socket, SIGNAL(textMessageReceived(QString)));
+    socket->sendTextMessage("{\"id\":0, \"method\": \"JSONRPC.Hello\", \"params\": {\"compression\": true}}");
+    textSpy.wait();
+    QCOMPARE(textSpy.count(), 1);
+    QVariantMap handShake = QJsonDocument::fromJson(textSpy.first().first().toByteArray()).toVariant().toMap();
+    QCOMPARE(handShake.value("params").toMap().value("compression").toBool(), true);
+
+    CompressionContext context(CompressionContext::FormatDeflateMessage);
+    QSignalSpy binarySpy(socket, SIGNAL(binaryMessageReceived(QByteArray)));
+    QStringList methods = {"JSONRPC.Introspect", "JSONRPC.Version", "JSONRPC.Version"};
+    QByteArray payload;
+    QByteArray data;
+    for (int i = 0; i < methods.count(); i++) {
+        binarySpy.clear();
+        QVariantMap call;
+        call.insert("id", i + 1);
+        call.insert("method", methods.at(i));
+        call.insert("token", QString::fromUtf8(m_apiToken));
+        socket->sendBinaryMessage(context.compress(QJsonDocument::fromVariant(call).toJson(QJsonDocument::Compact)));
+        binarySpy.wait();
+        QCOMPARE(binarySpy.count(), 1);
+
+        payload = binarySpy.first().first().toByteArray();
+        data.clear();
+        QVERIFY(context.decompress(payload, &data));
+        QVariantMap response = QJsonDocument::fromJson(data).toVariant().toMap();
+        QCOMPARE(response.value("id").toInt(), i + 1);
+        QCOMPARE(response.value("status").toString(), QStringLiteral("success"));
+    }
+    QCOMPARE(textSpy.count(), 1);
+
+    // The compression context is kept across messages, so a reply repeating a previous one compresses
+    // better than it would on its own
+    CompressionContext freshContext(CompressionContext::FormatDeflateMessage);
+    int freshSize = freshContext.compress(data).size();
+    qCDebug(dcTests()) << "Repeated reply compressed to" << payload.size() << "bytes, on its own" << freshSize << "bytes";
+    QVERIFY(payload.size() < freshSize);
+
+    socket->close();
+    socket->deleteLater();
+}
+
+void TestWebSocketServer::compressionSizeLimit()
+{
+    QWebSocket *socket = new QWebSocket("nymea tests", QWebSocketProtocol::Version13);
+    connect(socket, &QWebSocket::sslErrors, this, &TestWebSocketServer::sslErrors);
+    QSignalSpy connectedSpy(socket, &QWebSocket::connected);
+    socket->open(QUrl(QStringLiteral("wss://localhost:4444")));
+    connectedSpy.wait();
+    QVERIFY2(connectedSpy.count() > 0, "not connected");
+
+    QSignalSpy textSpy(socket, SIGNAL(textMessageReceived(QString)));
+    socket->sendTextMessage("{\"id\":0, \"method\": \"JSONRPC.Hello\", \"params\": {\"compression\": true}}");
+    textSpy.wait();
+    QCOMPARE(textSpy.count(), 1);
+
+    // A few kB inflating beyond the message size limit are rejected and the connection is dropped
+    CompressionContext context(CompressionContext::FormatDeflateMessage);
+    QByteArray payload = context.compress(QByteArray(CompressionContext::maxDecompressedSize + 1, ' '));
+    QVERIFY(payload.size() < 16 * 1024);
+    QSignalSpy disconnectedSpy(socket, &QWebSocket::disconnected);
+    socket->sendBinaryMessage(payload);
+    if (disconnectedSpy.isEmpty()) disconnectedSpy.wait();
+    QCOMPARE(disconnectedSpy.count(), 1);
+
+    socket->deleteLater();
+}
+
+void TestWebSocketServer::benchmarkStartupSequenceBytes()
+{
+    qint64 plainBytes = startupSequenceBytes(false);
+    qint64 compressedBytes = startupSequenceBytes(true);
+    QVERIFY(plainBytes > 0);
+    QVERIFY(compressedBytes > 0);
+
+    qCDebug(dcTests()) << "Bytes on the wire for the startup sequence. Uncompressed:" << plainBytes << "Compressed:" << compressedBytes
+                       << QString("(%1%)").arg(compressedBytes * 100.0 / plainBytes, 0, 'f', 1);
+    QVERIFY(compressedBytes * 3 < plainBytes);
+}
+
+qint64 TestWebSocketServer::startupSequenceBytes(bool compression)
+{
+    QWebSocket socket("nymea tests", QWebSocketProtocol::Version13);
+    connect(&socket, &QWebSocket::sslErrors, this, &TestWebSocketServer::sslErrors);
+    QSignalSpy spyConnection(&socket, SIGNAL(connected()));
+    socket.open(QUrl(QStringLiteral("wss://localhost:4444")));
+    spyConnection.wait();
+    if (spyConnection.count() == 0) {
+        return -1;
+    }
+
+    QSignalSpy textSpy(&socket, SIGNAL(textMessageReceived(QString)));
+    QSignalSpy binarySpy(&socket, SIGNAL(binaryMessageReceived(QByteArray)));
+    CompressionContext context(CompressionContext::FormatDeflateMessage);
+
+    QStringList methods = {"JSONRPC.Hello", "JSONRPC.Introspect", "Integrations.GetVendors", "Integrations.GetThingClasses",
+                           "Integrations.GetThings", "Rules.GetRules", "Tags.GetTags"};
+    qint64 bytes = 0;
+    for (int i = 0; i < methods.count(); i++) {
+        QVariantMap call;
+        call.insert("id", i);
+        call.insert("method", methods.at(i));
+        call.insert("token", QString::fromUtf8(m_apiToken));
+        if (i == 0 && compression) {
+            QVariantMap params;
+            params.insert("compression", true);
+            call.insert("params", params);
+        }
+        QByteArray data = QJsonDocument::fromVariant(call).toJson(QJsonDocument::Compact);
+
+        // Everything after the handshake is compressed
+        bool compressed = compression && i > 0;
+        QSignalSpy &spy = compressed ? binarySpy : textSpy;
+        textSpy.clear();
+        binarySpy.clear();
+        if (compressed) {
+            socket.sendBinaryMessage(context.compress(data));
+        } else {
+            socket.sendTextMessage(data);
+        }
+        if (spy.isEmpty()) {
+            spy.wait();
+        }
+        if (spy.count() != 1) {
+            qWarning() << "No response for" << methods.at(i);
+            return -1;
+        }
+
+        QByteArray payload = compressed ? spy.first().first().toByteArray() : spy.first().first().toString().toUtf8();
+        bytes += payload.size();
+        if (compressed) {
+            QByteArray decompressed;
+            if (!context.decompress(payload, &decompressed)) {
+                return -1;
+            }
+            payload = decompressed;
+        }
+        QVariantMap response = QJsonDocument::fromJson(payload).toVariant().toMap();
+        if (response.value("id").toInt() != i || response.value("status").toString() != "success") {
+            qWarning() << "Unexpected response for" << methods.at(i) << response;
+            return -1;
+        }
+    }
+    socket.close();
+    return bytes;
+}
+
 QVariant TestWebSocketServer::injectSocketAndWait(const QString &method, const QVariantMap &params)
 {
     QVariantMap call;